@@ -0,0 +1,145 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS arena allocator.
+ *
+ * An arena hands out memory by bumping a pointer through chunks of memory, and
+ * frees everything it handed out at once. It suits tasks that allocate many
+ * short-lived objects per unit of work (e.g. per request), and drop all of them
+ * when the work is done.
+ *
+ * The chunks are blocks taken from a pool allocator (see pool_alloc.h). An
+ * allocation only touches the pool when the current chunk is full, otherwise
+ * it's a pointer bump without any locking. Since the chunks are linked through
+ * their first words in the same way as the pool's list of free blocks, any
+ * number of them is given back to the pool with a single
+ * os_pool_alloc_give_chain() call, which makes os_arena_reset() and
+ * os_arena_rewind() O(1).
+ *
+ * An arena belongs to a single task. It can be bound to the task with
+ * os_task_set_arena(), after which the task can allocate from it with
+ * os_arena_task_alloc().
+ */
+
+#ifndef MOUROS_ARENA_H_
+#define MOUROS_ARENA_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+#include <mouros/pool_alloc.h> // For the pool allocator.
+
+
+/**
+ * The alignment of the memory returned by os_arena_alloc().
+ */
+#define OS_ARENA_ALIGN 8
+
+/**
+ * The number of bytes at the beginning of every chunk used for linking the
+ * chunks together.
+ */
+#define OS_ARENA_CHUNK_HEADER_SIZE \
+	((uint32_t) ((sizeof(void *) + OS_ARENA_ALIGN - 1) / OS_ARENA_ALIGN * \
+	             OS_ARENA_ALIGN))
+
+
+/**
+ * Struct holding information about an arena.
+ */
+typedef struct arena {
+	/** The pool the chunks are taken from. */
+	pool_alloc_t *pool;
+	/** The oldest chunk. Its first word points to the next chunk. */
+	void *first_chunk;
+	/** The chunk allocations are currently made from. */
+	void *last_chunk;
+	/** The number of chunks held by the arena. */
+	uint32_t num_chunks;
+	/** The next free byte in last_chunk. */
+	uint8_t *next_free;
+	/** The end of last_chunk. */
+	uint8_t *end;
+} arena_t;
+
+/**
+ * A position in an arena, to which the arena can be rewound.
+ */
+typedef struct arena_mark {
+	/** The chunk allocations were made from. */
+	void *chunk;
+	/** The number of chunks held by the arena. */
+	uint32_t num_chunks;
+	/** The next free byte in chunk. */
+	uint8_t *next_free;
+} arena_mark_t;
+
+
+/**
+ * Initializes an empty arena. No chunks are taken until the first allocation.
+ *
+ * @note The pool block size must be larger than OS_ARENA_CHUNK_HEADER_SIZE and
+ *       a multiple of OS_ARENA_ALIGN, and the blocks should be aligned to
+ *       OS_ARENA_ALIGN bytes.
+ *
+ * @param arena Pointer to the arena struct to be initialized.
+ * @param pool  The pool to take the chunks from.
+ */
+void os_arena_init(arena_t *arena, pool_alloc_t *pool);
+
+/**
+ * Allocates size bytes from the arena, aligned to OS_ARENA_ALIGN bytes.
+ *
+ * @param arena Pointer to the arena struct.
+ * @param size  The requested size. Can be at most the pool block size minus
+ *              OS_ARENA_CHUNK_HEADER_SIZE.
+ * @return Pointer to the allocated memory, or NULL if the request is too large
+ *         or the pool is empty.
+ */
+void *os_arena_alloc(arena_t *arena, uint32_t size);
+
+/**
+ * Allocates size bytes from the arena of the current task (see
+ * os_task_set_arena()).
+ *
+ * @param size The requested size.
+ * @return Pointer to the allocated memory, or NULL on error or if the task has
+ *         no arena.
+ */
+void *os_arena_task_alloc(uint32_t size);
+
+/**
+ * Remembers the current position in the arena.
+ *
+ * @param arena Pointer to the arena struct.
+ * @param mark  Pointer to the struct to store the position.
+ */
+void os_arena_mark(arena_t *arena, arena_mark_t *mark);
+
+/**
+ * Frees everything allocated after the mark was taken. Chunks which become
+ * unused are given back to the pool.
+ *
+ * @param arena Pointer to the arena struct.
+ * @param mark  A position stored by os_arena_mark() since the last
+ *              os_arena_reset() or os_arena_release().
+ */
+void os_arena_rewind(arena_t *arena, const arena_mark_t *mark);
+
+/**
+ * Frees everything allocated from the arena. The first chunk is kept for the
+ * following allocations, the rest are given back to the pool.
+ *
+ * @param arena Pointer to the arena struct.
+ */
+void os_arena_reset(arena_t *arena);
+
+/**
+ * Frees everything allocated from the arena, and gives all the chunks back to
+ * the pool.
+ *
+ * @param arena Pointer to the arena struct.
+ */
+void os_arena_release(arena_t *arena);
+
+
+#endif /* MOUROS_ARENA_H_ */
@@ -0,0 +1,115 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS bitmap pool allocator.
+ *
+ * Like the pool allocator (see pool_alloc.h), this allocator hands out blocks
+ * of a predefined size. Instead of a linked list threaded through the free
+ * blocks, it keeps one bit per block in a separate bitmap. Because of this:
+ *
+ * - Free blocks are never touched by the allocator, so their contents survive
+ *   and no cache lines of the backing memory are pulled in by the bookkeeping.
+ * - Runs of adjacent blocks can be allocated with os_bitmap_pool_take_run(),
+ *   e.g. for variable-size DMA buffers.
+ *
+ * A free block is found by scanning the bitmap a word at a time and picking
+ * the lowest set bit with a count trailing zeros operation, so a search costs
+ * O(words) rather than O(blocks). Allocations are first-fit, from the lowest
+ * address up.
+ *
+ * A second bitmap marks the last block of every allocated run, which lets
+ * os_bitmap_pool_give() free a whole run given just its first block.
+ *
+ * The bitmaps are updated in a short critical section, so the allocator can be
+ * used from both tasks and interrupt handlers.
+ */
+
+#ifndef MOUROS_BITMAP_POOL_H_
+#define MOUROS_BITMAP_POOL_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+
+/**
+ * The number of 32-bit words needed for the bitmaps of a pool of num_blocks
+ * blocks (see os_bitmap_pool_init()).
+ */
+#define OS_BITMAP_POOL_MAP_WORDS(num_blocks) (2 * (((num_blocks) + 31) / 32))
+
+/**
+ * Struct holding information about the bitmap pool.
+ */
+typedef struct bitmap_pool {
+	/** Pointer to the first block. */
+	uint8_t *mem;
+	/** The size (in bytes) of blocks in this pool. */
+	uint32_t block_size;
+	/** The number of blocks in the pool. */
+	uint32_t num_blocks;
+	/** The number of free blocks. */
+	volatile uint32_t num_free;
+	/** Bitmap with a bit set for every free block. */
+	uint32_t *free_map;
+	/** Bitmap with a bit set for the last block of every allocated run. */
+	uint32_t *end_map;
+} bitmap_pool_t;
+
+
+/**
+ * Initialization function for bitmap_pool_t. This must be called before a pool
+ * is used. All blocks start out free.
+ *
+ * @param pool        Pointer to the pool struct to be initialized.
+ * @param backing_mem Pointer to the beginning of a memory area that should hold
+ *                    the individual blocks. This needs to be at least
+ *                    block_size * num_blocks bytes large.
+ * @param block_size  The size (in bytes) of an individual block.
+ * @param num_blocks  The number of blocks in the pool.
+ * @param map         Array of OS_BITMAP_POOL_MAP_WORDS(num_blocks) words to
+ *                    hold the bitmaps.
+ */
+void os_bitmap_pool_init(bitmap_pool_t *pool,
+                         void *backing_mem,
+                         uint32_t block_size,
+                         uint32_t num_blocks,
+                         uint32_t *map);
+
+/**
+ * Returns a pointer to a single block of block_size bytes.
+ *
+ * @param pool Pointer to the pool struct.
+ * @return Pointer to the block, or NULL if the pool is empty.
+ */
+void *os_bitmap_pool_take(bitmap_pool_t *pool);
+
+/**
+ * Returns a pointer to num adjacent blocks, i.e. to a contiguous area of
+ * num * block_size bytes.
+ *
+ * @param pool Pointer to the pool struct.
+ * @param num  The number of blocks in the run. Must be at least 1.
+ * @return Pointer to the first block of the run, or NULL if there's no run of
+ *         num free blocks.
+ */
+void *os_bitmap_pool_take_run(bitmap_pool_t *pool, uint32_t num);
+
+/**
+ * Returns a block, or a whole run of blocks, to the pool.
+ *
+ * @param pool  Pointer to the pool struct.
+ * @param block Pointer returned by os_bitmap_pool_take() or
+ *              os_bitmap_pool_take_run().
+ */
+void os_bitmap_pool_give(bitmap_pool_t *pool, void *block);
+
+/**
+ * Returns the number of free blocks in the pool. The free blocks aren't
+ * necessarily adjacent.
+ *
+ * @param pool Pointer to the pool struct.
+ * @return The number of free blocks.
+ */
+uint32_t os_bitmap_pool_num_free(bitmap_pool_t *pool);
+
+
+#endif /* MOUROS_BITMAP_POOL_H_ */
@@ -140,5 +140,45 @@ void os_char_buffer_read_buf_blocking(mailbox_t *mb,
                                       char *buf,
                                       uint32_t buf_len);
 
+/**
+ * Returns the longest contiguous run of free space in the buffer. Meant for
+ * filling the buffer in large chunks, e.g. by a DMA engine receiving data.
+ *
+ * @param mb   Pointer to the mailbox implementing the character buffer.
+ * @param span Pointer to a location to store the start of the free space.
+ * @return The number of characters that can be written to span.
+ */
+uint32_t os_char_buffer_write_span(mailbox_t *mb, char **span);
+
+/**
+ * Marks len characters written into the span returned by
+ * os_char_buffer_write_span() as inserted into the buffer. Calls
+ * data_added_callback.
+ *
+ * @param mb  Pointer to the mailbox implementing the character buffer.
+ * @param len The number of characters written into the span.
+ */
+void os_char_buffer_write_commit(mailbox_t *mb, uint32_t len);
+
+/**
+ * Returns the longest contiguous run of characters stored in the buffer. Meant
+ * for draining the buffer in large chunks, e.g. by a DMA engine transmitting
+ * data.
+ *
+ * @param mb   Pointer to the mailbox implementing the character buffer.
+ * @param span Pointer to a location to store the start of the run.
+ * @return The number of characters that can be read from span.
+ */
+uint32_t os_char_buffer_read_span(mailbox_t *mb, const char **span);
+
+/**
+ * Removes len characters read from the span returned by
+ * os_char_buffer_read_span() from the buffer.
+ *
+ * @param mb  Pointer to the mailbox implementing the character buffer.
+ * @param len The number of characters read from the span.
+ */
+void os_char_buffer_read_commit(mailbox_t *mb, uint32_t len);
+
 
 #endif /* MOUROS_CHAR_BUFFER_H_ */
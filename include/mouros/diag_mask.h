@@ -0,0 +1,82 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS diagnostic event categories.
+ *
+ * Every event in diag_config.json belongs to a category. A category can be
+ * left out of the build by leaving it out of OS_DIAG_BUILD_MASK (set with the
+ * DIAG_CATEGORIES CMake variable), in which case its event sites compile to
+ * nothing. The categories that are built in can further be switched on and off
+ * at runtime with os_diag_set_mask(). An event site then costs a single load
+ * and test of the mask while its category is off.
+ */
+
+#ifndef MOUROS_DIAG_MASK_H_
+#define MOUROS_DIAG_MASK_H_
+
+#include <stdint.h> // For uint32_t.
+
+
+/** Task switches, blocking and wakeups ("sched" in diag_config.json). */
+#define OS_DIAG_CAT_SCHED (1 << 0)
+/** Newlib system calls ("syscall" in diag_config.json). */
+#define OS_DIAG_CAT_SYSCALL (1 << 1)
+/** Periodic task stack usage reports ("stack" in diag_config.json). */
+#define OS_DIAG_CAT_STACK (1 << 2)
+/** Pool allocator statistics ("pool" in diag_config.json). */
+#define OS_DIAG_CAT_POOL (1 << 3)
+/** Resource contention waits and statistics ("sync" in diag_config.json). */
+#define OS_DIAG_CAT_SYNC (1 << 4)
+/** Profiler samples ("profile" in diag_config.json). */
+#define OS_DIAG_CAT_PROFILE (1 << 5)
+
+/** All the categories. */
+#define OS_DIAG_CAT_ALL \
+	(OS_DIAG_CAT_SCHED | OS_DIAG_CAT_SYSCALL | OS_DIAG_CAT_STACK | \
+	 OS_DIAG_CAT_POOL | OS_DIAG_CAT_SYNC | OS_DIAG_CAT_PROFILE)
+
+#ifdef DIAG_ENABLE
+#ifndef OS_DIAG_BUILD_MASK
+/** The categories compiled in. */
+#define OS_DIAG_BUILD_MASK OS_DIAG_CAT_ALL
+#endif
+#else
+#undef OS_DIAG_BUILD_MASK
+#define OS_DIAG_BUILD_MASK 0
+#endif
+
+#ifndef OS_DIAG_DEFAULT_MASK
+/** The categories enabled at startup. */
+#define OS_DIAG_DEFAULT_MASK OS_DIAG_CAT_ALL
+#endif
+
+/**
+ * Evaluates to true if the events of the category cat (e.g. SCHED) should be
+ * logged. Constant false if the category isn't built in.
+ */
+#define OS_DIAG_ENABLED(cat) \
+	((OS_DIAG_BUILD_MASK & OS_DIAG_CAT_##cat) != 0 && \
+	 (os_diag_mask & OS_DIAG_CAT_##cat) != 0)
+
+
+/**
+ * The categories enabled at runtime. Use os_diag_set_mask() to change it.
+ */
+extern volatile uint32_t os_diag_mask;
+
+
+/**
+ * Sets the categories of the events to log. The categories not built in stay
+ * off.
+ *
+ * @param mask Bitwise OR of the OS_DIAG_CAT_* values.
+ */
+void os_diag_set_mask(uint32_t mask);
+
+/**
+ * Returns the categories of the events being logged.
+ */
+uint32_t os_diag_get_mask(void);
+
+
+#endif /* MOUROS_DIAG_MASK_H_ */
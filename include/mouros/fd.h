@@ -0,0 +1,115 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of functions and data types for the
+ * MourOS file descriptor table.
+ *
+ * The file descriptor table maps the file descriptors used by newlib (stdin,
+ * stdout, stderr and any user registered descriptors) onto character buffers
+ * (see char_buffer.h). Data written to a descriptor, e.g. by printf(), is
+ * queued in its tx buffer, and data read from a descriptor is taken from its rx
+ * buffer. A driver, e.g. a UART interrupt handler or a DMA transfer, moves the
+ * data between the buffers and the hardware.
+ *
+ * Unless a descriptor is opened with OS_FD_NONBLOCK, a write to a full buffer
+ * blocks the calling task until the driver reads from the buffer, and a read
+ * from an empty buffer blocks the calling task until some data arrives. Only
+ * one task at a time may block reading a descriptor. Before the scheduler is
+ * started, reads and writes never block, and return what they could transfer.
+ *
+ * Several tasks may write to the same descriptor, but writes aren't atomic: if
+ * the buffer fills up during a write, data from other writers may be inserted
+ * between its parts.
+ */
+
+#ifndef MOUROS_FD_H_
+#define MOUROS_FD_H_
+
+#include <stdint.h>  // For uint32_t, etc.
+#include <stdbool.h> // For bool.
+
+#include <mouros/mailbox.h> // For the mailbox struct.
+
+
+#ifndef OS_FD_MAX_FDS
+/**
+ * The number of entries in the file descriptor table.
+ */
+#define OS_FD_MAX_FDS 8
+#endif
+
+/**
+ * Flag making reads & writes return EAGAIN instead of blocking.
+ */
+#define OS_FD_NONBLOCK (1 << 0)
+
+
+/**
+ * Maps the file descriptor fd onto a pair of character buffers. Replaces any
+ * previous mapping of fd. Typically used to set up STDIN_FILENO, STDOUT_FILENO
+ * and STDERR_FILENO.
+ *
+ * @param fd    The file descriptor. Must be less than OS_FD_MAX_FDS.
+ * @param rx    The character buffer to read data from. Can be NULL for write
+ *              only descriptors.
+ * @param tx    The character buffer to write data to. Can be NULL for read only
+ *              descriptors.
+ * @param flags Either 0 or OS_FD_NONBLOCK.
+ * @return True on success, false if fd is out of range.
+ */
+bool os_fd_set(int fd, mailbox_t *rx, mailbox_t *tx, uint32_t flags);
+
+/**
+ * Maps the lowest unused file descriptor above STDERR_FILENO onto a pair of
+ * character buffers.
+ *
+ * @param rx    The character buffer to read data from. Can be NULL.
+ * @param tx    The character buffer to write data to. Can be NULL.
+ * @param flags Either 0 or OS_FD_NONBLOCK.
+ * @return The file descriptor, or -1 if the table is full.
+ */
+int os_fd_open(mailbox_t *rx, mailbox_t *tx, uint32_t flags);
+
+/**
+ * Removes the mapping of the file descriptor fd.
+ *
+ * @param fd The file descriptor.
+ * @return True on success, false if fd isn't mapped.
+ */
+bool os_fd_close(int fd);
+
+/**
+ * Checks whether the file descriptor fd is mapped.
+ *
+ * @param fd The file descriptor.
+ * @return True if fd is mapped, false otherwise.
+ */
+bool os_fd_is_open(int fd);
+
+/**
+ * Writes up to count bytes to the file descriptor fd.
+ *
+ * @note Blocking descriptors must not be written to from interrupt handlers.
+ *
+ * @param fd    The file descriptor.
+ * @param buf   Pointer to the data to be written.
+ * @param count The number of bytes in buf.
+ * @return The number of bytes written, or a negated errno value on error.
+ */
+int32_t os_fd_write(int fd, const void *buf, uint32_t count);
+
+/**
+ * Reads up to count bytes from the file descriptor fd. A blocking read returns
+ * as soon as at least one byte is available.
+ *
+ * @note Blocking descriptors must not be read from interrupt handlers.
+ *
+ * @param fd    The file descriptor.
+ * @param buf   Pointer to the buffer to store the data.
+ * @param count The size of buf.
+ * @return The number of bytes read, or a negated errno value on error.
+ */
+int32_t os_fd_read(int fd, void *buf, uint32_t count);
+
+
+#endif /* MOUROS_FD_H_ */
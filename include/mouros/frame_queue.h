@@ -0,0 +1,176 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of functions and data types for the
+ * MourOS variable-length frame queues.
+ *
+ * A frame queue stores variable-length records (frames) in a circular byte
+ * buffer. Every frame is prefixed by a two byte little-endian length header,
+ * so a frame only takes as much space as it actually needs.
+ *
+ * Frames are never split across the end of the buffer. If a frame doesn't fit
+ * into the space left before the end of the buffer, a wrap marker is written
+ * and the frame is placed at the beginning of the buffer instead. Thanks to
+ * this, every frame can be accessed in place (see os_frame_queue_peek()), and
+ * whole runs of frames can be handed to e.g. a DMA engine (see
+ * os_frame_queue_peek_span()).
+ *
+ * The queue is safe for a single producer and a single consumer.
+ */
+
+#ifndef MOUROS_FRAME_QUEUE_H_
+#define MOUROS_FRAME_QUEUE_H_
+
+#include <stdint.h>  // For uint32_t, etc.
+#include <stdbool.h> // For bool.
+
+
+/**
+ * The size of the length header preceding every frame.
+ */
+#define OS_FRAME_QUEUE_HEADER_SIZE 2
+
+/**
+ * The maximum length of a single frame.
+ */
+#define OS_FRAME_QUEUE_MAX_FRAME_LEN 0xfffe
+
+
+/**
+ * A structure representing a variable-length frame queue.
+ */
+typedef struct frame_queue {
+	/**
+	 * Pointer to the beginning of the memory segment holding the frames.
+	 */
+	uint8_t *buf;
+	/**
+	 * The size of the memory area pointed to by buf.
+	 */
+	uint32_t buf_len;
+	/**
+	 * Internal position of the next frame to be read.
+	 */
+	volatile uint32_t read_pos;
+	/**
+	 * Internal position the next frame will be written to.
+	 */
+	volatile uint32_t write_pos;
+	/**
+	 * Internal position of the frame reserved by os_frame_queue_reserve().
+	 */
+	uint32_t reserved_pos;
+	/**
+	 * Internal length of the frame reserved by os_frame_queue_reserve().
+	 */
+	uint16_t reserved_len;
+	/**
+	 * Callback function called when a new frame is inserted into the queue.
+	 */
+	void (*data_added)(void);
+} frame_queue_t;
+
+
+/**
+ * Initializes the frame queue struct (queue).
+ *
+ * @param queue               Pointer to the struct to be initialized.
+ * @param buf                 Pointer to the memory area to hold the frames.
+ * @param buf_len             The size of buf in bytes.
+ * @param data_added_callback Optional callback that gets called every time a
+ *                            new frame is added to the queue. Can be NULL.
+ */
+void os_frame_queue_init(frame_queue_t *queue,
+                         void *buf,
+                         uint32_t buf_len,
+                         void (*data_added_callback)(void));
+
+/**
+ * Reserves space for a frame of len bytes. The frame data can then be written
+ * directly into the returned memory, and the frame is made visible to the
+ * reader by os_frame_queue_commit().
+ *
+ * @note The returned pointer isn't aligned in any way.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param len   The length of the frame.
+ * @return Pointer to the space reserved for the frame data, or NULL if there
+ *         isn't enough free space in the queue.
+ */
+void *os_frame_queue_reserve(frame_queue_t *queue, uint16_t len);
+
+/**
+ * Commits the frame reserved by the last os_frame_queue_reserve() call, and
+ * calls data_added_callback.
+ *
+ * @param queue Pointer to the queue struct.
+ */
+void os_frame_queue_commit(frame_queue_t *queue);
+
+/**
+ * Inserts a whole frame into the queue, or nothing at all if there isn't
+ * enough free space. Calls data_added_callback if the insertion was
+ * successful.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param data  Pointer to the frame data.
+ * @param len   The length of the frame.
+ * @return True if the frame was inserted, false otherwise.
+ */
+bool os_frame_queue_write(frame_queue_t *queue, const void *data, uint16_t len);
+
+/**
+ * Returns the oldest frame in the queue without removing it. The frame stays
+ * valid until it's removed by os_frame_queue_consume().
+ *
+ * @note The returned pointer isn't aligned in any way.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param len   Pointer to a location to store the length of the frame.
+ * @return Pointer to the frame data, or NULL if the queue is empty.
+ */
+const void *os_frame_queue_peek(frame_queue_t *queue, uint16_t *len);
+
+/**
+ * Removes the oldest frame from the queue.
+ *
+ * @param queue Pointer to the queue struct.
+ */
+void os_frame_queue_consume(frame_queue_t *queue);
+
+/**
+ * Copies the oldest frame out of the queue and removes it.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param out   Pointer to a place in memory to store the frame.
+ * @param len   On input the size of out. On output the length of the frame.
+ * @return True if a frame was read. False if the queue was empty, or if the
+ *         frame is longer than out (in which case it stays in the queue and its
+ *         length is stored in len).
+ */
+bool os_frame_queue_read(frame_queue_t *queue, void *out, uint16_t *len);
+
+/**
+ * Returns the longest contiguous run of whole frames, including their length
+ * headers, starting at the oldest frame. The run ends at the newest frame or
+ * at the point where the frames wrap to the beginning of the buffer.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param len   Pointer to a location to store the length of the run in bytes.
+ * @return Pointer to the beginning of the run, or NULL if the queue is empty.
+ */
+const void *os_frame_queue_peek_span(frame_queue_t *queue, uint32_t *len);
+
+/**
+ * Removes len bytes worth of frames from the queue.
+ *
+ * @note len must end on a frame boundary within the run returned by
+ *       os_frame_queue_peek_span().
+ *
+ * @param queue Pointer to the queue struct.
+ * @param len   The number of bytes to remove.
+ */
+void os_frame_queue_consume_span(frame_queue_t *queue, uint32_t len);
+
+
+#endif /* MOUROS_FRAME_QUEUE_H_ */
@@ -12,6 +12,40 @@
 #include <stdint.h>  // For uint32_t, etc.
 #include <stdbool.h> // For bool.
 
+struct tcb;
+struct mailbox;
+
+/**
+ * Value of the delimiter parameter of os_mailbox_set_notify() disabling
+ * delimiter triggered notifications.
+ */
+#define OS_MAILBOX_NO_DELIMITER (-1)
+
+/**
+ * A structure holding the notification policy of a mailbox. See
+ * os_mailbox_set_notify(). All the members are internal.
+ */
+typedef struct mailbox_notify {
+	/** The fill level in bytes at which notifications are triggered. */
+	uint32_t threshold_bytes;
+	/** The number of ticks without writes after which pending data
+	 *  triggers a notification. Zero if disabled. */
+	uint32_t idle_ticks;
+	/** The first message byte value triggering a notification, or
+	 *  OS_MAILBOX_NO_DELIMITER. */
+	int16_t delimiter;
+	/** True if the idle timeout is running. */
+	bool idle_armed;
+	/** True if the struct is in the list of running idle timeouts. */
+	bool idle_listed;
+	/** The tick count at which the idle timeout expires. */
+	uint64_t idle_deadline;
+	/** The mailbox this policy belongs to. */
+	struct mailbox *mb;
+	/** The next struct in the list of running idle timeouts. */
+	struct mailbox_notify *next;
+} mailbox_notify_t;
+
 
 /**
  * A structure representing a single circular FIFO mailbox buffer.
@@ -42,8 +76,23 @@ typedef struct mailbox {
 	uint32_t write_pos;
 	/**
 	 * Callback function called when new data is inserted into the mailbox.
+	 * With a notification policy set, it can also be called from the
+	 * SysTick interrupt handler (see os_mailbox_set_notify()).
 	 */
 	void (*data_added)(void);
+	/**
+	 * Pointer to the task blocked in os_mailbox_select() on this mailbox.
+	 */
+	struct tcb *waiting_task;
+	/**
+	 * Linked list of the tasks blocked in os_mailbox_wait_space() on this
+	 * mailbox.
+	 */
+	struct tcb *waiting_writers;
+	/**
+	 * Optional notification policy. If NULL, every write notifies.
+	 */
+	mailbox_notify_t *notify;
 } mailbox_t;
 
 
@@ -67,6 +116,42 @@ void os_mailbox_init(mailbox_t *mb,
                      uint32_t msg_size,
                      void (*data_added_callback)(void));
 
+/**
+ * Sets a notification policy for the mailbox. By default, the data_added
+ * callback is called (and a task waiting in os_mailbox_select() is woken up)
+ * on every write. With a policy set, this only happens when:
+ *  - the fill level crosses threshold messages, or the mailbox becomes full,
+ *  - a message starting with the delimiter byte is written, or
+ *  - data has been waiting for idle_ticks system ticks without any further
+ *    writes.
+ *
+ * This batches consumer wakeups, e.g. a line oriented char buffer can notify
+ * only on '\n' or after a short pause in the input. Further writes while the
+ * fill level stays at or above the threshold don't notify again.
+ *
+ * @note Idle timeout notifications are sent from the SysTick interrupt
+ *       handler, with interrupts masked. The data_added callback of a mailbox
+ *       with an idle timeout must therefore be safe to call from an interrupt
+ *       handler, must be short, and must not block. Waking up the task waiting
+ *       in os_mailbox_select() is safe.
+ *
+ * @param mb         Pointer to the mailbox struct.
+ * @param notify     Pointer to the struct to hold the policy. Must stay valid
+ *                   while it's in use. NULL restores the default behavior.
+ * @param threshold  The fill level (in messages) triggering a notification. 0
+ *                   means notify only when the mailbox is full.
+ * @param delimiter  The first message byte value triggering a notification, or
+ *                   OS_MAILBOX_NO_DELIMITER.
+ * @param idle_ticks The number of system ticks after the last write when
+ *                   pending data triggers a notification. 0 disables the idle
+ *                   timeout.
+ */
+void os_mailbox_set_notify(mailbox_t *mb,
+                           mailbox_notify_t *notify,
+                           uint32_t threshold,
+                           int16_t delimiter,
+                           uint32_t idle_ticks);
+
 /**
  * Inserts a new single message into the mailbox. Calls data_added_callback if
  * the insertion was successful.
@@ -177,5 +262,83 @@ uint32_t os_mailbox_read_multiple_atomic(mailbox_t *mb,
                                          void *out,
                                          uint32_t out_msg_num);
 
+/**
+ * Returns the longest contiguous run of free message slots, starting at the
+ * current write position. Together with os_mailbox_write_commit() this allows
+ * e.g. a DMA engine to fill the mailbox directly.
+ *
+ * @param mb   Pointer to the mailbox struct.
+ * @param span Pointer to a location to store the start of the free run.
+ * @return The number of messages that can be written to span.
+ */
+uint32_t os_mailbox_write_span(mailbox_t *mb, void **span);
+
+/**
+ * Advances the write position by msg_num messages, making them visible to the
+ * reader. Calls data_added_callback if msg_num isn't zero.
+ *
+ * @note msg_num must not be larger than the value returned by the preceding
+ *       os_mailbox_write_span() call.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msg_num The number of messages written into the span.
+ */
+void os_mailbox_write_commit(mailbox_t *mb, uint32_t msg_num);
+
+/**
+ * Returns the longest contiguous run of stored messages, starting at the
+ * current read position. Together with os_mailbox_read_commit() this allows
+ * e.g. a DMA engine to drain the mailbox directly.
+ *
+ * @param mb   Pointer to the mailbox struct.
+ * @param span Pointer to a location to store the start of the run.
+ * @return The number of messages that can be read from span.
+ */
+uint32_t os_mailbox_read_span(mailbox_t *mb, void **span);
+
+/**
+ * Advances the read position by msg_num messages, freeing their slots.
+ *
+ * @note msg_num must not be larger than the value returned by the preceding
+ *       os_mailbox_read_span() call.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msg_num The number of messages read from the span.
+ */
+void os_mailbox_read_commit(mailbox_t *mb, uint32_t msg_num);
+
+/**
+ * Checks which of the supplied mailboxes hold at least one message.
+ *
+ * @param mbs     Array of pointers to the mailboxes to be checked.
+ * @param num_mbs The number of mailboxes in mbs. At most 32.
+ * @return A bitmask with bit i set if mbs[i] can be read from.
+ */
+uint32_t os_mailbox_poll(mailbox_t **mbs, uint8_t num_mbs);
+
+/**
+ * Blocks the current task until at least one of the supplied mailboxes holds
+ * a message. The task is woken up by the first write into any of the
+ * mailboxes.
+ *
+ * @note Only a single task may wait on a particular mailbox at a time.
+ *
+ * @param mbs     Array of pointers to the mailboxes to wait on.
+ * @param num_mbs The number of mailboxes in mbs. At most 32.
+ * @return A bitmask with bit i set if mbs[i] can be read from. Never zero.
+ */
+uint32_t os_mailbox_select(mailbox_t **mbs, uint8_t num_mbs);
+
+/**
+ * Blocks the current task until the mailbox has room for at least one message.
+ * The waiting tasks are woken up by the first read from the mailbox. Any number
+ * of tasks may wait on a mailbox at the same time.
+ *
+ * @note Must not be called from interrupt handlers.
+ *
+ * @param mb Pointer to the mailbox struct.
+ */
+void os_mailbox_wait_space(mailbox_t *mb);
+
 
 #endif /* MOUROS_MAILBOX_H_ */
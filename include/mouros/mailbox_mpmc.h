@@ -0,0 +1,158 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of functions and data types for the
+ * MourOS multi-producer/multi-consumer mailboxes.
+ *
+ * The MPMC mailbox is a bounded queue where every message slot carries a
+ * sequence number. Producers and consumers claim a slot by atomically
+ * advancing a position counter, copy the message without holding any lock, and
+ * then publish the slot by updating its sequence number. This means tasks and
+ * ISRs of different priorities can write into (or read from) the same mailbox
+ * without disabling interrupts for the whole copy, and that a preempted
+ * producer never blocks other producers.
+ *
+ * On Cortex-M3/M4 the position counters are advanced with LDREX/STREX. The
+ * Cortex-M0 has no exclusive access instructions, so there each counter update
+ * is done in a (very short) critical section.
+ *
+ * @note A consumer can only read messages in slot order. If a producer claimed
+ *       a slot and got preempted before filling it, readers will see the
+ *       mailbox as empty until that producer finishes its write.
+ */
+
+#ifndef MOUROS_MAILBOX_MPMC_H_
+#define MOUROS_MAILBOX_MPMC_H_
+
+#include <stdint.h>  // For uint32_t, etc.
+#include <stdbool.h> // For bool.
+
+
+/**
+ * The size in bytes of a single slot of an MPMC mailbox holding messages of
+ * msg_size bytes. Every slot holds a 32-bit sequence number followed by the
+ * message, padded to a multiple of four bytes.
+ */
+#define OS_MAILBOX_MPMC_SLOT_SIZE(msg_size) \
+	(sizeof(uint32_t) + (((msg_size) + 3) & ~3u))
+
+/**
+ * The size in bytes of the buffer needed by an MPMC mailbox holding num_msgs
+ * messages of msg_size bytes.
+ */
+#define OS_MAILBOX_MPMC_BUF_SIZE(num_msgs, msg_size) \
+	((num_msgs) * OS_MAILBOX_MPMC_SLOT_SIZE(msg_size))
+
+
+/**
+ * A structure representing a multi-producer/multi-consumer FIFO mailbox.
+ */
+typedef struct mailbox_mpmc {
+	/**
+	 * Pointer to the beginning of the memory segment holding the mailbox
+	 * slots.
+	 */
+	uint8_t *slot_buf;
+	/**
+	 * The number of slots in slot_buf minus one.
+	 */
+	uint32_t mask;
+	/**
+	 * The size of a single mailbox message.
+	 */
+	uint32_t msg_size;
+	/**
+	 * The size of a single slot. See OS_MAILBOX_MPMC_SLOT_SIZE().
+	 */
+	uint32_t slot_size;
+	/**
+	 * Internal free running counter of the next slot to be written.
+	 */
+	volatile uint32_t write_pos;
+	/**
+	 * Internal free running counter of the next slot to be read.
+	 */
+	volatile uint32_t read_pos;
+	/**
+	 * Callback function called when new data is inserted into the mailbox.
+	 */
+	void (*data_added)(void);
+} mailbox_mpmc_t;
+
+
+/**
+ * Initializes the MPMC mailbox struct (mb).
+ *
+ * @note num_msgs must be a power of two, and slot_buf must be four byte
+ *       aligned.
+ *
+ * @param mb                  Pointer to the struct to be initialized.
+ * @param slot_buf            Pointer to the memory area to be used to hold the
+ *                            mailbox data. Must be at least
+ *                            OS_MAILBOX_MPMC_BUF_SIZE(num_msgs, msg_size)
+ *                            bytes large.
+ * @param num_msgs            The number of messages the mailbox can hold.
+ * @param msg_size            The size in bytes of a single message.
+ * @param data_added_callback Optional callback that gets called every time new
+ *                            data is added to the mailbox. Can be NULL.
+ */
+void os_mailbox_mpmc_init(mailbox_mpmc_t *mb,
+                          void *slot_buf,
+                          uint32_t num_msgs,
+                          uint32_t msg_size,
+                          void (*data_added_callback)(void));
+
+/**
+ * Inserts a new single message into the mailbox. Calls data_added_callback if
+ * the insertion was successful. Can be called concurrently from any number of
+ * tasks and ISRs.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param msg Pointer to the message to be inserted.
+ * @return True if the message was successfully added, false if the mailbox was
+ *         full.
+ */
+bool os_mailbox_mpmc_write(mailbox_mpmc_t *mb, const void *msg);
+
+/**
+ * Inserts up to msg_num messages into the mailbox. Calls data_added_callback
+ * once if at least one message was inserted.
+ *
+ * @note Messages from other producers may get interleaved with the inserted
+ *       messages.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msgs    Pointer to the messages to be added.
+ * @param msg_num The number of messages in msgs.
+ * @return The number of messages successfully inserted into the mailbox.
+ */
+uint32_t os_mailbox_mpmc_write_multiple(mailbox_mpmc_t *mb,
+                                        const void *msgs,
+                                        uint32_t msg_num);
+
+/**
+ * Reads a single message from the mailbox. Can be called concurrently from any
+ * number of tasks and ISRs.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param out Pointer to a place in memory to store the read message.
+ * @return True if a message was read into the location pointed to by out.
+ *         False if the mailbox was empty.
+ */
+bool os_mailbox_mpmc_read(mailbox_mpmc_t *mb, void *out);
+
+/**
+ * Reads up to out_msg_num messages from the mailbox into the location pointed
+ * to by out.
+ *
+ * @param mb          Pointer to the mailbox struct.
+ * @param out         Pointer to the data array
+ * @param out_msg_num The number of messages that can be stored in out.
+ * @return Returns the number of read messages.
+ */
+uint32_t os_mailbox_mpmc_read_multiple(mailbox_mpmc_t *mb,
+                                       void *out,
+                                       uint32_t out_msg_num);
+
+
+#endif /* MOUROS_MAILBOX_MPMC_H_ */
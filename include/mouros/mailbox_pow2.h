@@ -0,0 +1,284 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of functions and data types for the
+ * MourOS power-of-two mailboxes.
+ *
+ * A power-of-two mailbox behaves like the regular mailbox (see mailbox.h), but
+ * its message count must be a power of two. This allows the read and write
+ * positions to be kept as free running message counters, which are turned into
+ * buffer indexes by masking. The result is that index calculations need no
+ * wrap-around branches, and that all the message slots in the buffer are
+ * usable (the regular mailbox always keeps one slot empty to tell a full buffer
+ * from an empty one).
+ *
+ * The OS_MAILBOX_POW2_TYPED() macro can be used to generate inline accessors
+ * for a specific message type. Those have the message size folded in at
+ * compile time, so e.g. a char FIFO compiles down to a mask, a load and a
+ * store per byte.
+ */
+
+#ifndef MOUROS_MAILBOX_POW2_H_
+#define MOUROS_MAILBOX_POW2_H_
+
+#include <stddef.h>  // For NULL.
+#include <stdint.h>  // For uint32_t, etc.
+#include <stdbool.h> // For bool.
+
+
+/**
+ * A structure representing a single circular FIFO mailbox buffer with a power
+ * of two number of message slots.
+ */
+typedef struct mailbox_pow2 {
+	/**
+	 * Pointer to the beginning of the memory segment holding the mailbox
+	 * data.
+	 */
+	uint8_t *msg_buf;
+	/**
+	 * The number of message slots in msg_buf minus one. Used to mask the
+	 * message counters into slot indexes.
+	 */
+	uint32_t mask;
+	/**
+	 * The size of a single mailbox message.
+	 */
+	uint32_t msg_size;
+	/**
+	 * Internal free running counter of messages read from the mailbox.
+	 */
+	volatile uint32_t read_cnt;
+	/**
+	 * Internal free running counter of messages written into the mailbox.
+	 */
+	volatile uint32_t write_cnt;
+	/**
+	 * Callback function called when new data is inserted into the mailbox.
+	 */
+	void (*data_added)(void);
+} mailbox_pow2_t;
+
+
+/** @cond */
+static inline bool __os_mailbox_pow2_write(mailbox_pow2_t *mb,
+                                           const void *msg,
+                                           uint32_t msg_size)
+{
+	uint32_t write_cnt = mb->write_cnt;
+
+	if (write_cnt - mb->read_cnt > mb->mask) {
+		return false;
+	}
+
+	uint8_t *slot = &mb->msg_buf[(write_cnt & mb->mask) * msg_size];
+	for (uint32_t i = 0; i < msg_size; i++) {
+		slot[i] = ((const uint8_t *) msg)[i];
+	}
+
+	// The message must be in the buffer before the reader can see it.
+	asm volatile ("" ::: "memory");
+
+	mb->write_cnt = write_cnt + 1;
+
+	if (mb->data_added != NULL) {
+		mb->data_added();
+	}
+
+	return true;
+}
+
+static inline bool __os_mailbox_pow2_read(mailbox_pow2_t *mb,
+                                          void *out,
+                                          uint32_t msg_size)
+{
+	uint32_t read_cnt = mb->read_cnt;
+
+	if (read_cnt == mb->write_cnt) {
+		return false;
+	}
+
+	const uint8_t *slot = &mb->msg_buf[(read_cnt & mb->mask) * msg_size];
+	for (uint32_t i = 0; i < msg_size; i++) {
+		((uint8_t *) out)[i] = slot[i];
+	}
+
+	// The message must be copied out before the writer can reuse the slot.
+	asm volatile ("" ::: "memory");
+
+	mb->read_cnt = read_cnt + 1;
+
+	return true;
+}
+/** @endcond */
+
+/**
+ * Helper macro generating inline accessors for a power-of-two mailbox holding
+ * messages of a single type. The message size is a compile-time constant in
+ * the generated functions.
+ *
+ * For OS_MAILBOX_POW2_TYPED(uart_rx, char) the following is generated:
+ *  - void uart_rx_init(mailbox_pow2_t *mb, char *buf, uint32_t num_msgs,
+ *                      void (*data_added_callback)(void))
+ *  - bool uart_rx_write(mailbox_pow2_t *mb, const char *msg)
+ *  - bool uart_rx_read(mailbox_pow2_t *mb, char *out)
+ */
+#define OS_MAILBOX_POW2_TYPED(name, type) \
+	static inline void name##_init(mailbox_pow2_t *mb, \
+	                               type *buf, \
+	                               uint32_t num_msgs, \
+	                               void (*data_added_callback)(void)) \
+	{ \
+		os_mailbox_pow2_init(mb, buf, num_msgs, sizeof(type), \
+		                     data_added_callback); \
+	} \
+	\
+	static inline bool name##_write(mailbox_pow2_t *mb, const type *msg) \
+	{ \
+		return __os_mailbox_pow2_write(mb, msg, sizeof(type)); \
+	} \
+	\
+	static inline bool name##_read(mailbox_pow2_t *mb, type *out) \
+	{ \
+		return __os_mailbox_pow2_read(mb, out, sizeof(type)); \
+	}
+
+
+/**
+ * Initializes the power-of-two mailbox struct (mb).
+ *
+ * @note num_msgs must be a power of two.
+ *
+ * @param mb                  Pointer to the struct to be initialized.
+ * @param msg_buf             Pointer to the memory area to be used to hold the
+ *                            mailbox data. Must be num_msgs * msg_size bytes
+ *                            large.
+ * @param num_msgs            The number of messages in msg_buf. All of them
+ *                            can be used.
+ * @param msg_size            The size in bytes of a single message.
+ * @param data_added_callback Optional callback that gets called every time new
+ *                            data is added to the mailbox. Can be NULL.
+ */
+void os_mailbox_pow2_init(mailbox_pow2_t *mb,
+                          void *msg_buf,
+                          uint32_t num_msgs,
+                          uint32_t msg_size,
+                          void (*data_added_callback)(void));
+
+/**
+ * Returns the number of messages currently stored in the mailbox.
+ *
+ * @param mb Pointer to the mailbox struct.
+ * @return The number of messages that can be read.
+ */
+uint32_t os_mailbox_pow2_count(const mailbox_pow2_t *mb);
+
+/**
+ * Inserts a new single message into the mailbox. Calls data_added_callback if
+ * the insertion was successful.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param msg Pointer to the message to be inserted.
+ * @return True if the message was successfully added, false otherwise.
+ */
+bool os_mailbox_pow2_write(mailbox_pow2_t *mb, const void *msg);
+
+/**
+ * Inserts up to msg_num messages into the mailbox. Calls data_added_callback
+ * once if at least one message was inserted.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msgs    Pointer to the messages to be added.
+ * @param msg_num The number of messages in msgs.
+ * @return The number of messages successfully inserted into the mailbox.
+ */
+uint32_t os_mailbox_pow2_write_multiple(mailbox_pow2_t *mb,
+                                        const void *msgs,
+                                        uint32_t msg_num);
+
+/**
+ * Reads a single message from the mailbox.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param out Pointer to a place in memory to store the read message.
+ * @return True if there was at least one message in the mailbox. It will be
+ *         stored in the location pointed to by out. False if the mailbox was
+ *         empty.
+ */
+bool os_mailbox_pow2_read(mailbox_pow2_t *mb, void *out);
+
+/**
+ * Reads messages from the mailbox into the location pointed to by out. Reads
+ * either all the messages that are available in the mailbox, or out_msg_num
+ * messages, whichever is smaller.
+ *
+ * @param mb          Pointer to the mailbox struct.
+ * @param out         Pointer to the data array
+ * @param out_msg_num The number of messages that can be stored in out.
+ * @return Returns the number of read messages.
+ */
+uint32_t os_mailbox_pow2_read_multiple(mailbox_pow2_t *mb,
+                                       void *out,
+                                       uint32_t out_msg_num);
+
+/**
+ * Atomic version of os_mailbox_pow2_write.
+ *
+ * Atomicity is achieved by disabling interrupts, and the regular version is
+ * atomic for the single producer/single consumer case, so only use this if
+ * it's really needed.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param msg Pointer to the message to be inserted.
+ * @return True if the message was successfully added, false otherwise.
+ */
+bool os_mailbox_pow2_write_atomic(mailbox_pow2_t *mb, const void *msg);
+
+/**
+ * Atomic version of os_mailbox_pow2_write_multiple.
+ *
+ * Atomicity is achieved by disabling interrupts, and the regular version is
+ * atomic for the single producer/single consumer case, so only use this if
+ * it's really needed.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msgs    Pointer to the messages to be added.
+ * @param msg_num The number of messages in msgs.
+ * @return The number of messages successfully inserted into the mailbox.
+ */
+uint32_t os_mailbox_pow2_write_multiple_atomic(mailbox_pow2_t *mb,
+                                               const void *msgs,
+                                               uint32_t msg_num);
+
+/**
+ * Atomic version of os_mailbox_pow2_read.
+ *
+ * Atomicity is achieved by disabling interrupts, and the regular version is
+ * atomic for the single producer/single consumer case, so only use this if
+ * it's really needed.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param out Pointer to a place in memory to store the read message.
+ * @return True if there was at least one message in the mailbox. False if the
+ *         mailbox was empty.
+ */
+bool os_mailbox_pow2_read_atomic(mailbox_pow2_t *mb, void *out);
+
+/**
+ * Atomic version of os_mailbox_pow2_read_multiple.
+ *
+ * Atomicity is achieved by disabling interrupts, and the regular version is
+ * atomic for the single producer/single consumer case, so only use this if
+ * it's really needed.
+ *
+ * @param mb          Pointer to the mailbox struct.
+ * @param out         Pointer to the data array
+ * @param out_msg_num The number of messages that can be stored in out.
+ * @return Returns the number of read messages.
+ */
+uint32_t os_mailbox_pow2_read_multiple_atomic(mailbox_pow2_t *mb,
+                                              void *out,
+                                              uint32_t out_msg_num);
+
+
+#endif /* MOUROS_MAILBOX_POW2_H_ */
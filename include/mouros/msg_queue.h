@@ -0,0 +1,157 @@
+/**
+ * @file
+ *
+ * This file contains the declarations of functions and data types for the
+ * MourOS message queues.
+ *
+ * A message queue passes pointers to blocks taken from a pool allocator (see
+ * pool_alloc.h) instead of copying the message contents through a mailbox.
+ * The sender takes a block, fills it and sends it. The ownership of the block
+ * is transferred to the receiver, which processes the message and returns the
+ * block to the pool. Sending a message costs the same regardless of its size.
+ *
+ * Optionally, messages can be reference counted (see os_msg_alloc()). Such a
+ * message can be sent to several queues at once, and its block is returned to
+ * the pool once every receiver has released it.
+ */
+
+#ifndef MOUROS_MSG_QUEUE_H_
+#define MOUROS_MSG_QUEUE_H_
+
+#include <stdint.h>  // For uint32_t, etc.
+#include <stdbool.h> // For bool.
+
+#include <mouros/mailbox.h>    // For the mailbox struct & functions.
+#include <mouros/pool_alloc.h> // For the pool allocator.
+
+
+/**
+ * Header placed in front of the payload of reference counted messages.
+ */
+struct msg_header {
+	/** The pool the message block was taken from. */
+	pool_alloc_t *pool;
+	/** The number of references to the message. */
+	volatile uint32_t refs;
+};
+
+/**
+ * The number of bytes reserved in front of the payload of a reference counted
+ * message. Keeps the payload 8 byte aligned.
+ */
+#define OS_MSG_HEADER_SIZE ((sizeof(struct msg_header) + 7) & ~7u)
+
+/**
+ * The pool block size needed for reference counted messages with payloads of
+ * payload_size bytes.
+ */
+#define OS_MSG_BLOCK_SIZE(payload_size) (OS_MSG_HEADER_SIZE + (payload_size))
+
+
+/**
+ * A structure representing a queue of message block pointers.
+ */
+typedef struct msg_queue {
+	/** The mailbox holding the queued block pointers. */
+	mailbox_t mb;
+	/** The pool the queued blocks are allocated from. */
+	pool_alloc_t *pool;
+} msg_queue_t;
+
+
+/**
+ * Initializes the message queue struct (queue).
+ *
+ * @param queue               Pointer to the struct to be initialized.
+ * @param ptr_buf             Array to hold the queued pointers.
+ * @param num_msgs            The number of elements in ptr_buf.
+ * @param pool                The pool the messages are allocated from.
+ * @param data_added_callback Optional callback that gets called every time a
+ *                            message is sent. Can be NULL.
+ */
+void os_msg_queue_init(msg_queue_t *queue,
+                       void **ptr_buf,
+                       uint32_t num_msgs,
+                       pool_alloc_t *pool,
+                       void (*data_added_callback)(void));
+
+/**
+ * Takes a block for a new message from the queue's pool.
+ *
+ * @param queue Pointer to the queue struct.
+ * @return Pointer to the message block, or NULL if the pool is empty.
+ */
+void *os_msg_queue_alloc(msg_queue_t *queue);
+
+/**
+ * Sends the message block to the queue. The receiver becomes the owner of the
+ * block on success.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param msg   Pointer to the message block.
+ * @return True if the message was queued. False if the queue was full, in
+ *         which case the caller still owns the block.
+ */
+bool os_msg_queue_send(msg_queue_t *queue, void *msg);
+
+/**
+ * Receives the next message block from the queue. The caller becomes the owner
+ * of the block and must return it with os_msg_queue_free() (or os_msg_release()
+ * for reference counted messages) once done.
+ *
+ * @param queue Pointer to the queue struct.
+ * @return Pointer to the message block, or NULL if the queue was empty.
+ */
+void *os_msg_queue_receive(msg_queue_t *queue);
+
+/**
+ * Returns a received message block to the queue's pool.
+ *
+ * @param queue Pointer to the queue struct.
+ * @param msg   Pointer to the message block.
+ */
+void os_msg_queue_free(msg_queue_t *queue, void *msg);
+
+/**
+ * Takes a block for a new reference counted message from pool. The message
+ * starts with a single reference owned by the caller.
+ *
+ * @note The pool block size must be at least OS_MSG_BLOCK_SIZE() of the
+ *       payload.
+ *
+ * @param pool The pool to take the block from.
+ * @return Pointer to the message payload, or NULL if the pool is empty.
+ */
+void *os_msg_alloc(pool_alloc_t *pool);
+
+/**
+ * Adds count references to a reference counted message.
+ *
+ * @param msg   Pointer to the message payload.
+ * @param count The number of references to add.
+ */
+void os_msg_ref(void *msg, uint32_t count);
+
+/**
+ * Drops a reference to a reference counted message. The message block is
+ * returned to its pool once the last reference is dropped.
+ *
+ * @param msg Pointer to the message payload.
+ */
+void os_msg_release(void *msg);
+
+/**
+ * Sends a reference counted message to several queues. Every queue receiving
+ * the message gets its own reference, and the caller's reference is consumed.
+ *
+ * @param queues     Array of pointers to the target queues.
+ * @param num_queues The number of elements in queues.
+ * @param msg        Pointer to the message payload.
+ * @return The number of queues the message was sent to.
+ */
+uint32_t os_msg_queue_send_multi(msg_queue_t **queues,
+                                 uint32_t num_queues,
+                                 void *msg);
+
+
+#endif /* MOUROS_MSG_QUEUE_H_ */
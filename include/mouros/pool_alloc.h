@@ -10,6 +10,31 @@
  * first block in the list is returned, and the second block becomes the new
  * first block. Every time a block is freed (via os_pool_alloc_give()), the
  * newly freed block is prepended to the list of free blocks.
+ *
+ * The list is built lazily. Blocks that have never been handed out aren't in
+ * the list, but are taken in address order from the unused part of the backing
+ * memory once the list is empty. This gives the same allocation order as a
+ * fully built list, while keeping os_pool_alloc_init() O(1) even for large
+ * pools.
+ *
+ * On ARMv7-M (Cortex-M3/M4), taking and giving blocks is lock-free. The list
+ * head is updated with the LDREX/STREX exclusive access instructions, so the
+ * allocator can be used from any number of tasks and interrupt handlers without
+ * ever disabling interrupts. ARMv6-M (Cortex-M0) lacks those instructions, so
+ * there the list is updated in a short critical section instead.
+ *
+ * Bursts of blocks can be taken and given back with os_pool_alloc_take_n(),
+ * os_pool_alloc_give_n() and os_pool_alloc_give_chain(). Given blocks are moved
+ * as a whole chain in a single list update, and taken ones in batches of up to
+ * OS_POOL_ALLOC_TAKE_BATCH blocks per update, instead of paying for one update
+ * per block.
+ *
+ * Tasks can also wait for a block to become available with
+ * os_pool_alloc_take_blocking(). A block given back to a pool with waiting
+ * tasks is handed directly to the highest priority waiter.
+ *
+ * If MourOS is built with POOL_STATS_ENABLE defined, every pool also keeps
+ * occupancy statistics, which can be read with os_pool_alloc_get_stats().
  */
 
 #ifndef MOUROS_POOL_ALLOC_H_
@@ -17,15 +42,82 @@
 
 #include <stdint.h> // For uint32_t, ...
 
+struct tcb;
+
+
+/**
+ * Timeout value making os_pool_alloc_take_blocking() wait indefinitely.
+ */
+#define OS_POOL_ALLOC_WAIT_FOREVER UINT32_MAX
+
+#ifndef OS_POOL_ALLOC_TAKE_BATCH
+/**
+ * The maximum number of blocks os_pool_alloc_take_n() unlinks from the list of
+ * free blocks in one list update. On ARM, every update walks the list with
+ * interrupts disabled, so this bounds the interrupt latency it adds.
+ */
+#define OS_POOL_ALLOC_TAKE_BATCH 8
+#endif
+
 /**
  * Struct holding information about the pool of allocatable blocks.
  */
 typedef struct pool_alloc {
 	/** Pointer to the first block in the list of free blocks. */
-	void *first_block;
+	void *volatile first_block;
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__) && \
+    !defined(__ARM_ARCH_7EM__)
+	/**
+	 * Counter incremented on every update of first_block, which host builds
+	 * swap together with it using a double word compare-and-swap. It keeps a
+	 * block that was taken and given back in the meantime from being mistaken
+	 * for an unchanged head (the ABA problem). ARM builds don't need it.
+	 */
+	volatile uintptr_t tag;
+#endif
 	/** The size (in bytes) of blocks in this pool. */
 	uint32_t block_size;
+	/** Pointer to the first block that has never been handed out. */
+	void *volatile next_unused;
+	/** Pointer to the end of the backing memory. */
+	void *unused_end;
+	/**
+	 * Pointer to the first task waiting for a block. This is the first task
+	 * in a priority ordered linked list.
+	 */
+	struct tcb *volatile first_waiting;
+#ifdef POOL_STATS_ENABLE
+	/** The total number of blocks in the pool. */
+	uint32_t num_blocks;
+	/** The number of free blocks. */
+	volatile uint32_t num_free;
+	/** The lowest number of free blocks seen. */
+	volatile uint32_t min_free;
+	/** The number of failed allocations. */
+	volatile uint32_t num_failures;
+#endif
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__) && \
+    !defined(__ARM_ARCH_7EM__)
+} __attribute__((aligned(2 * sizeof(uintptr_t)))) pool_alloc_t;
+#else
 } pool_alloc_t;
+#endif
+
+/**
+ * Snapshot of the occupancy statistics of a pool.
+ */
+typedef struct pool_alloc_stats {
+	/** The total number of blocks in the pool. */
+	uint32_t capacity;
+	/** The number of free blocks. */
+	uint32_t num_free;
+	/** The lowest number of free blocks seen (the low-water mark). */
+	uint32_t min_free;
+	/** The number of allocations that failed because the pool was empty. */
+	uint32_t num_failures;
+	/** The highest number of blocks taken at the same time. */
+	uint32_t max_used;
+} pool_alloc_stats_t;
 
 
 /**
@@ -60,9 +152,29 @@ void os_pool_alloc_init(pool_alloc_t *alloc,
  */
 void *os_pool_alloc_take(pool_alloc_t *alloc);
 
+/**
+ * Returns a pointer to an area of memory of block_size (see
+ * os_pool_alloc_init()). If the pool is empty, the calling task is blocked
+ * until a block is given back to the pool, or until the timeout expires.
+ * Waiting tasks get the blocks in the order of their priority.
+ *
+ * @note Must not be called from interrupt handlers, unless timeout_ticks is 0.
+ *
+ * @param alloc         Pointer to the pool struct holding information about the
+ *                      block pool.
+ * @param timeout_ticks The maximum number of system ticks to wait for. 0 makes
+ *                      the call behave like os_pool_alloc_take(), and
+ *                      OS_POOL_ALLOC_WAIT_FOREVER disables the timeout.
+ *
+ * @return Pointer to the newly allocated block. Returns NULL if the timeout
+ *         expired.
+ */
+void *os_pool_alloc_take_blocking(pool_alloc_t *alloc, uint32_t timeout_ticks);
+
 /**
  * Returns a memory block of block_size (see os_pool_alloc_init()) to the block
- * pool.
+ * pool. If there are tasks waiting in os_pool_alloc_take_blocking(), the block
+ * is handed to the highest priority one.
  *
  * @param alloc Pointer to the pool struct holding information about the block
  *              pool.
@@ -71,6 +183,85 @@ void *os_pool_alloc_take(pool_alloc_t *alloc);
  */
 void os_pool_alloc_give(pool_alloc_t *alloc, void *block);
 
+/**
+ * Takes up to num blocks from the pool in one go. Blocks from the list of free
+ * blocks are unlinked in batches of up to OS_POOL_ALLOC_TAKE_BATCH blocks, each
+ * with a single list update. On ARM, every update walks its part of the list
+ * in a critical section, so the interrupt latency added doesn't grow with num.
+ *
+ * @param alloc  Pointer to the pool struct holding information about the block
+ *               pool.
+ * @param blocks Array to store the pointers to the taken blocks.
+ * @param num    The number of blocks to take.
+ *
+ * @return The number of blocks stored in blocks. Less than num if the pool ran
+ *         out of free blocks.
+ */
+uint32_t os_pool_alloc_take_n(pool_alloc_t *alloc,
+                              void **blocks,
+                              uint32_t num);
+
+/**
+ * Returns num blocks to the pool in one go. The blocks are linked into a chain
+ * first, and the chain is then prepended to the list of free blocks with a
+ * single list update (see os_pool_alloc_give_chain()).
+ *
+ * @param alloc  Pointer to the pool struct holding information about the block
+ *               pool.
+ * @param blocks Array of pointers to the blocks that should be returned.
+ * @param num    The number of elements in blocks.
+ */
+void os_pool_alloc_give_n(pool_alloc_t *alloc, void **blocks, uint32_t num);
+
+/**
+ * Returns a chain of already linked blocks to the pool with a single list
+ * update. The first word of every block in the chain must hold the pointer to
+ * the next block, the same way as in the list of free blocks. The first word
+ * of the last block is overwritten.
+ *
+ * This is useful e.g. for DMA descriptor chains, which can be handed back
+ * without building an array of their blocks first.
+ *
+ * @param alloc Pointer to the pool struct holding information about the block
+ *              pool.
+ * @param first Pointer to the first block of the chain.
+ * @param last  Pointer to the last block of the chain.
+ * @param num   The number of blocks in the chain.
+ */
+void os_pool_alloc_give_chain(pool_alloc_t *alloc,
+                              void *first,
+                              void *last,
+                              uint32_t num);
+
+/**
+ * Takes a snapshot of the occupancy statistics of the pool.
+ *
+ * @note The statistics are only kept if POOL_STATS_ENABLE is defined. If it's
+ *       not, the snapshot is all zeros.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param stats Pointer to the struct to store the snapshot.
+ */
+void os_pool_alloc_get_stats(pool_alloc_t *alloc, pool_alloc_stats_t *stats);
+
+/**
+ * Resets the low-water mark of the pool to the current number of free blocks,
+ * and the number of failed allocations to zero.
+ *
+ * @param alloc Pointer to the pool struct.
+ */
+void os_pool_alloc_reset_stats(pool_alloc_t *alloc);
+
+/**
+ * Sends a snapshot of the occupancy statistics of the pool to the diagnostics
+ * log, as a POOL_STATS event identified by the pool address. Does nothing
+ * unless both DIAG_ENABLE and POOL_STATS_ENABLE are defined, and the POOL
+ * diagnostic category is enabled (see diag_mask.h).
+ *
+ * @param alloc Pointer to the pool struct.
+ */
+void os_pool_alloc_report_stats(pool_alloc_t *alloc);
+
 
 #endif /* MOUROS_POOL_ALLOC_H_ */
 
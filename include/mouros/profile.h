@@ -0,0 +1,98 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS sampling profiler.
+ *
+ * If MourOS is built with PROFILE_ENABLE defined, sys_tick_handler() can
+ * sample the program counter of the preempted task. Sampling is started with
+ * os_profile_start(), and takes a sample every period ticks. The sample is the
+ * PC stacked by the exception entry, found through the stack pointer saved by
+ * SCHED_PUSH_STACK(), so taking it costs a few loads and stores.
+ *
+ * The samples are kept in a ring of OS_PROFILE_RING_SIZE entries, and read
+ * with os_profile_read(). Samples taken while the ring is full are dropped and
+ * counted. If DIAG_ENABLE is defined as well, the idle task drains the ring
+ * into PROFILE_SAMPLE diag events, which tools/diag_profile.py turns into a
+ * flat profile or a flame graph. Since the idle task only runs when nothing
+ * else does, samples are dropped if the CPU stays busy for longer than
+ * OS_PROFILE_RING_SIZE samples.
+ *
+ * The SysTick handler only runs once the interrupt handlers it's waiting for
+ * return, so the time spent in interrupt handlers is attributed to the task
+ * code they interrupted.
+ */
+
+#ifndef MOUROS_PROFILE_H_
+#define MOUROS_PROFILE_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+
+#ifndef OS_PROFILE_RING_SIZE
+/**
+ * The number of samples the profiler ring holds. Must be a power of two.
+ */
+#define OS_PROFILE_RING_SIZE 128
+#endif
+
+
+/**
+ * A single profiler sample.
+ */
+typedef struct profile_sample {
+	/** The program counter of the preempted task. */
+	uint32_t pc;
+	/** The ID of the preempted task. */
+	uint8_t task_id;
+} profile_sample_t;
+
+/**
+ * Snapshot of the profiler statistics.
+ */
+typedef struct profile_stats {
+	/** The number of samples taken. */
+	uint32_t num_samples;
+	/** The number of samples dropped because the ring was full. */
+	uint32_t num_dropped;
+	/** The number of samples waiting to be read. */
+	uint32_t num_pending;
+} profile_stats_t;
+
+
+/**
+ * Starts sampling. Does nothing unless PROFILE_ENABLE is defined.
+ *
+ * @param period Take a sample every period ticks. 0 stops sampling.
+ */
+void os_profile_start(uint32_t period);
+
+/**
+ * Stops sampling. The samples already taken can still be read.
+ */
+void os_profile_stop(void);
+
+/**
+ * Removes samples from the ring, oldest first.
+ *
+ * @param samples Array to store the samples.
+ * @param max_num The length of the array.
+ * @return The number of samples stored.
+ */
+uint32_t os_profile_read(profile_sample_t *samples, uint32_t max_num);
+
+/**
+ * Sends all the samples in the ring to the diagnostics log as PROFILE_SAMPLE
+ * events. Called by the idle task. Does nothing unless both DIAG_ENABLE and
+ * PROFILE_ENABLE are defined.
+ */
+void os_profile_report(void);
+
+/**
+ * Takes a snapshot of the profiler statistics.
+ *
+ * @param stats Pointer to the struct to store the snapshot.
+ */
+void os_profile_get_stats(profile_stats_t *stats);
+
+
+#endif /* MOUROS_PROFILE_H_ */
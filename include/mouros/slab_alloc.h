@@ -0,0 +1,158 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS slab allocator.
+ *
+ * The slab allocator serves variable sized allocations from several pool
+ * allocators (see pool_alloc.h), one per size class. The size classes are
+ * powers of two, from 1 << OS_SLAB_MIN_BLOCK_SHIFT bytes up. An allocation is
+ * served from the smallest class that can hold it, or from the next larger one
+ * if that class is exhausted. The class of a request is found with a single
+ * count-leading-zeros operation, so the time taken by an allocation is bounded
+ * by the number of size classes.
+ *
+ * Every class is backed by its own memory area, so freed blocks are returned to
+ * their class by comparing addresses, without any per-block headers.
+ *
+ * Allocations larger than the largest class (or made when all the suitable
+ * classes are exhausted) can be passed to optional fallback functions, e.g. a
+ * general purpose heap.
+ *
+ * If MourOS is built with SLAB_MALLOC_ENABLE defined, the newlib malloc(),
+ * free(), realloc() and calloc() functions are replaced by ones allocating from
+ * os_malloc_slab.
+ */
+
+#ifndef MOUROS_SLAB_ALLOC_H_
+#define MOUROS_SLAB_ALLOC_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+#include <mouros/pool_alloc.h> // For the pool allocator.
+
+
+/**
+ * The binary logarithm of the block size of the smallest size class.
+ */
+#define OS_SLAB_MIN_BLOCK_SHIFT 4
+
+/**
+ * The number of size classes. The largest class has blocks of
+ * 1 << (OS_SLAB_MIN_BLOCK_SHIFT + OS_SLAB_NUM_CLASSES - 1) bytes.
+ */
+#define OS_SLAB_NUM_CLASSES 8
+
+
+/**
+ * Struct holding information about a single size class.
+ */
+struct slab_class {
+	/** The pool holding the blocks of the class. */
+	pool_alloc_t pool;
+	/** The beginning of the memory area of the class. NULL if unused. */
+	uint8_t *mem_start;
+	/** The end of the memory area of the class. */
+	uint8_t *mem_end;
+};
+
+/**
+ * Struct holding information about a slab allocator.
+ */
+typedef struct slab_alloc {
+	/** The size classes, from the smallest to the largest. */
+	struct slab_class classes[OS_SLAB_NUM_CLASSES];
+	/** Optional fallback allocation function. */
+	void *(*fallback_alloc)(uint32_t size);
+	/** Optional fallback function freeing blocks from fallback_alloc. */
+	void (*fallback_free)(void *ptr);
+	/** Optional fallback function resizing blocks from fallback_alloc. */
+	void *(*fallback_realloc)(void *ptr, uint32_t size);
+} slab_alloc_t;
+
+
+#ifdef SLAB_MALLOC_ENABLE
+/**
+ * The slab allocator used by malloc() & co. Must be set up before the first
+ * call to malloc().
+ */
+extern slab_alloc_t os_malloc_slab;
+#endif
+
+
+/**
+ * Initializes the slab allocator with no size classes and no fallback.
+ *
+ * @param slab Pointer to the slab allocator struct.
+ */
+void os_slab_alloc_init(slab_alloc_t *slab);
+
+/**
+ * Adds a size class to the slab allocator.
+ *
+ * @param slab       Pointer to the slab allocator struct.
+ * @param mem        Pointer to the memory holding the blocks of the class. Must
+ *                   be at least block_size * num_blocks bytes large.
+ * @param block_size The block size of the class. Must be a power of two
+ *                   between 1 << OS_SLAB_MIN_BLOCK_SHIFT and the largest class
+ *                   size. Every class can be added only once.
+ * @param num_blocks The number of blocks in the class. Must not be zero.
+ */
+void os_slab_alloc_add_class(slab_alloc_t *slab,
+                             void *mem,
+                             uint32_t block_size,
+                             uint32_t num_blocks);
+
+/**
+ * Sets the functions handling the requests the size classes can't serve.
+ * Any of them can be NULL, in which case such requests fail.
+ *
+ * @param slab         Pointer to the slab allocator struct.
+ * @param alloc_func   The fallback allocation function.
+ * @param free_func    The fallback free function.
+ * @param realloc_func The fallback reallocation function.
+ */
+void os_slab_alloc_set_fallback(slab_alloc_t *slab,
+                                void *(*alloc_func)(uint32_t size),
+                                void (*free_func)(void *ptr),
+                                void *(*realloc_func)(void *ptr,
+                                                      uint32_t size));
+
+/**
+ * Allocates a block of at least size bytes.
+ *
+ * @param slab Pointer to the slab allocator struct.
+ * @param size The requested size.
+ * @return Pointer to the block, or NULL if no memory is available.
+ */
+void *os_slab_alloc_take(slab_alloc_t *slab, uint32_t size);
+
+/**
+ * Frees a block allocated by os_slab_alloc_take() or os_slab_alloc_realloc().
+ *
+ * @param slab Pointer to the slab allocator struct.
+ * @param ptr  Pointer to the block. Can be NULL.
+ */
+void os_slab_alloc_give(slab_alloc_t *slab, void *ptr);
+
+/**
+ * Resizes a block, moving it if needed. Behaves like the standard realloc().
+ *
+ * @param slab Pointer to the slab allocator struct.
+ * @param ptr  Pointer to the block. Can be NULL.
+ * @param size The requested size.
+ * @return Pointer to the resized block, or NULL if no memory is available (in
+ *         which case the original block is left untouched).
+ */
+void *os_slab_alloc_realloc(slab_alloc_t *slab, void *ptr, uint32_t size);
+
+/**
+ * Returns the usable size of a block allocated from the size classes.
+ *
+ * @param slab Pointer to the slab allocator struct.
+ * @param ptr  Pointer to the block.
+ * @return The block size of its class, or 0 if the block isn't from any class.
+ */
+uint32_t os_slab_alloc_block_size(slab_alloc_t *slab, void *ptr);
+
+
+#endif /* MOUROS_SLAB_ALLOC_H_ */
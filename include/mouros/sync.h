@@ -3,13 +3,41 @@
  *
  * Definitions of functions and structures implementing resources.
  *
+ * If MourOS is built with RESOURCE_STATS_ENABLE defined, every resource keeps
+ * contention statistics: how often it was acquired, how often the acquiring
+ * task had to wait, and how long the waits and the holds took. The times are
+ * measured with os_get_timestamp(). A resource is added to the list of
+ * profiled resources when it's first acquired, and stays there, so it must not
+ * go out of scope or be reinitialized afterwards. The most contended resources
+ * can be listed with os_resource_get_top_contended(). If DIAG_ENABLE is
+ * defined as well, waits longer than OS_RESOURCE_LONG_WAIT_US are logged as
+ * RESOURCE_WAIT events.
+ *
  */
 
 #ifndef MOUROS_SYNC_H_
 #define MOUROS_SYNC_H_
 
+#include <stdint.h>  // For uint32_t, ...
+#include <stdbool.h> // For bool.
+
 #include <mouros/tasks.h>
 
+#ifndef OS_RESOURCE_LONG_WAIT_US
+/**
+ * Waits for a resource at least this long (in microseconds) are logged as
+ * RESOURCE_WAIT diag events.
+ */
+#define OS_RESOURCE_LONG_WAIT_US 1000
+#endif
+
+#ifndef OS_RESOURCE_REPORT_MAX
+/**
+ * The maximum number of resources os_resource_report_top_contended() reports.
+ */
+#define OS_RESOURCE_REPORT_MAX 8
+#endif
+
 /**
  * Struct holding information about a resource.
  */
@@ -23,8 +51,49 @@ typedef struct resource {
 	 * Pointer to the task currently owning the resource.
 	 */
 	struct tcb *acquired_by;
+#ifdef RESOURCE_STATS_ENABLE
+	/** The number of times the resource was acquired. */
+	uint32_t num_acquires;
+	/** The number of acquisitions that had to wait. */
+	uint32_t num_contended;
+	/** The total time spent waiting for the resource. */
+	uint64_t total_wait;
+	/** The total time the resource was held. */
+	uint64_t total_hold;
+	/** The longest wait for the resource. */
+	uint32_t max_wait;
+	/** The longest hold of the resource. */
+	uint32_t max_hold;
+	/** The time the resource was last acquired. */
+	uint64_t acquired_at;
+	/** The next resource in the list of profiled resources. */
+	struct resource *stats_next;
+	/** True if the resource is in the list of profiled resources. */
+	bool stats_listed;
+#endif
 } resource_t;
 
+/**
+ * Snapshot of the contention statistics of a resource. The times are in
+ * os_get_timestamp() steps.
+ */
+typedef struct resource_stats {
+	/** The resource. */
+	const resource_t *resource;
+	/** The number of times the resource was acquired. */
+	uint32_t num_acquires;
+	/** The number of acquisitions that had to wait. */
+	uint32_t num_contended;
+	/** The total time spent waiting for the resource. */
+	uint64_t total_wait;
+	/** The total time the resource was held. */
+	uint64_t total_hold;
+	/** The longest wait for the resource. */
+	uint32_t max_wait;
+	/** The longest hold of the resource. */
+	uint32_t max_hold;
+} resource_stats_t;
+
 /**
  * Acquires ownership of the resource pointed to by res.
  *
@@ -44,4 +113,43 @@ void os_resource_acquire(resource_t *res);
  */
 void os_resource_release(resource_t *res);
 
+/**
+ * Takes a snapshot of the contention statistics of the resource. All the
+ * statistics are zero unless RESOURCE_STATS_ENABLE is defined.
+ *
+ * @param res   The resource.
+ * @param stats Pointer to the struct to store the snapshot.
+ */
+void os_resource_get_stats(resource_t *res, resource_stats_t *stats);
+
+/**
+ * Resets the contention statistics of the resource to zero.
+ *
+ * @param res The resource.
+ */
+void os_resource_reset_stats(resource_t *res);
+
+/**
+ * Takes snapshots of the statistics of the most contended resources, ordered
+ * by the number of contended acquisitions, and then by the total wait time.
+ * Resources that were never contended are left out. Returns 0 unless
+ * RESOURCE_STATS_ENABLE is defined.
+ *
+ * @param stats   Array to store the snapshots.
+ * @param max_num The length of the array.
+ * @return The number of snapshots stored.
+ */
+uint32_t os_resource_get_top_contended(resource_stats_t *stats,
+                                       uint32_t max_num);
+
+/**
+ * Sends the statistics of up to num (at most OS_RESOURCE_REPORT_MAX) most
+ * contended resources to the diagnostics log, as RESOURCE_STATS events
+ * identified by the resource address. Does nothing unless both DIAG_ENABLE and
+ * RESOURCE_STATS_ENABLE are defined.
+ *
+ * @param num The number of resources to report.
+ */
+void os_resource_report_top_contended(uint32_t num);
+
 #endif /* MOUROS_SYNC_H_ */
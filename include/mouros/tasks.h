@@ -13,6 +13,10 @@
 #include <stdbool.h> // For bool.
 #include <reent.h>   // For the reent struct.
 
+#include <mouros/pool_alloc.h> // For the pool allocator.
+
+struct arena;
+
 
 /** @cond */
 #define ___os_task_init_with_stack(task, name, stack_size, priority, task_func, task_params, stack_num) \
@@ -73,6 +77,16 @@ typedef struct tcb {
 		 * The task is waiting for a resource to become available.
 		 */
 		TASK_WAITING_FOR_RESOURCE,
+		/**
+		 * The task is waiting for data in one of the mailboxes passed
+		 * to os_mailbox_select().
+		 */
+		TASK_WAITING_FOR_MAILBOX,
+		/**
+		 * The task is waiting for a block to be given back to a pool in
+		 * os_pool_alloc_take_blocking().
+		 */
+		TASK_WAITING_FOR_BLOCK,
 		/**
 		 * The task is sleeping and will again be scheduled once the
 		 * set sleep duration has elapsed.
@@ -98,6 +112,16 @@ typedef struct tcb {
 	 */
 	uint64_t wakeup_time;
 
+	/**
+	 * Pointer to the next task in the priority ordered list of tasks waiting
+	 * for a pool block (WAITING_FOR_BLOCK), or in the list of tasks waiting
+	 * for space in a mailbox. Separate from next_task, as the waiting task
+	 * may be in the sleepqueue at the same time.
+	 */
+	struct tcb *wait_next;
+	/** The pool block handed to the task while it was waiting. */
+	void *wait_result;
+
 	/**
 	 * The value of the exception return vector in the link register when
 	 * the task undergoes stacking (in pend_sv_handler() &
@@ -112,8 +136,20 @@ typedef struct tcb {
 	/** The total size of the stack allocated to the task. */
 	uint32_t stack_size;
 
-	/** Struct used for newlib task reentrancy. */
-	struct _reent reent;
+	/**
+	 * Pointer to the struct used for newlib task reentrancy. See
+	 * os_task_set_reent().
+	 */
+	struct _reent *reent;
+	/** The pool reent was allocated from, or NULL. */
+	pool_alloc_t *reent_pool;
+#ifndef SHARED_REENT_ENABLE
+	/** The task's own reent struct, used unless set otherwise. */
+	struct _reent reent_data;
+#endif
+
+	/** The arena bound to the task. See os_task_set_arena(). */
+	struct arena *arena;
 } task_t;
 
 /**
@@ -278,6 +314,10 @@ uint32_t os_get_stack_max_usage(task_t *task);
  * The error function will be called by the diagnostics subsystem if the send
  * function does not transmit all the bytes in its buffer sucessfully.
  *
+ * If MourOS is built with TRACE_RING_ENABLE defined, the messages are buffered
+ * in the trace ring (see trace.h), and the send function is called later from
+ * the idle task, or from os_trace_flush().
+ *
  * @param diag_send_func  Pointer to the send function.
  * @param diag_error_func Pointer to the error function.
  */
@@ -285,9 +325,72 @@ void os_set_diagnostics(uint8_t (*diag_send_func)(uint8_t *msg_buf,
                                                   uint8_t msg_buf_len),
                         void (*diag_error_func)(void));
 
+/**
+ * Sets the newlib reentrancy struct used by task. The struct holds errno, the
+ * stdio streams and other per-thread newlib state.
+ *
+ * By default, every task embeds its own reent struct. If MourOS is built with
+ * SHARED_REENT_ENABLE defined, tasks don't embed one, and use the global newlib
+ * reent struct instead, unless they get a private one from this function. This
+ * saves the size of the struct (around 1 KB, depending on the newlib
+ * configuration) for every task that doesn't use stdio or errno. Tasks sharing
+ * the global struct must not use stdio concurrently.
+ *
+ * A struct previously allocated with os_task_alloc_reent() is given back to its
+ * pool, so the task must not be using it while this is called.
+ *
+ * @param task  The task to set the reent struct for.
+ * @param reent Pointer to the struct to be used. It gets initialized by this
+ *              function. NULL selects the default struct.
+ */
+void os_task_set_reent(task_t *task, struct _reent *reent);
+
+/**
+ * Gives task a private newlib reentrancy struct allocated from pool. Meant for
+ * tasks to call before they first use stdio when MourOS is built with
+ * SHARED_REENT_ENABLE defined. See os_task_set_reent().
+ *
+ * The struct is given back to pool when it gets replaced, or when the task
+ * function returns.
+ *
+ * @note The pool block size must be at least sizeof(struct _reent).
+ *
+ * @param task The task to allocate the reent struct for.
+ * @param pool The pool to allocate the struct from.
+ * @return True on success, false if the pool was empty.
+ */
+bool os_task_alloc_reent(task_t *task, pool_alloc_t *pool);
+
+/**
+ * Binds an arena (see arena.h) to task. The task can then allocate from it with
+ * os_arena_task_alloc().
+ *
+ * @param task  The task to bind the arena to.
+ * @param arena Pointer to the arena, or NULL to unbind the current one.
+ */
+void os_task_set_arena(task_t *task, struct arena *arena);
+
 /**
  * This function returns the number of system ticks since scheduling started.
  */
 uint64_t os_get_tick_count(void);
 
+/**
+ * Returns a timestamp with the resolution of a single SysTick counter step
+ * (i.e. one or eight core clock cycles), counted since scheduling started.
+ *
+ * The timestamp is composed of the tick count and the current SysTick counter
+ * value, so it doesn't wrap around, and it works on cores without a cycle
+ * counter. Can be called from interrupt handlers.
+ *
+ * @return The number of SysTick counter steps since scheduling started.
+ */
+uint64_t os_get_timestamp(void);
+
+/**
+ * Returns the frequency of os_get_timestamp(), i.e. the number of timestamp
+ * steps per second. Valid once scheduling started.
+ */
+uint32_t os_get_timestamp_freq(void);
+
 #endif /* MOUROS_TASKS_H_ */
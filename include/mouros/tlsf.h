@@ -0,0 +1,233 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS TLSF (two-level segregated fit) heap.
+ *
+ * The heap manages a single memory region, from which blocks of any size can be
+ * allocated. Free blocks are kept in segregated lists. The first level splits
+ * the lists by powers of two, and the second level splits every power of two
+ * range linearly into 1 << OS_TLSF_SL_INDEX_COUNT_LOG2 lists. Two levels of
+ * bitmaps record which lists are non-empty, so a suitable free block is found
+ * with a couple of bit scans, and allocating or freeing a block takes constant
+ * time regardless of the heap size or its fragmentation.
+ *
+ * Every block is preceded by a small header holding its size and a pointer to
+ * the physically preceding block, so that a freed block is merged with its free
+ * neighbours right away.
+ *
+ * The heap operations are made safe for concurrent use by tasks with a resource
+ * (see sync.h). They must not be used from interrupt handlers.
+ *
+ * If MourOS is built with TLSF_MALLOC_ENABLE defined, os_malloc_tlsf owns the
+ * RAM from the end of the statically allocated variables up to
+ * OS_TLSF_STACK_RESERVE bytes below the top of the main stack. The heap then
+ * replaces the newlib malloc(), free(), realloc() and calloc() functions, and
+ * _sbrk() stops handing out memory. If SLAB_MALLOC_ENABLE is defined as well,
+ * malloc() & co. stay with the slab allocator, and os_heap_malloc(),
+ * os_heap_free() and os_heap_realloc() can be set as its fallback functions.
+ */
+
+#ifndef MOUROS_TLSF_H_
+#define MOUROS_TLSF_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+#include <mouros/sync.h> // For resource_t.
+
+
+#ifndef OS_TLSF_SL_INDEX_COUNT_LOG2
+/**
+ * The binary logarithm of the number of second level lists per first level
+ * list. More lists waste less memory per allocation, but make tlsf_t larger.
+ */
+#define OS_TLSF_SL_INDEX_COUNT_LOG2 3
+#endif
+
+#ifndef OS_TLSF_FL_INDEX_MAX
+/**
+ * The binary logarithm of the largest block size the heap can handle. Larger
+ * regions are trimmed to fit.
+ */
+#define OS_TLSF_FL_INDEX_MAX 18
+#endif
+
+#ifndef OS_TLSF_STACK_RESERVE
+/**
+ * The number of bytes below the top of the main stack that are kept out of
+ * os_malloc_tlsf (see TLSF_MALLOC_ENABLE).
+ */
+#define OS_TLSF_STACK_RESERVE 1024
+#endif
+
+/** The number of second level lists per first level list. */
+#define OS_TLSF_SL_INDEX_COUNT (1 << OS_TLSF_SL_INDEX_COUNT_LOG2)
+
+/**
+ * The binary logarithm of the block alignment. Blocks are aligned to twice the
+ * pointer size.
+ */
+#define OS_TLSF_ALIGN_SIZE_LOG2 (sizeof(void *) == 8 ? 4 : 3)
+
+/**
+ * The first level index of the smallest blocks not in the first level list 0.
+ * The blocks below are split linearly over the second level lists of list 0.
+ */
+#define OS_TLSF_FL_INDEX_SHIFT \
+	(OS_TLSF_SL_INDEX_COUNT_LOG2 + OS_TLSF_ALIGN_SIZE_LOG2)
+
+/** The number of first level lists. */
+#define OS_TLSF_FL_INDEX_COUNT \
+	(OS_TLSF_FL_INDEX_MAX - OS_TLSF_FL_INDEX_SHIFT + 1)
+
+
+struct tlsf_block;
+
+/**
+ * Struct holding information about a TLSF heap.
+ */
+typedef struct tlsf {
+	/** Bitmap with a bit set for every non-empty first level list. */
+	uint32_t fl_bitmap;
+	/** Bitmaps with a bit set for every non-empty second level list. */
+	uint32_t sl_bitmap[OS_TLSF_FL_INDEX_COUNT];
+	/** The heads of the free block lists. */
+	struct tlsf_block *blocks[OS_TLSF_FL_INDEX_COUNT][OS_TLSF_SL_INDEX_COUNT];
+	/** The resource serializing access to the heap. */
+	resource_t lock;
+	/** The size of the managed region, in bytes. */
+	uint32_t total_size;
+	/** The number of bytes in free blocks, excluding their headers. */
+	uint32_t free_size;
+	/** The lowest value of free_size seen. */
+	uint32_t min_free_size;
+	/** The number of free blocks. */
+	uint32_t num_free_blocks;
+	/** The number of failed allocations. */
+	uint32_t num_failures;
+} tlsf_t;
+
+/**
+ * Snapshot of the usage and fragmentation statistics of a heap.
+ */
+typedef struct tlsf_stats {
+	/** The size of the managed region, in bytes. */
+	uint32_t total_size;
+	/** The number of bytes available in free blocks. */
+	uint32_t free_size;
+	/** The lowest number of free bytes seen (the low-water mark). */
+	uint32_t min_free_size;
+	/** The size of the largest free block. */
+	uint32_t largest_free_block;
+	/** The number of free blocks. */
+	uint32_t num_free_blocks;
+	/** The number of allocations that failed. */
+	uint32_t num_failures;
+	/**
+	 * The share of the free memory that's not in the largest free block, in
+	 * percent. 0 means all the free memory is available in one piece.
+	 */
+	uint32_t fragmentation;
+} tlsf_stats_t;
+
+
+#ifdef TLSF_MALLOC_ENABLE
+/**
+ * The heap used by malloc() & co. Set up on first use.
+ */
+extern tlsf_t os_malloc_tlsf;
+#endif
+
+
+/**
+ * Initializes the heap to manage the memory region of size bytes at mem.
+ *
+ * @param tlsf Pointer to the heap struct to be initialized.
+ * @param mem  Pointer to the memory region.
+ * @param size The size of the memory region in bytes.
+ */
+void os_tlsf_init(tlsf_t *tlsf, void *mem, uint32_t size);
+
+/**
+ * Allocates a block of at least size bytes, aligned to
+ * 1 << OS_TLSF_ALIGN_SIZE_LOG2 bytes.
+ *
+ * @note The request is rounded up to the smallest size of the next free list,
+ *       so that the first block of the list fits without any searching. A
+ *       request can thus fail even if there's a free block barely larger than
+ *       size.
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param size The requested size.
+ * @return Pointer to the block, or NULL if no large enough block is free.
+ */
+void *os_tlsf_alloc(tlsf_t *tlsf, uint32_t size);
+
+/**
+ * Frees a block allocated from the heap.
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param ptr  Pointer to the block. Can be NULL.
+ */
+void os_tlsf_free(tlsf_t *tlsf, void *ptr);
+
+/**
+ * Resizes a block, in place if possible, or by moving it otherwise. Behaves
+ * like the standard realloc().
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param ptr  Pointer to the block. Can be NULL.
+ * @param size The requested size.
+ * @return Pointer to the resized block, or NULL if there's not enough memory
+ *         (in which case the original block is left untouched) or if size is 0.
+ */
+void *os_tlsf_realloc(tlsf_t *tlsf, void *ptr, uint32_t size);
+
+/**
+ * Returns the usable size of a block allocated from the heap.
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param ptr  Pointer to the block.
+ * @return The size of the block in bytes.
+ */
+uint32_t os_tlsf_block_size(tlsf_t *tlsf, void *ptr);
+
+/**
+ * Takes a snapshot of the usage and fragmentation statistics of the heap.
+ *
+ * @param tlsf  Pointer to the heap struct.
+ * @param stats Pointer to the struct to store the snapshot.
+ */
+void os_tlsf_get_stats(tlsf_t *tlsf, tlsf_stats_t *stats);
+
+
+#ifdef TLSF_MALLOC_ENABLE
+/**
+ * Allocates memory from os_malloc_tlsf. Can be used as a slab allocator
+ * fallback.
+ *
+ * @param size The requested size.
+ * @return Pointer to the allocated memory, or NULL on error.
+ */
+void *os_heap_malloc(uint32_t size);
+
+/**
+ * Frees memory allocated from os_malloc_tlsf. Can be used as a slab allocator
+ * fallback.
+ *
+ * @param ptr Pointer to the memory to be freed. Can be NULL.
+ */
+void os_heap_free(void *ptr);
+
+/**
+ * Resizes memory allocated from os_malloc_tlsf. Can be used as a slab
+ * allocator fallback.
+ *
+ * @param ptr  Pointer to the memory to be resized. Can be NULL.
+ * @param size The requested size.
+ * @return Pointer to the resized memory, or NULL on error.
+ */
+void *os_heap_realloc(void *ptr, uint32_t size);
+#endif
+
+
+#endif /* MOUROS_TLSF_H_ */
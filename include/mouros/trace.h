@@ -0,0 +1,144 @@
+/**
+ * @file
+ *
+ * Header file for the MourOS trace ring.
+ *
+ * The trace ring decouples logging a message from transmitting it. Writers
+ * append messages to a byte ring in RAM, and a flusher later hands the buffered
+ * bytes to the output function in batches of up to 255 bytes.
+ *
+ * Writing a message takes a short critical section to reserve space in the
+ * ring, a copy of the message outside of it, and another short critical
+ * section to publish the message. Writers never wait for the output. If a
+ * message doesn't fit, it's dropped as a whole and counted, so the buffered
+ * stream stays made of complete messages. Messages can be written from both
+ * tasks and interrupt handlers.
+ *
+ * If MourOS is built with TRACE_RING_ENABLE defined, os_set_diagnostics()
+ * routes the diagnostic messages through the ring, and the idle task flushes
+ * it. The ring can also be flushed from any other low priority task with
+ * os_trace_flush().
+ *
+ * If MourOS is built with DIAG_ENABLE and TRACE_TIMESTAMP_ENABLE defined, the
+ * task switch, block and wake events are logged with os_trace_compact_event()
+ * instead of the generated diag functions. A compact event holds the event ID,
+ * the time since the previous compact event, and the event arguments, all but
+ * the ID encoded as LEB128 varints. The time is measured with
+ * os_get_timestamp() in units of 1 << OS_TRACE_TIMESTAMP_SHIFT SysTick steps,
+ * which keeps sub-microsecond resolution, and typically needs 1 or 2 bytes per
+ * event instead of the 8 bytes of a full tick count. The TRACE_CLOCK event,
+ * logged when the scheduling starts, gives the decoder the timestamp frequency.
+ */
+
+#ifndef MOUROS_TRACE_H_
+#define MOUROS_TRACE_H_
+
+#include <stdint.h> // For uint32_t, ...
+
+
+#ifndef OS_TRACE_RING_SIZE
+/**
+ * The size of the trace ring in bytes. Must be a power of two, and at least
+ * 256 bytes, so that any message fits.
+ */
+#define OS_TRACE_RING_SIZE 1024
+#endif
+
+#ifndef OS_TRACE_FLUSH_STACK_SIZE
+/**
+ * The number of bytes added to the stack of the idle task for calling the
+ * output function, if TRACE_RING_ENABLE is defined.
+ */
+#define OS_TRACE_FLUSH_STACK_SIZE 256
+#endif
+
+#ifndef OS_TRACE_TIMESTAMP_SHIFT
+/**
+ * The binary logarithm of the number of SysTick steps per time unit of the
+ * compact events.
+ */
+#define OS_TRACE_TIMESTAMP_SHIFT 4
+#endif
+
+/** The maximum number of arguments of a compact event. */
+#define OS_TRACE_COMPACT_MAX_ARGS 4
+
+
+/**
+ * Snapshot of the trace ring statistics.
+ */
+typedef struct trace_stats {
+	/** The number of bytes waiting to be flushed. */
+	uint32_t used;
+	/** The highest number of bytes waiting to be flushed seen. */
+	uint32_t max_used;
+	/** The number of bytes handed to the output function. */
+	uint32_t num_flushed;
+	/** The number of messages dropped because the ring was full. */
+	uint32_t num_overflows;
+} trace_stats_t;
+
+
+/**
+ * Sets the function the buffered messages are flushed to.
+ *
+ * @param send_func  Function transmitting msg_buf_len bytes from msg_buf, and
+ *                   returning the number of bytes actually transmitted.
+ * @param error_func Function called if send_func doesn't transmit all the bytes
+ *                   it was given. Can be NULL.
+ */
+void os_trace_set_output(uint8_t (*send_func)(uint8_t *msg_buf,
+                                              uint8_t msg_buf_len),
+                         void (*error_func)(void));
+
+/**
+ * Appends a message to the trace ring. Has the same signature as the send
+ * function of os_set_diagnostics(), so it can be used in its place.
+ *
+ * @param msg_buf     Pointer to the message.
+ * @param msg_buf_len The length of the message.
+ * @return msg_buf_len. A message that doesn't fit is counted in num_overflows
+ *         rather than reported to the writer.
+ */
+uint8_t os_trace_write(uint8_t *msg_buf, uint8_t msg_buf_len);
+
+/**
+ * Hands all the buffered messages to the output function. Does nothing if no
+ * output function is set, or if another flush is in progress.
+ *
+ * @note Must not be called from interrupt handlers.
+ *
+ * @return The number of bytes transmitted.
+ */
+uint32_t os_trace_flush(void);
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+/**
+ * Logs an event in the compact encoding, timestamped with os_get_timestamp().
+ * If MourOS is built with TRACE_RING_ENABLE, the event is appended to the trace
+ * ring, otherwise it's sent to the output function right away.
+ *
+ * The event is encoded and written with interrupts masked, so that the order
+ * of the events in the stream matches the order of their timestamps. If the
+ * event is dropped, the next event's time is still measured from the last
+ * event written, so the decoded timestamps stay correct.
+ *
+ * @param event_id The index of the event in diag_config.json.
+ * @param args     The event arguments, without the timestamp, in the order of
+ *                 diag_config.json.
+ * @param num_args The number of arguments. At most OS_TRACE_COMPACT_MAX_ARGS.
+ */
+void os_trace_compact_event(uint8_t event_id,
+                            const uint32_t *args,
+                            uint32_t num_args);
+#endif
+
+/**
+ * Takes a snapshot of the trace ring statistics.
+ *
+ * @param stats Pointer to the struct to store the snapshot.
+ */
+void os_trace_get_stats(trace_stats_t *stats);
+
+
+#endif /* MOUROS_TRACE_H_ */
@@ -5,6 +5,7 @@ use core::cell::UnsafeCell;
 use core::marker::PhantomData;
 use core::mem::MaybeUninit;
 use super::CVoid;
+use super::tasks::Task;
 
 #[repr(C)]
 #[derive(Debug)]
@@ -15,6 +16,8 @@ pub struct MailboxRaw {
     read_pos: u32,
     write_pos: u32,
     data_added: Option<extern "C" fn()>,
+    waiting_task: *mut Task,
+    notify: *mut CVoid,
 }
 
 impl Default for MailboxRaw {
@@ -0,0 +1,150 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of an arena allocator.
+ */
+
+#include <stddef.h> // For NULL
+
+#include <libopencm3/cm3/assert.h> // For assert().
+
+#include <mouros/arena.h> // Arena function definitions.
+#include <mouros/tasks.h> // For the arena of the task.
+
+#include "scheduler.h" // For current_task.
+
+
+/**
+ * Gives the chunks following chunk back to the pool, and makes chunk the one
+ * allocations are made from.
+ *
+ * @param arena      Pointer to the arena struct.
+ * @param chunk      The chunk to keep as the last one. NULL gives back all the
+ *                   chunks.
+ * @param num_chunks The number of chunks up to and including chunk.
+ */
+static void truncate_chunks(arena_t *arena, void *chunk, uint32_t num_chunks)
+{
+	cm3_assert(num_chunks <= arena->num_chunks);
+
+	if (num_chunks < arena->num_chunks) {
+		void *first = chunk != NULL ? *(void **) chunk :
+		                              arena->first_chunk;
+
+		os_pool_alloc_give_chain(arena->pool, first, arena->last_chunk,
+		                         arena->num_chunks - num_chunks);
+	}
+
+	arena->num_chunks = num_chunks;
+	arena->last_chunk = chunk;
+
+	if (chunk == NULL) {
+		arena->first_chunk = NULL;
+		arena->next_free = NULL;
+		arena->end = NULL;
+	} else {
+		arena->end = (uint8_t *) chunk + arena->pool->block_size;
+	}
+}
+
+
+void os_arena_init(arena_t *arena, pool_alloc_t *pool)
+{
+	cm3_assert(pool->block_size > OS_ARENA_CHUNK_HEADER_SIZE);
+	cm3_assert(pool->block_size % OS_ARENA_ALIGN == 0);
+
+	arena->pool = pool;
+	arena->first_chunk = NULL;
+	arena->last_chunk = NULL;
+	arena->num_chunks = 0;
+	arena->next_free = NULL;
+	arena->end = NULL;
+}
+
+void *os_arena_alloc(arena_t *arena, uint32_t size)
+{
+	// Checked before rounding up, so that the rounding can't overflow. The
+	// limit is a multiple of OS_ARENA_ALIGN, so the rounded size fits too.
+	if (size > arena->pool->block_size - OS_ARENA_CHUNK_HEADER_SIZE) {
+		return NULL;
+	}
+
+	size = (size + OS_ARENA_ALIGN - 1) & ~(uint32_t) (OS_ARENA_ALIGN - 1);
+
+	uint8_t *ptr = (uint8_t *) (((uintptr_t) arena->next_free +
+	                             OS_ARENA_ALIGN - 1) &
+	                            ~(uintptr_t) (OS_ARENA_ALIGN - 1));
+
+	if (arena->next_free != NULL && ptr <= arena->end &&
+	    size <= (uint32_t) (arena->end - ptr)) {
+		arena->next_free = ptr + size;
+		return ptr;
+	}
+
+	void *chunk = os_pool_alloc_take(arena->pool);
+
+	if (chunk == NULL) {
+		return NULL;
+	}
+
+	*(void **) chunk = NULL;
+
+	if (arena->last_chunk != NULL) {
+		*(void **) arena->last_chunk = chunk;
+	} else {
+		arena->first_chunk = chunk;
+	}
+
+	arena->last_chunk = chunk;
+	arena->num_chunks++;
+	arena->end = (uint8_t *) chunk + arena->pool->block_size;
+
+	ptr = (uint8_t *) chunk + OS_ARENA_CHUNK_HEADER_SIZE;
+	arena->next_free = ptr + size;
+
+	return ptr;
+}
+
+void *os_arena_task_alloc(uint32_t size)
+{
+	arena_t *arena = current_task->arena;
+
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	return os_arena_alloc(arena, size);
+}
+
+void os_arena_mark(arena_t *arena, arena_mark_t *mark)
+{
+	mark->chunk = arena->last_chunk;
+	mark->num_chunks = arena->num_chunks;
+	mark->next_free = arena->next_free;
+}
+
+void os_arena_rewind(arena_t *arena, const arena_mark_t *mark)
+{
+	truncate_chunks(arena, mark->chunk, mark->num_chunks);
+
+	if (mark->chunk != NULL) {
+		arena->next_free = mark->next_free;
+	}
+}
+
+void os_arena_reset(arena_t *arena)
+{
+	if (arena->first_chunk == NULL) {
+		return;
+	}
+
+	truncate_chunks(arena, arena->first_chunk, 1);
+
+	arena->next_free = (uint8_t *) arena->first_chunk +
+	                   OS_ARENA_CHUNK_HEADER_SIZE;
+}
+
+void os_arena_release(arena_t *arena)
+{
+	truncate_chunks(arena, NULL, 0);
+}
@@ -0,0 +1,265 @@
+/**
+ * @file
+ *
+ * This file contains the atomic primitives used internally by MourOS.
+ *
+ * On ARMv7-M (Cortex-M3/M4) they are built on the LDREX/STREX exclusive access
+ * instructions. ARMv6-M (Cortex-M0) has no exclusive access instructions, so
+ * there they fall back to short critical sections. Any other target is assumed
+ * to be a host build (i.e. the unit tests), which uses the GCC __atomic
+ * builtins.
+ *
+ */
+
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+#include <stdint.h>  // For uint32_t.
+#include <stdbool.h> // For bool.
+
+#include <libopencm3/cm3/cortex.h> // For CM_ATOMIC_CONTEXT().
+
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/**
+ * Makes sure memory accesses before the barrier aren't reordered with those
+ * after it. The Cortex-M cores are single issue and in-order, so preventing
+ * compiler reordering is enough.
+ */
+static inline void atomic_barrier(void)
+{
+	asm volatile ("" ::: "memory");
+}
+
+/**
+ * Atomically loads a 32-bit value.
+ *
+ * @param ptr Pointer to the value.
+ * @return The loaded value.
+ */
+static inline uint32_t atomic_load_u32(volatile uint32_t *ptr)
+{
+	uint32_t val = *ptr;
+	atomic_barrier();
+
+	return val;
+}
+
+/**
+ * Atomically stores a 32-bit value. Memory accesses preceding the store are
+ * visible before the store itself.
+ *
+ * @param ptr Pointer to the value.
+ * @param val The value to be stored.
+ */
+static inline void atomic_store_u32(volatile uint32_t *ptr, uint32_t val)
+{
+	atomic_barrier();
+	*ptr = val;
+}
+
+/**
+ * Atomically replaces the value pointed to by ptr with desired, if it's equal
+ * to expected.
+ *
+ * @param ptr      Pointer to the value.
+ * @param expected The value ptr is expected to hold.
+ * @param desired  The new value.
+ * @return True if the value was replaced, false otherwise.
+ */
+static inline bool atomic_cas_u32(volatile uint32_t *ptr,
+                                  uint32_t expected,
+                                  uint32_t desired)
+{
+	uint32_t curr;
+	uint32_t failed;
+
+	do {
+		asm volatile ("ldrex %[curr], [%[ptr]]"
+		              : [curr] "=r" (curr)
+		              : [ptr] "r" (ptr)
+		              : "memory");
+
+		if (curr != expected) {
+			asm volatile ("clrex" ::: "memory");
+			return false;
+		}
+
+		asm volatile ("strex %[failed], %[desired], [%[ptr]]"
+		              : [failed] "=&r" (failed)
+		              : [ptr] "r" (ptr), [desired] "r" (desired)
+		              : "memory");
+	} while (failed);
+
+	return true;
+}
+
+/**
+ * Atomically adds val to the value pointed to by ptr.
+ *
+ * @param ptr Pointer to the value.
+ * @param val The value to be added.
+ * @return The value before the addition.
+ */
+static inline uint32_t atomic_fetch_add_u32(volatile uint32_t *ptr,
+                                            uint32_t val)
+{
+	uint32_t old;
+	uint32_t failed;
+
+	do {
+		asm volatile ("ldrex %[old], [%[ptr]]"
+		              : [old] "=r" (old)
+		              : [ptr] "r" (ptr)
+		              : "memory");
+
+		asm volatile ("strex %[failed], %[new], [%[ptr]]"
+		              : [failed] "=&r" (failed)
+		              : [ptr] "r" (ptr), [new] "r" (old + val)
+		              : "memory");
+	} while (failed);
+
+	return old;
+}
+
+/**
+ * Loads a pointer and marks its address for exclusive access. Must be followed
+ * by atomic_store_exclusive_ptr() or atomic_clear_exclusive().
+ *
+ * The exclusive monitor is cleared on every exception entry and return, so the
+ * pair of calls fails if any interrupt handler ran in between, even if it left
+ * the pointer with its original value. This makes the pair immune to the ABA
+ * problem of compare-and-swap.
+ *
+ * @note Only available on ARMv7-M.
+ *
+ * @param ptr Pointer to the pointer to be loaded.
+ * @return The loaded pointer.
+ */
+static inline void *atomic_load_exclusive_ptr(void *volatile *ptr)
+{
+	void *val;
+
+	asm volatile ("ldrex %[val], [%[ptr]]"
+	              : [val] "=r" (val)
+	              : [ptr] "r" (ptr)
+	              : "memory");
+
+	return val;
+}
+
+/**
+ * Stores a pointer if the exclusive access started by
+ * atomic_load_exclusive_ptr() hasn't been interrupted.
+ *
+ * @note Only available on ARMv7-M.
+ *
+ * @param ptr Pointer to the pointer to be stored.
+ * @param val The new value.
+ * @return True if the value was stored, false otherwise.
+ */
+static inline bool atomic_store_exclusive_ptr(void *volatile *ptr, void *val)
+{
+	uint32_t failed;
+
+	asm volatile ("strex %[failed], %[val], [%[ptr]]"
+	              : [failed] "=&r" (failed)
+	              : [ptr] "r" (ptr), [val] "r" (val)
+	              : "memory");
+
+	return !failed;
+}
+
+/**
+ * Ends the exclusive access started by atomic_load_exclusive_ptr() without
+ * storing anything.
+ *
+ * @note Only available on ARMv7-M.
+ */
+static inline void atomic_clear_exclusive(void)
+{
+	asm volatile ("clrex" ::: "memory");
+}
+
+#elif defined(__ARM_ARCH_6M__)
+
+static inline void atomic_barrier(void)
+{
+	asm volatile ("" ::: "memory");
+}
+
+static inline uint32_t atomic_load_u32(volatile uint32_t *ptr)
+{
+	uint32_t val = *ptr;
+	atomic_barrier();
+
+	return val;
+}
+
+static inline void atomic_store_u32(volatile uint32_t *ptr, uint32_t val)
+{
+	atomic_barrier();
+	*ptr = val;
+}
+
+static inline bool atomic_cas_u32(volatile uint32_t *ptr,
+                                  uint32_t expected,
+                                  uint32_t desired)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (*ptr != expected) {
+		return false;
+	}
+
+	*ptr = desired;
+
+	return true;
+}
+
+static inline uint32_t atomic_fetch_add_u32(volatile uint32_t *ptr,
+                                            uint32_t val)
+{
+	CM_ATOMIC_CONTEXT();
+
+	uint32_t old = *ptr;
+	*ptr = old + val;
+
+	return old;
+}
+
+#else
+
+static inline void atomic_barrier(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t atomic_load_u32(volatile uint32_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomic_store_u32(volatile uint32_t *ptr, uint32_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline bool atomic_cas_u32(volatile uint32_t *ptr,
+                                  uint32_t expected,
+                                  uint32_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+	                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t atomic_fetch_add_u32(volatile uint32_t *ptr,
+                                            uint32_t val)
+{
+	return __atomic_fetch_add(ptr, val, __ATOMIC_ACQ_REL);
+}
+
+#endif
+
+#endif /* ATOMIC_H_ */
@@ -0,0 +1,173 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of a bitmap pool allocator.
+ */
+
+#include <stddef.h>  // For NULL
+#include <stdbool.h> // For bool.
+
+#include <libopencm3/cm3/cortex.h> // For CM_ATOMIC_CONTEXT().
+#include <libopencm3/cm3/assert.h> // For assert().
+
+#include <mouros/bitmap_pool.h> // Bitmap pool function definitions.
+
+
+/**
+ * Returns the index of the first bit at or after from which is set in
+ * (map ^ flip). I.e. with flip 0 the first set bit is found, and with flip ~0
+ * the first clear bit.
+ *
+ * @param map   The bitmap to search.
+ * @param from  The index of the first bit to look at.
+ * @param limit The index of the first bit not to look at.
+ * @param flip  Mask XORed with every word of the bitmap.
+ * @return The index of the bit, or limit if there's no such bit before it.
+ */
+static uint32_t find_bit(const uint32_t *map,
+                         uint32_t from,
+                         uint32_t limit,
+                         uint32_t flip)
+{
+	if (from >= limit) {
+		return limit;
+	}
+
+	uint32_t idx = from / 32;
+	uint32_t word = (map[idx] ^ flip) & (~0u << (from % 32));
+
+	while (word == 0) {
+		idx++;
+
+		if (idx * 32 >= limit) {
+			return limit;
+		}
+
+		word = map[idx] ^ flip;
+	}
+
+	uint32_t bit = idx * 32 + (uint32_t) __builtin_ctz(word);
+
+	return bit < limit ? bit : limit;
+}
+
+/**
+ * Sets or clears num bits starting at start, a word at a time.
+ *
+ * @param map   The bitmap to update.
+ * @param start The index of the first bit.
+ * @param num   The number of bits.
+ * @param set   True to set the bits, false to clear them.
+ */
+static void update_bits(uint32_t *map, uint32_t start, uint32_t num, bool set)
+{
+	while (num > 0) {
+		uint32_t shift = start % 32;
+		uint32_t count = 32 - shift < num ? 32 - shift : num;
+		uint32_t mask = (count == 32 ? ~0u : (1u << count) - 1) << shift;
+
+		if (set) {
+			map[start / 32] |= mask;
+		} else {
+			map[start / 32] &= ~mask;
+		}
+
+		start += count;
+		num -= count;
+	}
+}
+
+
+void os_bitmap_pool_init(bitmap_pool_t *pool,
+                         void *backing_mem,
+                         uint32_t block_size,
+                         uint32_t num_blocks,
+                         uint32_t *map)
+{
+	uint32_t map_words = OS_BITMAP_POOL_MAP_WORDS(num_blocks) / 2;
+
+	pool->mem = backing_mem;
+	pool->block_size = block_size;
+	pool->num_blocks = num_blocks;
+	pool->num_free = num_blocks;
+	pool->free_map = map;
+	pool->end_map = map + map_words;
+
+	// The bits past the last block stay clear, so they never look free.
+	for (uint32_t i = 0; i < 2 * map_words; i++) {
+		map[i] = 0;
+	}
+
+	update_bits(pool->free_map, 0, num_blocks, true);
+}
+
+void *os_bitmap_pool_take(bitmap_pool_t *pool)
+{
+	return os_bitmap_pool_take_run(pool, 1);
+}
+
+void *os_bitmap_pool_take_run(bitmap_pool_t *pool, uint32_t num)
+{
+	cm3_assert(num > 0);
+
+	CM_ATOMIC_CONTEXT();
+
+	if (num > pool->num_free) {
+		return NULL;
+	}
+
+	uint32_t start = find_bit(pool->free_map, 0, pool->num_blocks, 0);
+
+	while (start < pool->num_blocks) {
+		// Look for a used block within the candidate run. The search
+		// skips whole words of free blocks at once.
+		uint32_t limit = pool->num_blocks - start < num ?
+		                 pool->num_blocks : start + num;
+		uint32_t end = find_bit(pool->free_map, start, limit, ~0u);
+
+		if (end - start == num) {
+			update_bits(pool->free_map, start, num, false);
+			update_bits(pool->end_map, end - 1, 1, true);
+
+			pool->num_free -= num;
+
+			return pool->mem + start * pool->block_size;
+		}
+
+		if (end == pool->num_blocks) {
+			break;
+		}
+
+		start = find_bit(pool->free_map, end, pool->num_blocks, 0);
+	}
+
+	return NULL;
+}
+
+void os_bitmap_pool_give(bitmap_pool_t *pool, void *block)
+{
+	uint32_t offset = (uint32_t) ((uint8_t *) block - pool->mem);
+	uint32_t start = offset / pool->block_size;
+
+	cm3_assert((uint8_t *) block >= pool->mem);
+	cm3_assert(start < pool->num_blocks);
+	cm3_assert(offset % pool->block_size == 0);
+
+	CM_ATOMIC_CONTEXT();
+
+	cm3_assert(!(pool->free_map[start / 32] & (1u << (start % 32))));
+
+	uint32_t last = find_bit(pool->end_map, start, pool->num_blocks, 0);
+
+	cm3_assert(last < pool->num_blocks);
+
+	update_bits(pool->end_map, last, 1, false);
+	update_bits(pool->free_map, start, last - start + 1, true);
+
+	pool->num_free += last - start + 1;
+}
+
+uint32_t os_bitmap_pool_num_free(bitmap_pool_t *pool)
+{
+	return pool->num_free;
+}
@@ -100,4 +100,22 @@ void os_char_buffer_read_buf_blocking(mailbox_t *mb,
 	}
 }
 
+uint32_t os_char_buffer_write_span(mailbox_t *mb, char **span)
+{
+	return os_mailbox_write_span(mb, (void **) span);
+}
+
+void os_char_buffer_write_commit(mailbox_t *mb, uint32_t len)
+{
+	os_mailbox_write_commit(mb, len);
+}
 
+uint32_t os_char_buffer_read_span(mailbox_t *mb, const char **span)
+{
+	return os_mailbox_read_span(mb, (void **) span);
+}
+
+void os_char_buffer_read_commit(mailbox_t *mb, uint32_t len)
+{
+	os_mailbox_read_commit(mb, len);
+}
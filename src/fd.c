@@ -0,0 +1,186 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the MourOS file descriptor table.
+ *
+ */
+
+#include <stddef.h> // For NULL.
+#include <errno.h>  // For the error codes.
+#include <unistd.h> // For STDERR_FILENO.
+
+#include <mouros/fd.h>    // For the file descriptor functions.
+
+#include <libopencm3/cm3/assert.h> // For the assert macros.
+#include <libopencm3/cm3/cortex.h> // For the atomic macros.
+
+#include "scheduler.h" // For current_task.
+
+
+/**
+ * An entry of the file descriptor table.
+ */
+struct fd_entry {
+	/** The character buffer to read from. */
+	mailbox_t *rx;
+	/** The character buffer to write to. */
+	mailbox_t *tx;
+	/** The descriptor flags. */
+	uint32_t flags;
+	/** True if the entry is in use. */
+	bool used;
+};
+
+/**
+ * The file descriptor table.
+ */
+static struct fd_entry fd_table[OS_FD_MAX_FDS];
+
+
+/**
+ * Returns the table entry of the file descriptor.
+ *
+ * @param fd The file descriptor.
+ * @return Pointer to the entry, or NULL if fd isn't mapped.
+ */
+static inline struct fd_entry *get_entry(int fd)
+{
+	if (fd < 0 || fd >= OS_FD_MAX_FDS || !fd_table[fd].used) {
+		return NULL;
+	}
+
+	return &fd_table[fd];
+}
+
+/**
+ * Checks whether the caller may block. Before the scheduler is started, there
+ * is no task to put to sleep, so the calls return short counts instead.
+ *
+ * @return True if the calling task can be blocked.
+ */
+static inline bool can_block(void)
+{
+	return current_task != NULL;
+}
+
+
+bool os_fd_set(int fd, mailbox_t *rx, mailbox_t *tx, uint32_t flags)
+{
+	if (fd < 0 || fd >= OS_FD_MAX_FDS) {
+		return false;
+	}
+
+	cm3_assert(rx == NULL || rx->msg_size == 1);
+	cm3_assert(tx == NULL || tx->msg_size == 1);
+
+	CM_ATOMIC_BLOCK() {
+		fd_table[fd].rx = rx;
+		fd_table[fd].tx = tx;
+		fd_table[fd].flags = flags;
+		fd_table[fd].used = true;
+	}
+
+	return true;
+}
+
+int os_fd_open(mailbox_t *rx, mailbox_t *tx, uint32_t flags)
+{
+	cm3_assert(rx == NULL || rx->msg_size == 1);
+	cm3_assert(tx == NULL || tx->msg_size == 1);
+
+	CM_ATOMIC_CONTEXT();
+
+	for (int fd = STDERR_FILENO + 1; fd < OS_FD_MAX_FDS; fd++) {
+		if (!fd_table[fd].used) {
+			fd_table[fd].rx = rx;
+			fd_table[fd].tx = tx;
+			fd_table[fd].flags = flags;
+			fd_table[fd].used = true;
+
+			return fd;
+		}
+	}
+
+	return -1;
+}
+
+bool os_fd_close(int fd)
+{
+	CM_ATOMIC_CONTEXT();
+
+	struct fd_entry *entry = get_entry(fd);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	entry->used = false;
+
+	return true;
+}
+
+bool os_fd_is_open(int fd)
+{
+	return get_entry(fd) != NULL;
+}
+
+int32_t os_fd_write(int fd, const void *buf, uint32_t count)
+{
+	struct fd_entry *entry = get_entry(fd);
+
+	if (entry == NULL || entry->tx == NULL) {
+		return -EBADF;
+	}
+
+	const uint8_t *data = buf;
+	uint32_t pos = 0;
+
+	while (true) {
+		// Each chunk is written in one critical section, but when the
+		// buffer fills up, other writers' data may land between the
+		// chunks of a single write.
+		pos += os_mailbox_write_multiple_atomic(entry->tx, &data[pos],
+		                                        count - pos);
+
+		if (pos == count || (entry->flags & OS_FD_NONBLOCK) ||
+		    !can_block()) {
+			break;
+		}
+
+		os_mailbox_wait_space(entry->tx);
+	}
+
+	if (pos == 0 && count != 0) {
+		return -EAGAIN;
+	}
+
+	return (int32_t) pos;
+}
+
+int32_t os_fd_read(int fd, void *buf, uint32_t count)
+{
+	struct fd_entry *entry = get_entry(fd);
+
+	if (entry == NULL || entry->rx == NULL) {
+		return -EBADF;
+	}
+
+	uint32_t num_read = 0;
+
+	while (count != 0) {
+		num_read = os_mailbox_read_multiple_atomic(entry->rx, buf, count);
+
+		if (num_read != 0 || (entry->flags & OS_FD_NONBLOCK) ||
+		    !can_block()) {
+			break;
+		}
+
+		os_mailbox_select(&entry->rx, 1);
+	}
+
+	if (num_read == 0 && count != 0) {
+		return -EAGAIN;
+	}
+
+	return (int32_t) num_read;
+}
@@ -0,0 +1,282 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the MourOS variable-length frame
+ * queues.
+ *
+ */
+
+#include <stddef.h> // For NULL.
+
+#include <mouros/frame_queue.h> // For the frame queue functions & data types.
+
+#include <libopencm3/cm3/assert.h> // For the assert macros.
+
+#include "atomic.h" // For atomic_barrier().
+
+/**
+ * Length header value marking that the next frame is at the beginning of the
+ * buffer.
+ */
+#define WRAP_MARKER 0xffff
+
+
+/**
+ * Reads a frame length header.
+ *
+ * @param hdr Pointer to the header.
+ * @return The header value.
+ */
+static inline uint16_t get_header(const uint8_t *hdr)
+{
+	return (uint16_t) (hdr[0] | (hdr[1] << 8));
+}
+
+/**
+ * Writes a frame length header.
+ *
+ * @param hdr Pointer to the header.
+ * @param val The header value.
+ */
+static inline void set_header(uint8_t *hdr, uint16_t val)
+{
+	hdr[0] = (uint8_t) val;
+	hdr[1] = (uint8_t) (val >> 8);
+}
+
+/**
+ * Returns the position of the oldest frame in the queue. Follows the wrap to
+ * the beginning of the buffer if the read position points to a wrap marker, or
+ * if there is no room for a header before the end of the buffer.
+ *
+ * @param queue     Pointer to the queue struct.
+ * @param write_pos The current write position.
+ * @return The position of the oldest frame, or write_pos if the queue is empty.
+ */
+static inline uint32_t get_read_pos(frame_queue_t *queue, uint32_t write_pos)
+{
+	uint32_t pos = queue->read_pos;
+
+	if (pos != write_pos &&
+	    (queue->buf_len - pos < OS_FRAME_QUEUE_HEADER_SIZE ||
+	     get_header(&queue->buf[pos]) == WRAP_MARKER)) {
+		pos = 0;
+	}
+
+	return pos;
+}
+
+/**
+ * Moves the read position past the frames ending at end_pos.
+ *
+ * @param queue   Pointer to the queue struct.
+ * @param end_pos Position right after the last consumed frame.
+ */
+static inline void set_read_pos(frame_queue_t *queue, uint32_t end_pos)
+{
+	if (end_pos == queue->buf_len) {
+		end_pos = 0;
+	}
+
+	// The frame must be fully read before the writer can reuse its space.
+	atomic_barrier();
+
+	queue->read_pos = end_pos;
+}
+
+
+void os_frame_queue_init(frame_queue_t *queue,
+                         void *buf,
+                         uint32_t buf_len,
+                         void (*data_added_callback)(void))
+{
+	queue->buf = (uint8_t *) buf;
+	queue->buf_len = buf_len;
+	queue->data_added = data_added_callback;
+
+	queue->read_pos = 0;
+	queue->write_pos = 0;
+	queue->reserved_pos = 0;
+	queue->reserved_len = 0;
+}
+
+void *os_frame_queue_reserve(frame_queue_t *queue, uint16_t len)
+{
+	if (len > OS_FRAME_QUEUE_MAX_FRAME_LEN) {
+		return NULL;
+	}
+
+	uint32_t needed = OS_FRAME_QUEUE_HEADER_SIZE + (uint32_t) len;
+	uint32_t read_pos = queue->read_pos;
+	uint32_t write_pos = queue->write_pos;
+	uint32_t pos;
+
+	// The write position must never catch up with the read position, as
+	// that would make the queue look empty.
+	if (write_pos >= read_pos) {
+		uint32_t tail = queue->buf_len - write_pos;
+
+		if (needed < tail || (needed == tail && read_pos != 0)) {
+			pos = write_pos;
+
+		} else if (needed < read_pos) {
+			if (tail >= OS_FRAME_QUEUE_HEADER_SIZE) {
+				set_header(&queue->buf[write_pos], WRAP_MARKER);
+			}
+
+			pos = 0;
+
+		} else {
+			return NULL;
+		}
+
+	} else if (needed < read_pos - write_pos) {
+		pos = write_pos;
+
+	} else {
+		return NULL;
+	}
+
+	set_header(&queue->buf[pos], len);
+
+	queue->reserved_pos = pos;
+	queue->reserved_len = len;
+
+	return &queue->buf[pos + OS_FRAME_QUEUE_HEADER_SIZE];
+}
+
+void os_frame_queue_commit(frame_queue_t *queue)
+{
+	uint32_t new_write_pos = queue->reserved_pos +
+	                         OS_FRAME_QUEUE_HEADER_SIZE +
+	                         queue->reserved_len;
+
+	if (new_write_pos == queue->buf_len) {
+		new_write_pos = 0;
+	}
+
+	// The frame must be in the buffer before the reader can see it.
+	atomic_barrier();
+
+	queue->write_pos = new_write_pos;
+
+	if (queue->data_added != NULL) {
+		queue->data_added();
+	}
+}
+
+bool os_frame_queue_write(frame_queue_t *queue, const void *data, uint16_t len)
+{
+	uint8_t *frame = os_frame_queue_reserve(queue, len);
+
+	if (frame == NULL) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < len; i++) {
+		frame[i] = ((const uint8_t *) data)[i];
+	}
+
+	os_frame_queue_commit(queue);
+
+	return true;
+}
+
+const void *os_frame_queue_peek(frame_queue_t *queue, uint16_t *len)
+{
+	uint32_t write_pos = queue->write_pos;
+	uint32_t pos = get_read_pos(queue, write_pos);
+
+	if (pos == write_pos) {
+		return NULL;
+	}
+
+	atomic_barrier();
+
+	*len = get_header(&queue->buf[pos]);
+
+	return &queue->buf[pos + OS_FRAME_QUEUE_HEADER_SIZE];
+}
+
+void os_frame_queue_consume(frame_queue_t *queue)
+{
+	uint32_t write_pos = queue->write_pos;
+	uint32_t pos = get_read_pos(queue, write_pos);
+
+	if (pos == write_pos) {
+		return;
+	}
+
+	atomic_barrier();
+
+	set_read_pos(queue, pos + OS_FRAME_QUEUE_HEADER_SIZE +
+	                    get_header(&queue->buf[pos]));
+}
+
+bool os_frame_queue_read(frame_queue_t *queue, void *out, uint16_t *len)
+{
+	uint16_t frame_len;
+	const uint8_t *frame = os_frame_queue_peek(queue, &frame_len);
+
+	if (frame == NULL) {
+		return false;
+	}
+
+	if (frame_len > *len) {
+		*len = frame_len;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < frame_len; i++) {
+		((uint8_t *) out)[i] = frame[i];
+	}
+
+	*len = frame_len;
+
+	os_frame_queue_consume(queue);
+
+	return true;
+}
+
+const void *os_frame_queue_peek_span(frame_queue_t *queue, uint32_t *len)
+{
+	uint32_t write_pos = queue->write_pos;
+	uint32_t pos = get_read_pos(queue, write_pos);
+
+	if (pos == write_pos) {
+		return NULL;
+	}
+
+	atomic_barrier();
+
+	uint32_t end = write_pos;
+
+	if (write_pos < pos) {
+		// The writer has wrapped. Walk the frames up to the wrap point.
+		end = pos;
+
+		while (end != queue->buf_len &&
+		       queue->buf_len - end >= OS_FRAME_QUEUE_HEADER_SIZE) {
+			uint16_t frame_len = get_header(&queue->buf[end]);
+
+			if (frame_len == WRAP_MARKER) {
+				break;
+			}
+
+			end += OS_FRAME_QUEUE_HEADER_SIZE + frame_len;
+		}
+	}
+
+	*len = end - pos;
+
+	return &queue->buf[pos];
+}
+
+void os_frame_queue_consume_span(frame_queue_t *queue, uint32_t len)
+{
+	uint32_t pos = get_read_pos(queue, queue->write_pos);
+
+	cm3_assert(pos + len <= queue->buf_len);
+
+	set_read_pos(queue, pos + len);
+}
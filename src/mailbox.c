@@ -13,6 +13,15 @@
 #include <libopencm3/cm3/assert.h> // For the assert macros.
 #include <libopencm3/cm3/cortex.h> // For the atomic macros.
 
+#include "scheduler.h"      // For current_task, os_tick_count, etc.
+#include "mailbox_notify.h" // For mailbox_notify_tick().
+
+
+/**
+ * List of the notification policies with a running idle timeout.
+ */
+static mailbox_notify_t *idle_list = NULL;
+
 /**
  * Inserts a single message into the mailbox.
  *
@@ -40,6 +49,247 @@ static inline bool write_msg(mailbox_t *mb, const void *msg)
 	}
 }
 
+/**
+ * Wakes up the task waiting for data in the mailbox, if there is one.
+ *
+ * @param mb Pointer to the mailbox struct.
+ */
+static inline void wake_waiting_task(mailbox_t *mb)
+{
+	if (mb->waiting_task == NULL) {
+		return;
+	}
+
+	CM_ATOMIC_BLOCK() {
+		struct tcb *task = mb->waiting_task;
+
+		if (task != NULL) {
+			mb->waiting_task = NULL;
+
+			if (task->state == TASK_WAITING_FOR_MAILBOX) {
+				sched_wake_task(task);
+			}
+		}
+	}
+}
+
+/**
+ * Wakes up the tasks waiting for space in the mailbox, if there are any.
+ *
+ * @param mb Pointer to the mailbox struct.
+ */
+static inline void wake_waiting_writers(mailbox_t *mb)
+{
+	if (mb->waiting_writers == NULL) {
+		return;
+	}
+
+	CM_ATOMIC_BLOCK() {
+		struct tcb *task = mb->waiting_writers;
+
+		mb->waiting_writers = NULL;
+
+		while (task != NULL) {
+			struct tcb *next = task->wait_next;
+
+			task->wait_next = NULL;
+
+			if (task->state == TASK_WAITING_FOR_MAILBOX) {
+				sched_wake_task(task);
+			}
+
+			task = next;
+		}
+	}
+}
+
+/**
+ * Returns the number of bytes of messages stored in the mailbox.
+ *
+ * @param mb Pointer to the mailbox struct.
+ * @return The number of bytes stored.
+ */
+static inline uint32_t get_fill_bytes(mailbox_t *mb)
+{
+	uint32_t read_pos = mb->read_pos;
+	uint32_t write_pos = mb->write_pos;
+
+	if (write_pos >= read_pos) {
+		return write_pos - read_pos;
+	} else {
+		return mb->msg_buf_len - read_pos + write_pos;
+	}
+}
+
+/**
+ * Checks whether any of the messages starts with the delimiter of the
+ * notification policy.
+ *
+ * @param notify   Pointer to the notification policy.
+ * @param msgs     Pointer to the messages.
+ * @param msg_num  The number of messages.
+ * @param msg_size The size of a single message.
+ * @return True if a delimiter was found, false otherwise.
+ */
+static inline bool has_delimiter(const mailbox_notify_t *notify,
+                                 const uint8_t *msgs,
+                                 uint32_t msg_num,
+                                 uint32_t msg_size)
+{
+	if (notify->delimiter == OS_MAILBOX_NO_DELIMITER) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < msg_num; i++, msgs += msg_size) {
+		if (*msgs == (uint8_t) notify->delimiter) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Removes the notification policy from the list of running idle timeouts.
+ *
+ * @note Must be called with interrupts disabled.
+ *
+ * @param notify Pointer to the notification policy.
+ */
+static void unlist_idle_timeout(mailbox_notify_t *notify)
+{
+	mailbox_notify_t **link = &idle_list;
+
+	while (*link != NULL) {
+		if (*link == notify) {
+			*link = notify->next;
+			break;
+		}
+
+		link = &(*link)->next;
+	}
+
+	notify->idle_listed = false;
+	notify->idle_armed = false;
+}
+
+/**
+ * (Re)starts the idle timeout of the notification policy.
+ *
+ * @param notify Pointer to the notification policy.
+ */
+static void arm_idle_timeout(mailbox_notify_t *notify)
+{
+	CM_ATOMIC_BLOCK() {
+		notify->idle_deadline = os_tick_count + notify->idle_ticks;
+		notify->idle_armed = true;
+
+		if (!notify->idle_listed) {
+			notify->idle_listed = true;
+			notify->next = idle_list;
+			idle_list = notify;
+		}
+	}
+}
+
+/**
+ * Calls the data_added callback of the mailbox and wakes up the task waiting
+ * for data in it.
+ *
+ * @param mb Pointer to the mailbox struct.
+ */
+static inline void notify_consumer(mailbox_t *mb)
+{
+	if (mb->data_added != NULL) {
+		mb->data_added();
+	}
+
+	wake_waiting_task(mb);
+}
+
+/**
+ * Checks whether the write of written bytes made the fill level of the mailbox
+ * cross the notification threshold. Writes while the fill level stays at or
+ * above the threshold don't notify again, the consumer was already told.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param notify  Pointer to the notification policy of the mailbox.
+ * @param written The number of bytes just written.
+ * @return True if the threshold was crossed, false otherwise.
+ */
+static inline bool crossed_threshold(mailbox_t *mb,
+                                     const mailbox_notify_t *notify,
+                                     uint32_t written)
+{
+	uint32_t fill = get_fill_bytes(mb);
+
+	// The fill level before the write. The consumer may have read some of
+	// the data in the meantime, so it can't be less than zero.
+	uint32_t prev_fill = fill > written ? fill - written : 0;
+
+	return fill >= notify->threshold_bytes &&
+	       prev_fill < notify->threshold_bytes;
+}
+
+/**
+ * Notifies the consumer about new messages, as permitted by the notification
+ * policy of the mailbox.
+ *
+ * @param mb      Pointer to the mailbox struct.
+ * @param msgs    Pointer to the new messages.
+ * @param msg_num The number of new messages.
+ */
+static inline void data_written(mailbox_t *mb,
+                                const uint8_t *msgs,
+                                uint32_t msg_num)
+{
+	mailbox_notify_t *notify = mb->notify;
+
+	if (notify != NULL &&
+	    !crossed_threshold(mb, notify, msg_num * mb->msg_size) &&
+	    !has_delimiter(notify, msgs, msg_num, mb->msg_size)) {
+
+		if (notify->idle_ticks != 0) {
+			arm_idle_timeout(notify);
+		}
+
+		return;
+	}
+
+	if (notify != NULL) {
+		notify->idle_armed = false;
+	}
+
+	notify_consumer(mb);
+}
+
+void mailbox_notify_tick(void)
+{
+	CM_ATOMIC_CONTEXT();
+
+	mailbox_notify_t **link = &idle_list;
+
+	while (*link != NULL) {
+		mailbox_notify_t *notify = *link;
+
+		if (notify->idle_armed && os_tick_count < notify->idle_deadline) {
+			link = &notify->next;
+			continue;
+		}
+
+		*link = notify->next;
+		notify->idle_listed = false;
+
+		if (notify->idle_armed) {
+			notify->idle_armed = false;
+
+			if (get_fill_bytes(notify->mb) != 0) {
+				notify_consumer(notify->mb);
+			}
+		}
+	}
+}
+
 void os_mailbox_init(mailbox_t *mb,
                      void *msg_buf,
                      uint32_t num_msgs,
@@ -50,16 +300,52 @@ void os_mailbox_init(mailbox_t *mb,
 	mb->msg_buf_len = num_msgs * msg_size;
 	mb->msg_size = msg_size;
 	mb->data_added = data_added_callback;
+	mb->waiting_task = NULL;
+	mb->waiting_writers = NULL;
+	mb->notify = NULL;
 
 	mb->read_pos = 0;
 	mb->write_pos = 0;
 }
 
+void os_mailbox_set_notify(mailbox_t *mb,
+                           mailbox_notify_t *notify,
+                           uint32_t threshold,
+                           int16_t delimiter,
+                           uint32_t idle_ticks)
+{
+	CM_ATOMIC_BLOCK() {
+		if (mb->notify != NULL && mb->notify->idle_listed) {
+			unlist_idle_timeout(mb->notify);
+		}
+
+		if (notify != NULL) {
+			// The mailbox holds at most msg_buf_len - msg_size bytes.
+			uint32_t capacity = mb->msg_buf_len - mb->msg_size;
+
+			notify->threshold_bytes = threshold * mb->msg_size;
+			if (threshold == 0 || notify->threshold_bytes > capacity) {
+				notify->threshold_bytes = capacity;
+			}
+
+			notify->idle_ticks = idle_ticks;
+			notify->delimiter = delimiter;
+			notify->idle_armed = false;
+			notify->idle_listed = false;
+			notify->idle_deadline = 0;
+			notify->mb = mb;
+			notify->next = NULL;
+		}
+
+		mb->notify = notify;
+	}
+}
+
 bool os_mailbox_write(mailbox_t *mb, const void *msg)
 {
 	bool ret = write_msg(mb, msg);
-	if (ret && mb->data_added != NULL) {
-		mb->data_added();
+	if (ret) {
+		data_written(mb, msg, 1);
 	}
 
 	return ret;
@@ -77,8 +363,8 @@ uint32_t os_mailbox_write_multiple(mailbox_t *mb,
 		}
 	}
 
-	if (i > 0 && mb->data_added != NULL) {
-		mb->data_added();
+	if (i > 0) {
+		data_written(mb, msgs, i);
 	}
 
 	return i;
@@ -99,6 +385,8 @@ bool os_mailbox_read(mailbox_t *mb, void *out)
 
 		mb->read_pos = new_read_pos;
 
+		wake_waiting_writers(mb);
+
 		return true;
 	} else {
 		return false;
@@ -152,3 +440,145 @@ uint32_t os_mailbox_read_multiple_atomic(mailbox_t *mb,
 	return os_mailbox_read_multiple(mb, out, out_msg_num);
 }
 
+uint32_t os_mailbox_write_span(mailbox_t *mb, void **span)
+{
+	uint32_t read_pos = mb->read_pos;
+	uint32_t write_pos = mb->write_pos;
+	uint32_t end;
+
+	// One slot must always stay empty, so the write position never catches
+	// up with the read position.
+	if (write_pos >= read_pos) {
+		end = mb->msg_buf_len;
+
+		if (read_pos == 0) {
+			end -= mb->msg_size;
+		}
+	} else {
+		end = read_pos - mb->msg_size;
+	}
+
+	*span = &mb->msg_buf[write_pos];
+
+	return (end - write_pos) / mb->msg_size;
+}
+
+void os_mailbox_write_commit(mailbox_t *mb, uint32_t msg_num)
+{
+	if (msg_num == 0) {
+		return;
+	}
+
+	const uint8_t *msgs = &mb->msg_buf[mb->write_pos];
+	uint32_t new_write_pos = mb->write_pos + msg_num * mb->msg_size;
+
+	cm3_assert(new_write_pos <= mb->msg_buf_len);
+
+	if (new_write_pos == mb->msg_buf_len) {
+		new_write_pos = 0;
+	}
+
+	mb->write_pos = new_write_pos;
+
+	data_written(mb, msgs, msg_num);
+}
+
+uint32_t os_mailbox_read_span(mailbox_t *mb, void **span)
+{
+	uint32_t read_pos = mb->read_pos;
+	uint32_t write_pos = mb->write_pos;
+	uint32_t end;
+
+	if (read_pos <= write_pos) {
+		end = write_pos;
+	} else {
+		end = mb->msg_buf_len;
+	}
+
+	*span = &mb->msg_buf[read_pos];
+
+	return (end - read_pos) / mb->msg_size;
+}
+
+void os_mailbox_read_commit(mailbox_t *mb, uint32_t msg_num)
+{
+	uint32_t new_read_pos = mb->read_pos + msg_num * mb->msg_size;
+
+	cm3_assert(new_read_pos <= mb->msg_buf_len);
+
+	if (new_read_pos == mb->msg_buf_len) {
+		new_read_pos = 0;
+	}
+
+	mb->read_pos = new_read_pos;
+
+	wake_waiting_writers(mb);
+}
+
+uint32_t os_mailbox_poll(mailbox_t **mbs, uint8_t num_mbs)
+{
+	cm3_assert(num_mbs <= 32);
+
+	uint32_t ready = 0;
+
+	for (uint8_t i = 0; i < num_mbs; i++) {
+		if (mbs[i]->read_pos != mbs[i]->write_pos) {
+			ready |= (uint32_t) 1 << i;
+		}
+	}
+
+	return ready;
+}
+
+uint32_t os_mailbox_select(mailbox_t **mbs, uint8_t num_mbs)
+{
+	while (true) {
+		CM_ATOMIC_CONTEXT();
+
+		uint32_t ready = os_mailbox_poll(mbs, num_mbs);
+
+		if (ready != 0) {
+			for (uint8_t i = 0; i < num_mbs; i++) {
+				if (mbs[i]->waiting_task == current_task) {
+					mbs[i]->waiting_task = NULL;
+				}
+			}
+
+			return ready;
+		}
+
+		for (uint8_t i = 0; i < num_mbs; i++) {
+			cm3_assert(mbs[i]->waiting_task == NULL ||
+			           mbs[i]->waiting_task == current_task);
+
+			mbs[i]->waiting_task = current_task;
+		}
+
+		current_task->state = TASK_WAITING_FOR_MAILBOX;
+
+		sched_trace_block(mbs[0]);
+
+		os_task_yield();
+	}
+}
+
+void os_mailbox_wait_space(mailbox_t *mb)
+{
+	while (true) {
+		CM_ATOMIC_CONTEXT();
+
+		// The mailbox holds at most msg_buf_len - msg_size bytes.
+		if (get_fill_bytes(mb) + mb->msg_size < mb->msg_buf_len) {
+			return;
+		}
+
+		current_task->wait_next = mb->waiting_writers;
+		mb->waiting_writers = current_task;
+
+		current_task->state = TASK_WAITING_FOR_MAILBOX;
+
+		sched_trace_block(mb);
+
+		os_task_yield();
+	}
+}
@@ -0,0 +1,172 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the multi-producer/multi-consumer
+ * FIFO queues for MourOS.
+ *
+ */
+
+#include <stddef.h> // For NULL.
+
+#include <mouros/mailbox_mpmc.h> // For the mailbox functions & data types.
+
+#include <libopencm3/cm3/assert.h> // For the assert macros.
+
+#include "atomic.h" // For the atomic primitives.
+
+
+/**
+ * Returns a pointer to the sequence number of the slot corresponding to pos.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param pos Free running slot position.
+ * @return Pointer to the slot sequence number. The message data follows it.
+ */
+static inline volatile uint32_t *get_slot(mailbox_mpmc_t *mb, uint32_t pos)
+{
+	return (volatile uint32_t *) &mb->slot_buf[(pos & mb->mask) *
+	                                           mb->slot_size];
+}
+
+/**
+ * Inserts a single message into the mailbox.
+ *
+ * @param mb  Pointer to the mailbox struct.
+ * @param msg Pointer to the message to be inserted.
+ * @return True if the message was successfully added, false otherwise.
+ */
+static bool write_msg(mailbox_mpmc_t *mb, const void *msg)
+{
+	uint32_t pos = atomic_load_u32(&mb->write_pos);
+	volatile uint32_t *slot;
+
+	while (true) {
+		slot = get_slot(mb, pos);
+
+		int32_t diff = (int32_t) (atomic_load_u32(slot) - pos);
+
+		if (diff == 0) {
+			// The slot is free. Try to claim it.
+			if (atomic_cas_u32(&mb->write_pos, pos, pos + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// The slot still holds an unread message. We're full.
+			return false;
+		}
+
+		// Another producer got here first.
+		pos = atomic_load_u32(&mb->write_pos);
+	}
+
+	uint8_t *data = (uint8_t *) (slot + 1);
+	for (uint32_t i = 0; i < mb->msg_size; i++) {
+		data[i] = ((const uint8_t *) msg)[i];
+	}
+
+	atomic_store_u32(slot, pos + 1);
+
+	return true;
+}
+
+void os_mailbox_mpmc_init(mailbox_mpmc_t *mb,
+                          void *slot_buf,
+                          uint32_t num_msgs,
+                          uint32_t msg_size,
+                          void (*data_added_callback)(void))
+{
+	cm3_assert(num_msgs != 0 && (num_msgs & (num_msgs - 1)) == 0);
+	cm3_assert(((uintptr_t) slot_buf & 0b11) == 0);
+
+	mb->slot_buf = (uint8_t *) slot_buf;
+	mb->mask = num_msgs - 1;
+	mb->msg_size = msg_size;
+	mb->slot_size = OS_MAILBOX_MPMC_SLOT_SIZE(msg_size);
+	mb->data_added = data_added_callback;
+
+	for (uint32_t i = 0; i < num_msgs; i++) {
+		*get_slot(mb, i) = i;
+	}
+
+	mb->read_pos = 0;
+	atomic_store_u32(&mb->write_pos, 0);
+}
+
+bool os_mailbox_mpmc_write(mailbox_mpmc_t *mb, const void *msg)
+{
+	bool ret = write_msg(mb, msg);
+	if (ret && mb->data_added != NULL) {
+		mb->data_added();
+	}
+
+	return ret;
+}
+
+uint32_t os_mailbox_mpmc_write_multiple(mailbox_mpmc_t *mb,
+                                        const void *msgs,
+                                        uint32_t msg_num)
+{
+	uint32_t i;
+	const uint8_t *curr_msg = msgs;
+	for (i = 0; i < msg_num; i++, curr_msg += mb->msg_size) {
+		if (!write_msg(mb, curr_msg)) {
+			break;
+		}
+	}
+
+	if (i > 0 && mb->data_added != NULL) {
+		mb->data_added();
+	}
+
+	return i;
+}
+
+bool os_mailbox_mpmc_read(mailbox_mpmc_t *mb, void *out)
+{
+	uint32_t pos = atomic_load_u32(&mb->read_pos);
+	volatile uint32_t *slot;
+
+	while (true) {
+		slot = get_slot(mb, pos);
+
+		int32_t diff = (int32_t) (atomic_load_u32(slot) - (pos + 1));
+
+		if (diff == 0) {
+			// The slot holds a message. Try to claim it.
+			if (atomic_cas_u32(&mb->read_pos, pos, pos + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// The slot hasn't been written yet. We're empty.
+			return false;
+		}
+
+		// Another consumer got here first.
+		pos = atomic_load_u32(&mb->read_pos);
+	}
+
+	const uint8_t *data = (const uint8_t *) (slot + 1);
+	for (uint32_t i = 0; i < mb->msg_size; i++) {
+		((uint8_t *) out)[i] = data[i];
+	}
+
+	// Hand the slot over to the producer that's one lap ahead.
+	atomic_store_u32(slot, pos + mb->mask + 1);
+
+	return true;
+}
+
+uint32_t os_mailbox_mpmc_read_multiple(mailbox_mpmc_t *mb,
+                                       void *out,
+                                       uint32_t out_msg_num)
+{
+	uint32_t i;
+	uint8_t *curr_msg = out;
+	for (i = 0; i < out_msg_num; i++, curr_msg += mb->msg_size) {
+		if (!os_mailbox_mpmc_read(mb, curr_msg)) {
+			break;
+		}
+	}
+
+	return i;
+}
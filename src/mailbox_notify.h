@@ -0,0 +1,19 @@
+/**
+ * @file
+ *
+ * This file contains internal declarations for the MourOS mailbox notification
+ * policies.
+ *
+ */
+
+#ifndef MAILBOX_NOTIFY_H_
+#define MAILBOX_NOTIFY_H_
+
+/**
+ * Checks the idle timeouts of the mailbox notification policies, and notifies
+ * the consumers of the mailboxes whose timeout has expired. Called by the
+ * scheduler on every system tick.
+ */
+void mailbox_notify_tick(void);
+
+#endif /* MAILBOX_NOTIFY_H_ */
@@ -0,0 +1,139 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the power-of-two FIFO queues for
+ * MourOS.
+ *
+ */
+
+#include <stddef.h> // For NULL.
+
+#include <mouros/mailbox_pow2.h> // For the mailbox functions & data types.
+
+#include <libopencm3/cm3/assert.h> // For the assert macros.
+#include <libopencm3/cm3/cortex.h> // For the atomic macros.
+
+
+void os_mailbox_pow2_init(mailbox_pow2_t *mb,
+                          void *msg_buf,
+                          uint32_t num_msgs,
+                          uint32_t msg_size,
+                          void (*data_added_callback)(void))
+{
+	cm3_assert(num_msgs != 0 && (num_msgs & (num_msgs - 1)) == 0);
+
+	mb->msg_buf = (uint8_t *) msg_buf;
+	mb->mask = num_msgs - 1;
+	mb->msg_size = msg_size;
+	mb->data_added = data_added_callback;
+
+	mb->read_cnt = 0;
+	mb->write_cnt = 0;
+}
+
+uint32_t os_mailbox_pow2_count(const mailbox_pow2_t *mb)
+{
+	return mb->write_cnt - mb->read_cnt;
+}
+
+bool os_mailbox_pow2_write(mailbox_pow2_t *mb, const void *msg)
+{
+	return __os_mailbox_pow2_write(mb, msg, mb->msg_size);
+}
+
+uint32_t os_mailbox_pow2_write_multiple(mailbox_pow2_t *mb,
+                                        const void *msgs,
+                                        uint32_t msg_num)
+{
+	uint32_t write_cnt = mb->write_cnt;
+	uint32_t num_free = mb->mask + 1 - (write_cnt - mb->read_cnt);
+
+	if (msg_num > num_free) {
+		msg_num = num_free;
+	}
+
+	const uint8_t *curr_msg = msgs;
+	for (uint32_t i = 0; i < msg_num; i++, curr_msg += mb->msg_size) {
+		uint8_t *slot = &mb->msg_buf[((write_cnt + i) & mb->mask) *
+		                             mb->msg_size];
+
+		for (uint32_t j = 0; j < mb->msg_size; j++) {
+			slot[j] = curr_msg[j];
+		}
+	}
+
+	asm volatile ("" ::: "memory");
+
+	mb->write_cnt = write_cnt + msg_num;
+
+	if (msg_num > 0 && mb->data_added != NULL) {
+		mb->data_added();
+	}
+
+	return msg_num;
+}
+
+bool os_mailbox_pow2_read(mailbox_pow2_t *mb, void *out)
+{
+	return __os_mailbox_pow2_read(mb, out, mb->msg_size);
+}
+
+uint32_t os_mailbox_pow2_read_multiple(mailbox_pow2_t *mb,
+                                       void *out,
+                                       uint32_t out_msg_num)
+{
+	uint32_t read_cnt = mb->read_cnt;
+	uint32_t num_stored = mb->write_cnt - read_cnt;
+
+	if (out_msg_num > num_stored) {
+		out_msg_num = num_stored;
+	}
+
+	uint8_t *curr_msg = out;
+	for (uint32_t i = 0; i < out_msg_num; i++, curr_msg += mb->msg_size) {
+		const uint8_t *slot = &mb->msg_buf[((read_cnt + i) & mb->mask) *
+		                                   mb->msg_size];
+
+		for (uint32_t j = 0; j < mb->msg_size; j++) {
+			curr_msg[j] = slot[j];
+		}
+	}
+
+	asm volatile ("" ::: "memory");
+
+	mb->read_cnt = read_cnt + out_msg_num;
+
+	return out_msg_num;
+}
+
+bool os_mailbox_pow2_write_atomic(mailbox_pow2_t *mb, const void *msg)
+{
+	CM_ATOMIC_CONTEXT();
+
+	return os_mailbox_pow2_write(mb, msg);
+}
+
+uint32_t os_mailbox_pow2_write_multiple_atomic(mailbox_pow2_t *mb,
+                                               const void *msgs,
+                                               uint32_t msg_num)
+{
+	CM_ATOMIC_CONTEXT();
+
+	return os_mailbox_pow2_write_multiple(mb, msgs, msg_num);
+}
+
+bool os_mailbox_pow2_read_atomic(mailbox_pow2_t *mb, void *out)
+{
+	CM_ATOMIC_CONTEXT();
+
+	return os_mailbox_pow2_read(mb, out);
+}
+
+uint32_t os_mailbox_pow2_read_multiple_atomic(mailbox_pow2_t *mb,
+                                              void *out,
+                                              uint32_t out_msg_num)
+{
+	CM_ATOMIC_CONTEXT();
+
+	return os_mailbox_pow2_read_multiple(mb, out, out_msg_num);
+}
@@ -0,0 +1,113 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the MourOS message queues.
+ *
+ */
+
+#include <stddef.h> // For NULL.
+
+#include <mouros/msg_queue.h> // For the message queue functions & data types.
+
+#include "atomic.h" // For the atomic primitives.
+
+
+/**
+ * Returns the header of a reference counted message.
+ *
+ * @param msg Pointer to the message payload.
+ * @return Pointer to the message header.
+ */
+static inline struct msg_header *get_header(void *msg)
+{
+	return (struct msg_header *) ((uint8_t *) msg - OS_MSG_HEADER_SIZE);
+}
+
+
+void os_msg_queue_init(msg_queue_t *queue,
+                       void **ptr_buf,
+                       uint32_t num_msgs,
+                       pool_alloc_t *pool,
+                       void (*data_added_callback)(void))
+{
+	os_mailbox_init(&queue->mb, ptr_buf, num_msgs, sizeof(void *),
+	                data_added_callback);
+
+	queue->pool = pool;
+}
+
+void *os_msg_queue_alloc(msg_queue_t *queue)
+{
+	return os_pool_alloc_take(queue->pool);
+}
+
+bool os_msg_queue_send(msg_queue_t *queue, void *msg)
+{
+	return os_mailbox_write(&queue->mb, &msg);
+}
+
+void *os_msg_queue_receive(msg_queue_t *queue)
+{
+	void *msg = NULL;
+
+	os_mailbox_read(&queue->mb, &msg);
+
+	return msg;
+}
+
+void os_msg_queue_free(msg_queue_t *queue, void *msg)
+{
+	os_pool_alloc_give(queue->pool, msg);
+}
+
+void *os_msg_alloc(pool_alloc_t *pool)
+{
+	struct msg_header *header = os_pool_alloc_take(pool);
+
+	if (header == NULL) {
+		return NULL;
+	}
+
+	header->pool = pool;
+	header->refs = 1;
+
+	return (uint8_t *) header + OS_MSG_HEADER_SIZE;
+}
+
+void os_msg_ref(void *msg, uint32_t count)
+{
+	atomic_fetch_add_u32(&get_header(msg)->refs, count);
+}
+
+void os_msg_release(void *msg)
+{
+	struct msg_header *header = get_header(msg);
+
+	if (atomic_fetch_add_u32(&header->refs, (uint32_t) -1) == 1) {
+		os_pool_alloc_give(header->pool, header);
+	}
+}
+
+uint32_t os_msg_queue_send_multi(msg_queue_t **queues,
+                                 uint32_t num_queues,
+                                 void *msg)
+{
+	uint32_t num_sent = 0;
+
+	// Every queue gets its own reference. The caller's reference keeps the
+	// message alive until it has been sent to all the queues, even if a
+	// receiver releases its reference right away.
+	os_msg_ref(msg, num_queues);
+
+	for (uint32_t i = 0; i < num_queues; i++) {
+		if (os_msg_queue_send(queues[i], msg)) {
+			num_sent++;
+		} else {
+			os_msg_release(msg);
+		}
+	}
+
+	os_msg_release(msg);
+
+	return num_sent;
+}
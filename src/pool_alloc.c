@@ -11,34 +11,255 @@
 
 #include <mouros/pool_alloc.h> // Pool alloc function definitions.
 
+#include "atomic.h"    // For the exclusive access primitives.
+#include "scheduler.h" // For current_task, sched_wake_task(), etc.
 
+#ifdef DIAG_ENABLE
+#include "diag/diag.h" // For diag_pool_stats().
+#include <mouros/diag_mask.h> // For OS_DIAG_ENABLED().
+#endif
 
-void os_pool_alloc_init(pool_alloc_t *alloc,
-                        void *backing_mem,
-                        uint32_t block_size,
-                        uint32_t num_blocks) {
 
-	cm3_assert(block_size >= sizeof(uintptr_t));
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__) && \
+    !defined(__ARM_ARCH_7EM__)
+
+/**
+ * The list head and its tag, swapped together by the host implementation.
+ * Overlays the first_block and tag members of pool_alloc_t.
+ */
+struct tagged_head {
+	/** Pointer to the first free block. */
+	void *block;
+	/** The version counter of block. */
+	uintptr_t tag;
+} __attribute__((aligned(2 * sizeof(uintptr_t))));
+
+#endif
+
+
+#ifdef POOL_STATS_ENABLE
+
+/**
+ * Updates the statistics after blocks were taken.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param num   The number of blocks taken.
+ */
+static inline void stats_taken(pool_alloc_t *alloc, uint32_t num)
+{
+	uint32_t num_free = atomic_fetch_add_u32(&alloc->num_free,
+	                                         (uint32_t) -num) - num;
+	uint32_t min_free = atomic_load_u32(&alloc->min_free);
+
+	while (num_free < min_free &&
+	       !atomic_cas_u32(&alloc->min_free, min_free, num_free)) {
+		min_free = atomic_load_u32(&alloc->min_free);
+	}
+}
+
+/**
+ * Updates the statistics before blocks are given back. The count is raised
+ * before the blocks are visible in the list, so that a concurrent take can
+ * never make it drop below zero.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param num   The number of blocks given back.
+ */
+static inline void stats_giving(pool_alloc_t *alloc, uint32_t num)
+{
+	atomic_fetch_add_u32(&alloc->num_free, num);
+}
+
+/**
+ * Updates the statistics after a take from an empty pool.
+ *
+ * @param alloc Pointer to the pool struct.
+ */
+static inline void stats_failed(pool_alloc_t *alloc)
+{
+	atomic_fetch_add_u32(&alloc->num_failures, 1);
+}
+
+#else
+
+static inline void stats_taken(pool_alloc_t *alloc, uint32_t num)
+{
+	(void) alloc;
+	(void) num;
+}
+
+static inline void stats_giving(pool_alloc_t *alloc, uint32_t num)
+{
+	(void) alloc;
+	(void) num;
+}
+
+static inline void stats_failed(pool_alloc_t *alloc)
+{
+	(void) alloc;
+}
+
+#endif
+
+
+/**
+ * Adds the current task to the list of tasks waiting for a block of alloc. The
+ * task is inserted into the list based on its priority, after any waiting tasks
+ * of the same priority.
+ *
+ * @note Must be called with interrupts disabled.
+ *
+ * @param alloc Pointer to the pool struct.
+ */
+static void insert_waiting_task(pool_alloc_t *alloc)
+{
+	struct tcb **link = (struct tcb **) &alloc->first_waiting;
+
+	while (*link != NULL && (*link)->priority <= current_task->priority) {
+		link = &(*link)->wait_next;
+	}
+
+	current_task->wait_next = *link;
+	*link = current_task;
+}
+
+/**
+ * Removes the task from the list of tasks waiting for a block of alloc, if it's
+ * in there.
+ *
+ * @note Must be called with interrupts disabled.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param task  The task to be removed.
+ */
+static void remove_waiting_task(pool_alloc_t *alloc, struct tcb *task)
+{
+	struct tcb **link = (struct tcb **) &alloc->first_waiting;
+
+	while (*link != NULL) {
+		if (*link == task) {
+			*link = task->wait_next;
+			task->wait_next = NULL;
+
+			return;
+		}
+
+		link = &(*link)->wait_next;
+	}
+}
 
+/**
+ * Hands free blocks to the waiting tasks, for as long as there are both.
+ *
+ * @param alloc Pointer to the pool struct.
+ */
+static void serve_waiting_tasks(pool_alloc_t *alloc)
+{
 	CM_ATOMIC_CONTEXT();
 
-	alloc->block_size = block_size;
-	alloc->first_block = backing_mem;
+	while (alloc->first_waiting != NULL) {
+		void *block = os_pool_alloc_take(alloc);
 
-	uintptr_t *curr_block = backing_mem;
+		if (block == NULL) {
+			return;
+		}
 
-	for (uint32_t i = 0; i < num_blocks - 1; i++) {
+		struct tcb *task = alloc->first_waiting;
 
-		uintptr_t next = (uintptr_t) (((uint8_t *) curr_block) + block_size);
+		alloc->first_waiting = task->wait_next;
+		task->wait_next = NULL;
+		task->wait_result = block;
 
-		*curr_block = next;
-		curr_block = (uintptr_t *) next;
+		// The task may have been woken up by its timeout already, but
+		// not have run yet. It then picks up the block when it does.
+		if (task->state == TASK_WAITING_FOR_BLOCK) {
+			sched_remove_from_sleepqueue(task);
+			sched_wake_task(task);
+		}
 	}
+}
+
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/**
+ * Takes the first block from the list of free blocks.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @return Pointer to the block, or NULL if the list is empty.
+ */
+static inline void *pop_free_block(pool_alloc_t *alloc) {
+	void *ret;
+
+	do {
+		ret = atomic_load_exclusive_ptr(&alloc->first_block);
+
+		if (ret == NULL) {
+			atomic_clear_exclusive();
+			return NULL;
+		}
 
-	*curr_block = (uintptr_t) NULL;
+		// If an interrupt handler takes this block in the meantime, the
+		// store below fails and the loop starts over.
+	} while (!atomic_store_exclusive_ptr(&alloc->first_block,
+	                                     *(void **) ret));
+
+	return ret;
 }
 
-void *os_pool_alloc_take(pool_alloc_t *alloc) {
+/**
+ * Takes up to num consecutive blocks that have never been handed out.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param num   The maximum number of blocks to take.
+ * @param first Pointer to a location to store the address of the first block.
+ * @return The number of blocks taken.
+ */
+static inline uint32_t pop_unused_blocks(pool_alloc_t *alloc,
+                                         uint32_t num,
+                                         void **first) {
+	uint8_t *start;
+	uint8_t *end;
+	uint32_t count;
+
+	do {
+		start = atomic_load_exclusive_ptr(&alloc->next_unused);
+		end = start;
+
+		for (count = 0; count < num && end != alloc->unused_end;
+		     count++) {
+			end += alloc->block_size;
+		}
+
+		if (count == 0) {
+			atomic_clear_exclusive();
+			return 0;
+		}
+	} while (!atomic_store_exclusive_ptr(&alloc->next_unused, end));
+
+	*first = start;
+
+	return count;
+}
+
+/**
+ * Prepends a chain of linked blocks to the list of free blocks.
+ *
+ * @param alloc Pointer to the pool struct.
+ * @param first Pointer to the first block of the chain.
+ * @param last  Pointer to the last block of the chain.
+ */
+static inline void push_free_chain(pool_alloc_t *alloc,
+                                   void *first,
+                                   void *last) {
+	do {
+		*(void **) last = atomic_load_exclusive_ptr(&alloc->first_block);
+	} while (!atomic_store_exclusive_ptr(&alloc->first_block, first));
+}
+
+#elif defined(__ARM_ARCH_6M__)
+
+static inline void *pop_free_block(pool_alloc_t *alloc) {
 	CM_ATOMIC_CONTEXT();
 
 	uintptr_t *ret = alloc->first_block;
@@ -50,9 +271,388 @@ void *os_pool_alloc_take(pool_alloc_t *alloc) {
 	return ret;
 }
 
-void os_pool_alloc_give(pool_alloc_t *alloc, void *block) {
+static inline uint32_t pop_unused_blocks(pool_alloc_t *alloc,
+                                         uint32_t num,
+                                         void **first) {
+	CM_ATOMIC_CONTEXT();
+
+	uint8_t *end = alloc->next_unused;
+	uint32_t count;
+
+	for (count = 0; count < num && end != alloc->unused_end; count++) {
+		end += alloc->block_size;
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	*first = alloc->next_unused;
+	alloc->next_unused = end;
+
+	return count;
+}
+
+static inline void push_free_chain(pool_alloc_t *alloc,
+                                   void *first,
+                                   void *last) {
+	CM_ATOMIC_CONTEXT();
+
+	*((uintptr_t *) last) = (uintptr_t) alloc->first_block;
+	alloc->first_block = first;
+}
+
+#else
+
+static inline void *pop_free_block(pool_alloc_t *alloc) {
+	struct tagged_head *head = (struct tagged_head *) alloc;
+	struct tagged_head old_head;
+	struct tagged_head new_head;
+
+	__atomic_load(head, &old_head, __ATOMIC_ACQUIRE);
+
+	do {
+		if (old_head.block == NULL) {
+			return NULL;
+		}
+
+		// The block may have been taken (and written to) by another
+		// thread already, in which case the tag has changed, and the
+		// compare-and-swap fails.
+		new_head.block = __atomic_load_n((void **) old_head.block,
+		                                 __ATOMIC_RELAXED);
+		new_head.tag = old_head.tag + 1;
+	} while (!__atomic_compare_exchange(head, &old_head, &new_head, false,
+	                                    __ATOMIC_ACQ_REL,
+	                                    __ATOMIC_ACQUIRE));
+
+	return old_head.block;
+}
+
+static inline uint32_t pop_unused_blocks(pool_alloc_t *alloc,
+                                         uint32_t num,
+                                         void **first) {
+	uint8_t *start = __atomic_load_n(&alloc->next_unused, __ATOMIC_ACQUIRE);
+	uint8_t *end;
+	uint32_t count;
+
+	do {
+		end = start;
+
+		for (count = 0; count < num && end != alloc->unused_end;
+		     count++) {
+			end += alloc->block_size;
+		}
+
+		if (count == 0) {
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&alloc->next_unused,
+	                                      (void **) &start, end, false,
+	                                      __ATOMIC_ACQ_REL,
+	                                      __ATOMIC_ACQUIRE));
+
+	*first = start;
+
+	return count;
+}
+
+static inline void push_free_chain(pool_alloc_t *alloc,
+                                   void *first,
+                                   void *last) {
+	struct tagged_head *head = (struct tagged_head *) alloc;
+	struct tagged_head old_head;
+	struct tagged_head new_head;
+
+	__atomic_load(head, &old_head, __ATOMIC_ACQUIRE);
+
+	do {
+		__atomic_store_n((void **) last, old_head.block,
+		                 __ATOMIC_RELAXED);
+
+		new_head.block = first;
+		new_head.tag = old_head.tag + 1;
+	} while (!__atomic_compare_exchange(head, &old_head, &new_head, false,
+	                                    __ATOMIC_ACQ_REL,
+	                                    __ATOMIC_ACQUIRE));
+}
+
+#endif
+
+
+#if defined(__ARM_ARCH_6M__) || defined(__ARM_ARCH_7M__) || \
+    defined(__ARM_ARCH_7EM__)
+
+/**
+ * Takes up to num blocks from the list of free blocks.
+ *
+ * The list has to be walked to find the new head, and following the links of
+ * blocks that an interrupt handler could take (and overwrite) in the meantime
+ * isn't safe, so this always runs in a critical section, which lasts as long
+ * as num links take to follow. On ARMv7-M this still interoperates with the
+ * lock-free functions above, as disabling interrupts can only happen outside
+ * of (or clear) their exclusive accesses.
+ *
+ * @param alloc  Pointer to the pool struct.
+ * @param blocks Array to store the pointers to the taken blocks.
+ * @param num    The maximum number of blocks to take.
+ * @return The number of blocks taken.
+ */
+static inline uint32_t pop_free_blocks(pool_alloc_t *alloc,
+                                       void **blocks,
+                                       uint32_t num) {
 	CM_ATOMIC_CONTEXT();
 
-	*((uintptr_t *) block) = (uintptr_t) alloc->first_block;
+	void *block = alloc->first_block;
+	uint32_t count;
+
+	for (count = 0; count < num && block != NULL; count++) {
+		blocks[count] = block;
+		block = *(void **) block;
+	}
+
 	alloc->first_block = block;
+
+	return count;
+}
+
+#else
+
+static inline uint32_t pop_free_blocks(pool_alloc_t *alloc,
+                                       void **blocks,
+                                       uint32_t num) {
+	uint32_t count;
+
+	// Host builds have no critical sections to walk the list in, and
+	// there's no locking cost to save, so the blocks are taken one by one.
+	for (count = 0; count < num; count++) {
+		blocks[count] = pop_free_block(alloc);
+
+		if (blocks[count] == NULL) {
+			break;
+		}
+	}
+
+	return count;
+}
+
+#endif
+
+
+void os_pool_alloc_init(pool_alloc_t *alloc,
+                        void *backing_mem,
+                        uint32_t block_size,
+                        uint32_t num_blocks) {
+
+	cm3_assert(block_size >= sizeof(uintptr_t));
+
+	CM_ATOMIC_CONTEXT();
+
+	// The blocks aren't linked into the free list up front. Instead, they
+	// are handed out in order from next_unused once the free list is
+	// empty, which results in the same order as a fully linked list, but
+	// makes this function O(1).
+	alloc->block_size = block_size;
+	alloc->first_block = NULL;
+#if !defined(__ARM_ARCH_6M__) && !defined(__ARM_ARCH_7M__) && \
+    !defined(__ARM_ARCH_7EM__)
+	alloc->tag = 0;
+#endif
+	alloc->next_unused = backing_mem;
+	alloc->unused_end = (uint8_t *) backing_mem + block_size * num_blocks;
+	alloc->first_waiting = NULL;
+
+#ifdef POOL_STATS_ENABLE
+	alloc->num_blocks = num_blocks;
+	alloc->num_free = num_blocks;
+	alloc->min_free = num_blocks;
+	alloc->num_failures = 0;
+#endif
+}
+
+void *os_pool_alloc_take(pool_alloc_t *alloc) {
+	void *ret = pop_free_block(alloc);
+
+	if (ret == NULL && pop_unused_blocks(alloc, 1, &ret) == 0) {
+		stats_failed(alloc);
+
+		return NULL;
+	}
+
+	stats_taken(alloc, 1);
+
+	return ret;
+}
+
+void os_pool_alloc_give(pool_alloc_t *alloc, void *block) {
+	os_pool_alloc_give_chain(alloc, block, block, 1);
+}
+
+uint32_t os_pool_alloc_take_n(pool_alloc_t *alloc,
+                              void **blocks,
+                              uint32_t num) {
+	uint32_t count = 0;
+
+	// The blocks are taken in batches, so that on ARM no critical section
+	// walks more than OS_POOL_ALLOC_TAKE_BATCH links.
+	while (count < num) {
+		uint32_t batch = num - count;
+
+		if (batch > OS_POOL_ALLOC_TAKE_BATCH) {
+			batch = OS_POOL_ALLOC_TAKE_BATCH;
+		}
+
+		uint32_t taken = pop_free_blocks(alloc, &blocks[count], batch);
+
+		if (taken < batch) {
+			uint8_t *block;
+			uint32_t num_unused = pop_unused_blocks(alloc,
+			                                        batch - taken,
+			                                        (void **) &block);
+
+			for (uint32_t i = 0; i < num_unused; i++) {
+				blocks[count + taken++] = block;
+				block += alloc->block_size;
+			}
+		}
+
+		count += taken;
+
+		if (taken < batch) {
+			break;
+		}
+	}
+
+	if (count > 0) {
+		stats_taken(alloc, count);
+	}
+
+	if (count < num) {
+		stats_failed(alloc);
+	}
+
+	return count;
+}
+
+void os_pool_alloc_give_n(pool_alloc_t *alloc, void **blocks, uint32_t num) {
+	if (num == 0) {
+		return;
+	}
+
+	// Link the blocks into a chain outside of any critical section, so
+	// that it can be put into the list in one go.
+	for (uint32_t i = 0; i < num - 1; i++) {
+		*(void **) blocks[i] = blocks[i + 1];
+	}
+
+	os_pool_alloc_give_chain(alloc, blocks[0], blocks[num - 1], num);
+}
+
+void os_pool_alloc_give_chain(pool_alloc_t *alloc,
+                              void *first,
+                              void *last,
+                              uint32_t num) {
+	stats_giving(alloc, num);
+
+	push_free_chain(alloc, first, last);
+
+	if (alloc->first_waiting != NULL) {
+		serve_waiting_tasks(alloc);
+	}
+}
+
+void *os_pool_alloc_take_blocking(pool_alloc_t *alloc, uint32_t timeout_ticks) {
+	bool waited = false;
+
+	while (true) {
+		CM_ATOMIC_CONTEXT();
+
+		if (waited) {
+			void *block = current_task->wait_result;
+
+			if (block != NULL) {
+				current_task->wait_result = NULL;
+				return block;
+			}
+
+			// Woken up by the timeout.
+			remove_waiting_task(alloc, current_task);
+			sched_remove_from_sleepqueue(current_task);
+
+			return os_pool_alloc_take(alloc);
+		}
+
+		// A block given back after this check is handed over by
+		// os_pool_alloc_give(), which checks for waiting tasks after
+		// putting the block into the list.
+		void *block = os_pool_alloc_take(alloc);
+
+		if (block != NULL || timeout_ticks == 0) {
+			return block;
+		}
+
+		current_task->wait_result = NULL;
+		current_task->state = TASK_WAITING_FOR_BLOCK;
+
+		insert_waiting_task(alloc);
+
+		sched_trace_block(alloc);
+
+		if (timeout_ticks != OS_POOL_ALLOC_WAIT_FOREVER) {
+			current_task->wakeup_time = os_tick_count + timeout_ticks;
+			sched_add_to_sleepqueue(current_task);
+		}
+
+		waited = true;
+
+		os_task_yield();
+	}
+}
+
+void os_pool_alloc_get_stats(pool_alloc_t *alloc, pool_alloc_stats_t *stats) {
+#ifdef POOL_STATS_ENABLE
+	stats->capacity = alloc->num_blocks;
+	stats->num_free = atomic_load_u32(&alloc->num_free);
+	stats->min_free = atomic_load_u32(&alloc->min_free);
+	stats->num_failures = atomic_load_u32(&alloc->num_failures);
+	stats->max_used = stats->capacity - stats->min_free;
+#else
+	(void) alloc;
+
+	stats->capacity = 0;
+	stats->num_free = 0;
+	stats->min_free = 0;
+	stats->num_failures = 0;
+	stats->max_used = 0;
+#endif
+}
+
+void os_pool_alloc_reset_stats(pool_alloc_t *alloc) {
+#ifdef POOL_STATS_ENABLE
+	atomic_store_u32(&alloc->min_free, atomic_load_u32(&alloc->num_free));
+	atomic_store_u32(&alloc->num_failures, 0);
+#else
+	(void) alloc;
+#endif
+}
+
+void os_pool_alloc_report_stats(pool_alloc_t *alloc) {
+#if defined(DIAG_ENABLE) && defined(POOL_STATS_ENABLE)
+	pool_alloc_stats_t stats;
+
+	if (!OS_DIAG_ENABLED(POOL)) {
+		return;
+	}
+
+	os_pool_alloc_get_stats(alloc, &stats);
+
+	diag_pool_stats((uint32_t) alloc,
+	                alloc->block_size,
+	                stats.capacity,
+	                stats.num_free,
+	                stats.min_free,
+	                stats.num_failures);
+#else
+	(void) alloc;
+#endif
 }
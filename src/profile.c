@@ -0,0 +1,153 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of the sampling profiler.
+ */
+
+#include <stddef.h>  // For NULL
+#include <stdbool.h> // For bool.
+
+#include <libopencm3/cm3/cortex.h> // For CM_ATOMIC_BLOCK().
+
+#include <mouros/profile.h>  // Profiler function definitions.
+#include "profile_sample.h" // For profile_tick().
+#include "scheduler.h"      // For current_task.
+
+#ifdef DIAG_ENABLE
+#include "diag/diag.h" // For diag_profile_sample().
+#include <mouros/diag_mask.h> // For OS_DIAG_ENABLED().
+#endif
+
+
+#if (OS_PROFILE_RING_SIZE & (OS_PROFILE_RING_SIZE - 1)) != 0
+#error "OS_PROFILE_RING_SIZE must be a power of two."
+#endif
+
+/** Mask turning a free running position into an index into the ring. */
+#define RING_MASK (OS_PROFILE_RING_SIZE - 1)
+
+
+#ifdef PROFILE_ENABLE
+/** The samples. */
+static profile_sample_t ring[OS_PROFILE_RING_SIZE];
+
+/**
+ * The position after the last sample. The positions are free running, and are
+ * only masked when accessing the ring.
+ */
+static uint32_t write_pos = 0;
+/** The position of the oldest sample. */
+static uint32_t read_pos = 0;
+
+/** The number of ticks between samples, or 0 if sampling is stopped. */
+static uint32_t sample_period = 0;
+/** The number of ticks until the next sample. */
+static uint32_t countdown = 0;
+
+/** The number of samples taken. */
+static uint32_t num_samples = 0;
+/** The number of samples dropped. */
+static uint32_t num_dropped = 0;
+#endif
+
+
+#ifdef PROFILE_ENABLE
+void profile_tick(void)
+{
+	if (sample_period == 0 || --countdown != 0) {
+		return;
+	}
+
+	countdown = sample_period;
+
+	if (write_pos - read_pos == OS_PROFILE_RING_SIZE) {
+		num_dropped++;
+		return;
+	}
+
+	profile_sample_t *sample = &ring[write_pos & RING_MASK];
+
+	sample->pc = profile_stacked_pc(current_task);
+	sample->task_id = current_task->id;
+
+	write_pos++;
+	num_samples++;
+}
+#endif
+
+void os_profile_start(uint32_t period)
+{
+#ifdef PROFILE_ENABLE
+	CM_ATOMIC_BLOCK() {
+		sample_period = period;
+		countdown = period;
+	}
+#else
+	(void) period;
+#endif
+}
+
+void os_profile_stop(void)
+{
+	os_profile_start(0);
+}
+
+uint32_t os_profile_read(profile_sample_t *samples, uint32_t max_num)
+{
+#ifdef PROFILE_ENABLE
+	uint32_t num = 0;
+
+	while (num < max_num) {
+		bool empty = true;
+
+		// The SysTick handler adds samples, so they're removed one at a time
+		// with interrupts masked.
+		CM_ATOMIC_BLOCK() {
+			if (read_pos != write_pos) {
+				samples[num] = ring[read_pos & RING_MASK];
+				read_pos++;
+				empty = false;
+			}
+		}
+
+		if (empty) {
+			break;
+		}
+
+		num++;
+	}
+
+	return num;
+#else
+	(void) samples;
+	(void) max_num;
+
+	return 0;
+#endif
+}
+
+void os_profile_report(void)
+{
+#if defined(DIAG_ENABLE) && defined(PROFILE_ENABLE)
+	profile_sample_t sample;
+
+	while (OS_DIAG_ENABLED(PROFILE) && os_profile_read(&sample, 1) == 1) {
+		diag_profile_sample(sample.pc, sample.task_id);
+	}
+#endif
+}
+
+void os_profile_get_stats(profile_stats_t *stats)
+{
+#ifdef PROFILE_ENABLE
+	CM_ATOMIC_BLOCK() {
+		stats->num_samples = num_samples;
+		stats->num_dropped = num_dropped;
+		stats->num_pending = write_pos - read_pos;
+	}
+#else
+	stats->num_samples = 0;
+	stats->num_dropped = 0;
+	stats->num_pending = 0;
+#endif
+}
@@ -0,0 +1,47 @@
+/**
+ * @file
+ *
+ * This file contains internal declarations for the MourOS sampling profiler.
+ *
+ */
+
+#ifndef PROFILE_SAMPLE_H_
+#define PROFILE_SAMPLE_H_
+
+#include <stdint.h> // For uint32_t.
+
+#include <mouros/tasks.h> // For struct tcb.
+
+/**
+ * Returns the program counter stacked by the exception entry of a task whose
+ * context was just saved by SCHED_PUSH_STACK().
+ *
+ * @details The saved stack pointer points to R4-R11, preceded by D8-D15 if the
+ *          FPU context is active (bit 4 of exc_ret clear). They are followed by
+ *          the exception frame R0-R3, R12, LR, PC, xPSR.
+ *
+ * @param task The task.
+ * @return The stacked PC.
+ */
+static inline uint32_t profile_stacked_pc(const struct tcb *task)
+{
+	const int *frame = task->stack + 8;
+
+#if defined(__ARM_FP)
+	if ((task->exc_ret & 0x10) == 0) {
+		frame += 16;
+	}
+#endif
+
+	return (uint32_t) frame[6];
+}
+
+#ifdef PROFILE_ENABLE
+/**
+ * Takes a sample of the current task, if one is due. Called by the scheduler
+ * on every system tick, after the context of the current task was saved.
+ */
+void profile_tick(void);
+#endif
+
+#endif /* PROFILE_SAMPLE_H_ */
@@ -11,6 +11,11 @@
 #include <libopencm3/cm3/nvic.h> // nvic_* functions & defines
 
 #include "scheduler.h"
+#include "mailbox_notify.h"
+
+#ifdef PROFILE_ENABLE
+#include "profile_sample.h" // For profile_tick().
+#endif
 
 #include "diag/diag.h"
 
@@ -80,6 +85,24 @@ static struct tcb *take_highest_prio_task(void)
 	return NULL;
 }
 
+/**
+ * Makes the highest priority RUNNABLE task the current task, and logs the
+ * switch if the task changed.
+ */
+static void switch_to_next_task(void)
+{
+	struct tcb *prev_task = current_task;
+
+	current_task = take_highest_prio_task();
+	_impure_ptr = current_task->reent;
+
+	current_task->state = TASK_RUNNING;
+
+	if (current_task != prev_task) {
+		sched_trace_switch(prev_task, current_task);
+	}
+}
+
 /**
  * Searches the sleepqueue and moves any tasks, that should be woken up, into
  * the runqueue and sets their state to RUNNABLE.
@@ -99,6 +122,8 @@ static void wakeup_tasks(void)
 		sleeping->state = TASK_RUNNABLE;
 		sched_add_to_runqueue_head(sleeping);
 
+		sched_trace_wake(sleeping);
+
 		sleeping = sleepqueue_head;
 	}
 }
@@ -187,6 +212,20 @@ void sched_add_to_runqueue_tail(struct tcb *task)
 	task->next_task = NULL;
 }
 
+void sched_wake_task(struct tcb *task)
+{
+	task->next_task = NULL;
+	task->state = TASK_RUNNABLE;
+
+	sched_add_to_runqueue_head(task);
+
+	sched_trace_wake(task);
+
+	if (current_task->priority > task->priority) {
+		os_task_yield();
+	}
+}
+
 void sched_add_to_sleepqueue(struct tcb *task)
 {
 	struct tcb *sleeping = sleepqueue_head;
@@ -216,6 +255,22 @@ void sched_add_to_sleepqueue(struct tcb *task)
 	}
 }
 
+void sched_remove_from_sleepqueue(struct tcb *task)
+{
+	struct tcb **link = &sleepqueue_head;
+
+	while (*link != NULL) {
+		if (*link == task) {
+			*link = task->next_task;
+			task->next_task = NULL;
+
+			return;
+		}
+
+		link = &(*link)->next_task;
+	}
+}
+
 
 /**
  * Scheduling function that is run after a call to os_task_yield().
@@ -232,10 +287,7 @@ void pend_sv_handler(void)
 		sched_add_to_runqueue_tail(current_task);
 	}
 
-	current_task = take_highest_prio_task();
-	_impure_ptr = &current_task->reent;
-
-	current_task->state = TASK_RUNNING;
+	switch_to_next_task();
 
 	SCHED_POP_STACK_AND_BRANCH();
 }
@@ -250,16 +302,19 @@ void sys_tick_handler(void)
 
 	os_tick_count++;
 
+#ifdef PROFILE_ENABLE
+	profile_tick();
+#endif
+
 	wakeup_tasks();
 
+	mailbox_notify_tick();
+
 	sched_add_to_runqueue_tail(current_task);
 
 	current_task->state = TASK_RUNNABLE;
 
-	current_task = take_highest_prio_task();
-	_impure_ptr = &current_task->reent;
-
-	current_task->state = TASK_RUNNING;
+	switch_to_next_task();
 
 	SCHED_POP_STACK_AND_BRANCH();
 }
@@ -12,12 +12,28 @@
 
 #include <mouros/tasks.h>
 
+#ifdef DIAG_ENABLE
+#include "diag/diag.h" // For the task trace events.
+#include <mouros/diag_mask.h> // For OS_DIAG_ENABLED().
+#include <mouros/trace.h> // For os_trace_compact_event().
+#endif
+
 /**
  * The total number of priority levels implemented by MourOS. Tasks with higher
  * priority have a lower priority level number.
  */
 #define NUM_PRIO_LEVELS 16
 
+#if defined(DIAG_ENABLE) && defined(TRACE_TIMESTAMP_ENABLE)
+/**
+ * The indices of the scheduler events in diag_config.json, used when logging
+ * them as compact events.
+ */
+#define SCHED_EVENT_TASK_SWITCH 0
+#define SCHED_EVENT_TASK_BLOCK 23
+#define SCHED_EVENT_TASK_WAKE 24
+#endif
+
 /**
  * Pointer to the struct representing the task currently being executed.
  */
@@ -56,6 +72,17 @@ void sched_add_to_runqueue_head(struct tcb *task);
  */
 void sched_add_to_runqueue_tail(struct tcb *task);
 
+/**
+ * Makes a blocked task RUNNABLE again and adds it to the head of its runqueue.
+ * If the woken task has a higher priority than the current task, a call to the
+ * scheduler is requested.
+ *
+ * @note Must be called with interrupts disabled.
+ *
+ * @param task The task to be woken up.
+ */
+void sched_wake_task(struct tcb *task);
+
 /**
  * Adds task to the sleepqueue. Tasks in the sleepqueue will get woken up after
  * their wakeup_time has been exceeded by os_tick_count.
@@ -63,4 +90,101 @@ void sched_add_to_runqueue_tail(struct tcb *task);
  */
 void sched_add_to_sleepqueue(struct tcb *task);
 
+/**
+ * Removes task from the sleepqueue, if it's in there.
+ *
+ * @note Must be called with interrupts disabled.
+ *
+ * @param task The task to be removed.
+ */
+void sched_remove_from_sleepqueue(struct tcb *task);
+
+/**
+ * Logs a TASK_BLOCK event for the current task, which is about to block. Does
+ * nothing unless DIAG_ENABLE is defined and the SCHED category is enabled.
+ *
+ * @note Must be called after the waiting state of the task is set.
+ *
+ * @param object The object the task waits for (e.g. a mailbox). Can be NULL.
+ */
+static inline void sched_trace_block(const void *object)
+{
+#ifdef DIAG_ENABLE
+	if (!OS_DIAG_ENABLED(SCHED)) {
+		return;
+	}
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+	uint32_t args[] = {
+		current_task->id, current_task->state, (uint32_t) object
+	};
+
+	os_trace_compact_event(SCHED_EVENT_TASK_BLOCK, args, 3);
+#else
+	diag_task_block(os_tick_count, current_task->id,
+	                (uint8_t) current_task->state, (uint32_t) object);
+#endif
+#else
+	(void) object;
+#endif
+}
+
+/**
+ * Logs a TASK_WAKE event for task, which was just made RUNNABLE. The event
+ * holds the number of the active exception, so wakeups from interrupt handlers
+ * can be told apart from wakeups by other tasks (exception 0). Does nothing
+ * unless DIAG_ENABLE is defined and the SCHED category is enabled.
+ *
+ * @param task The woken task.
+ */
+static inline void sched_trace_wake(struct tcb *task)
+{
+#ifdef DIAG_ENABLE
+	if (!OS_DIAG_ENABLED(SCHED)) {
+		return;
+	}
+
+	uint32_t ipsr;
+
+	asm volatile ("mrs %[ipsr], ipsr" : [ipsr] "=r" (ipsr));
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+	uint32_t args[] = { task->id, ipsr & 0x1ff };
+
+	os_trace_compact_event(SCHED_EVENT_TASK_WAKE, args, 2);
+#else
+	diag_task_wake(os_tick_count, task->id, (uint16_t) (ipsr & 0x1ff));
+#endif
+#else
+	(void) task;
+#endif
+}
+
+/**
+ * Logs a TASK_SWITCH event. Does nothing unless DIAG_ENABLE is defined and the
+ * SCHED category is enabled.
+ *
+ * @param prev The task switched out.
+ * @param next The task switched in.
+ */
+static inline void sched_trace_switch(struct tcb *prev, struct tcb *next)
+{
+#ifdef DIAG_ENABLE
+	if (!OS_DIAG_ENABLED(SCHED)) {
+		return;
+	}
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+	uint32_t args[] = { prev->id, next->id };
+
+	os_trace_compact_event(SCHED_EVENT_TASK_SWITCH, args, 2);
+#else
+	diag_task_switch(os_tick_count, prev->id, next->id);
+#endif
+#else
+	(void) prev;
+	(void) next;
+#endif
+}
+
 #endif /* SCHEDULER_H_ */
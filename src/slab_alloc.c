@@ -0,0 +1,284 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of a slab allocator.
+ */
+
+#include <stddef.h> // For NULL
+#include <string.h> // For memcpy(), memset()
+
+#include <libopencm3/cm3/assert.h> // For assert().
+
+#include <mouros/slab_alloc.h> // Slab alloc function definitions.
+
+#ifdef SLAB_MALLOC_ENABLE
+#include <reent.h> // For the malloc reentrancy functions.
+#include <errno.h> // For ENOMEM.
+#endif
+
+
+#ifdef SLAB_MALLOC_ENABLE
+slab_alloc_t os_malloc_slab;
+#endif
+
+
+/**
+ * Returns the index of the smallest size class with blocks of at least size
+ * bytes.
+ *
+ * @param size The requested size.
+ * @return The class index. Greater or equal to OS_SLAB_NUM_CLASSES if no class
+ *         is large enough.
+ */
+static inline uint32_t get_class_index(uint32_t size)
+{
+	if (size <= (1u << OS_SLAB_MIN_BLOCK_SHIFT)) {
+		return 0;
+	}
+
+	// The binary logarithm of size, rounded up.
+	return 32 - (uint32_t) __builtin_clz(size - 1) - OS_SLAB_MIN_BLOCK_SHIFT;
+}
+
+/**
+ * Returns the size class the block belongs to.
+ *
+ * @param slab Pointer to the slab allocator struct.
+ * @param ptr  Pointer to the block.
+ * @return Pointer to the class, or NULL if the block isn't from any class.
+ */
+static inline struct slab_class *find_class(slab_alloc_t *slab, void *ptr)
+{
+	for (uint32_t i = 0; i < OS_SLAB_NUM_CLASSES; i++) {
+		struct slab_class *class = &slab->classes[i];
+
+		if ((uint8_t *) ptr >= class->mem_start &&
+		    (uint8_t *) ptr < class->mem_end) {
+			return class;
+		}
+	}
+
+	return NULL;
+}
+
+
+void os_slab_alloc_init(slab_alloc_t *slab)
+{
+	for (uint32_t i = 0; i < OS_SLAB_NUM_CLASSES; i++) {
+		slab->classes[i].pool.first_block = NULL;
+		slab->classes[i].pool.block_size = 0;
+		slab->classes[i].mem_start = NULL;
+		slab->classes[i].mem_end = NULL;
+	}
+
+	slab->fallback_alloc = NULL;
+	slab->fallback_free = NULL;
+	slab->fallback_realloc = NULL;
+}
+
+void os_slab_alloc_add_class(slab_alloc_t *slab,
+                             void *mem,
+                             uint32_t block_size,
+                             uint32_t num_blocks)
+{
+	cm3_assert((block_size & (block_size - 1)) == 0);
+	cm3_assert(num_blocks > 0);
+
+	uint32_t index = get_class_index(block_size);
+
+	cm3_assert(block_size >= (1u << OS_SLAB_MIN_BLOCK_SHIFT));
+	cm3_assert(index < OS_SLAB_NUM_CLASSES);
+
+	struct slab_class *class = &slab->classes[index];
+
+	cm3_assert(class->mem_start == NULL);
+
+	os_pool_alloc_init(&class->pool, mem, block_size, num_blocks);
+
+	class->mem_start = mem;
+	class->mem_end = (uint8_t *) mem + block_size * num_blocks;
+}
+
+void os_slab_alloc_set_fallback(slab_alloc_t *slab,
+                                void *(*alloc_func)(uint32_t size),
+                                void (*free_func)(void *ptr),
+                                void *(*realloc_func)(void *ptr,
+                                                      uint32_t size))
+{
+	slab->fallback_alloc = alloc_func;
+	slab->fallback_free = free_func;
+	slab->fallback_realloc = realloc_func;
+}
+
+void *os_slab_alloc_take(slab_alloc_t *slab, uint32_t size)
+{
+	// If the best fitting class is exhausted, try the larger ones.
+	for (uint32_t i = get_class_index(size); i < OS_SLAB_NUM_CLASSES; i++) {
+		if (slab->classes[i].mem_start == NULL) {
+			continue;
+		}
+
+		void *block = os_pool_alloc_take(&slab->classes[i].pool);
+
+		if (block != NULL) {
+			return block;
+		}
+	}
+
+	if (slab->fallback_alloc != NULL) {
+		return slab->fallback_alloc(size);
+	}
+
+	return NULL;
+}
+
+void os_slab_alloc_give(slab_alloc_t *slab, void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+
+	struct slab_class *class = find_class(slab, ptr);
+
+	if (class != NULL) {
+		os_pool_alloc_give(&class->pool, ptr);
+	} else {
+		cm3_assert(slab->fallback_free != NULL);
+
+		slab->fallback_free(ptr);
+	}
+}
+
+void *os_slab_alloc_realloc(slab_alloc_t *slab, void *ptr, uint32_t size)
+{
+	if (ptr == NULL) {
+		return os_slab_alloc_take(slab, size);
+	}
+
+	if (size == 0) {
+		os_slab_alloc_give(slab, ptr);
+		return NULL;
+	}
+
+	struct slab_class *class = find_class(slab, ptr);
+
+	if (class == NULL) {
+		if (slab->fallback_realloc != NULL) {
+			return slab->fallback_realloc(ptr, size);
+		}
+
+		return NULL;
+	}
+
+	uint32_t block_size = class->pool.block_size;
+
+	if (size <= block_size) {
+		return ptr;
+	}
+
+	void *new_block = os_slab_alloc_take(slab, size);
+
+	if (new_block != NULL) {
+		memcpy(new_block, ptr, block_size);
+		os_pool_alloc_give(&class->pool, ptr);
+	}
+
+	return new_block;
+}
+
+uint32_t os_slab_alloc_block_size(slab_alloc_t *slab, void *ptr)
+{
+	struct slab_class *class = find_class(slab, ptr);
+
+	if (class == NULL) {
+		return 0;
+	}
+
+	return class->pool.block_size;
+}
+
+
+#ifdef SLAB_MALLOC_ENABLE
+
+/**
+ * Allocates memory from os_malloc_slab. Replaces the newlib implementation used
+ * by malloc().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param size  The requested size.
+ * @return Pointer to the allocated memory, or NULL on error.
+ */
+void *_malloc_r(struct _reent *reent, size_t size)
+{
+	void *ptr = os_slab_alloc_take(&os_malloc_slab, (uint32_t) size);
+
+	if (ptr == NULL) {
+		reent->_errno = ENOMEM;
+	}
+
+	return ptr;
+}
+
+/**
+ * Frees memory allocated from os_malloc_slab. Replaces the newlib
+ * implementation used by free().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param ptr   Pointer to the memory to be freed.
+ */
+void _free_r(struct _reent *reent, void *ptr)
+{
+	(void) reent;
+
+	os_slab_alloc_give(&os_malloc_slab, ptr);
+}
+
+/**
+ * Resizes memory allocated from os_malloc_slab. Replaces the newlib
+ * implementation used by realloc().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param ptr   Pointer to the memory to be resized.
+ * @param size  The requested size.
+ * @return Pointer to the resized memory, or NULL on error.
+ */
+void *_realloc_r(struct _reent *reent, void *ptr, size_t size)
+{
+	void *new_ptr = os_slab_alloc_realloc(&os_malloc_slab, ptr,
+	                                      (uint32_t) size);
+
+	if (new_ptr == NULL && size != 0) {
+		reent->_errno = ENOMEM;
+	}
+
+	return new_ptr;
+}
+
+/**
+ * Allocates zeroed memory for an array from os_malloc_slab. Replaces the newlib
+ * implementation used by calloc().
+ *
+ * @param reent    Pointer to the reentrancy structure.
+ * @param num      The number of array elements.
+ * @param elm_size The size of a single element.
+ * @return Pointer to the allocated memory, or NULL on error.
+ */
+void *_calloc_r(struct _reent *reent, size_t num, size_t elm_size)
+{
+	size_t size = num * elm_size;
+
+	if (elm_size != 0 && size / elm_size != num) {
+		reent->_errno = ENOMEM;
+		return NULL;
+	}
+
+	void *ptr = _malloc_r(reent, size);
+
+	if (ptr != NULL) {
+		memset(ptr, 0, size);
+	}
+
+	return ptr;
+}
+
+#endif
@@ -5,12 +5,20 @@
  *
  */
 
+#include <stddef.h> // For NULL
+
 #include <libopencm3/cm3/cortex.h> // CM_ATOMIC_*
 
 #include <mouros/sync.h> // Function and struct declarations.
 #include "scheduler.h"   // current_task & sched_add_to_runqueue_head
 
 
+#ifdef RESOURCE_STATS_ENABLE
+/** The list of the resources acquired since the start, newest first. */
+static resource_t *stats_list = NULL;
+#endif
+
+
 /**
  * Adds the current task to the linked list of task waiting for res to be
  * available. The task is inserted into the list based on its priority. A higher
@@ -50,26 +58,166 @@ static void insert_waiting_task(struct resource *res) {
 }
 
 
+#if defined(DIAG_ENABLE) && defined(RESOURCE_STATS_ENABLE)
+/**
+ * Converts a number of os_get_timestamp() steps to microseconds, saturating at
+ * UINT32_MAX.
+ *
+ * @param steps The number of steps.
+ * @return The number of microseconds, or 0 if the scheduling hasn't started.
+ */
+static uint32_t steps_to_us(uint64_t steps)
+{
+	uint32_t freq = os_get_timestamp_freq();
+
+	if (freq == 0) {
+		return 0;
+	}
+
+	uint64_t us = steps * 1000000 / freq;
+
+	return us > UINT32_MAX ? UINT32_MAX : (uint32_t) us;
+}
+#endif
+
+#ifdef RESOURCE_STATS_ENABLE
+/**
+ * Adds res to the front of the list of profiled resources.
+ *
+ * @param res The resource.
+ */
+static void stats_register(resource_t *res)
+{
+	CM_ATOMIC_CONTEXT();
+
+	res->stats_next = stats_list;
+	res->stats_listed = true;
+	stats_list = res;
+}
+
+/**
+ * Updates the statistics of res, just acquired by the current task. Only the
+ * owner of a resource updates its statistics, so the owner serializes the
+ * updates.
+ *
+ * @param res        The resource.
+ * @param wait_start The time the current task started waiting for res.
+ * @param owner      The task owning res when the current task started waiting,
+ *                   or NULL if the current task didn't wait.
+ */
+static void stats_acquired(resource_t *res,
+                           uint64_t wait_start,
+                           struct tcb *owner)
+{
+	uint64_t now = os_get_timestamp();
+
+	if (!res->stats_listed) {
+		stats_register(res);
+	}
+
+	res->num_acquires++;
+	res->acquired_at = now;
+
+	if (owner == NULL) {
+		return;
+	}
+
+	uint64_t wait = now - wait_start;
+
+	res->num_contended++;
+	res->total_wait += wait;
+
+	if (wait > res->max_wait) {
+		res->max_wait = wait > UINT32_MAX ? UINT32_MAX : (uint32_t) wait;
+	}
+
+#ifdef DIAG_ENABLE
+	if (!OS_DIAG_ENABLED(SYNC)) {
+		return;
+	}
+
+	uint32_t wait_us = steps_to_us(wait);
+
+	if (wait_us >= OS_RESOURCE_LONG_WAIT_US) {
+		diag_resource_wait(os_tick_count, (uint32_t) res, current_task->id,
+		                   owner->id, wait_us);
+	}
+#endif
+}
+
+/**
+ * Updates the hold time statistics of res, about to be released by the
+ * current task.
+ *
+ * @param res The resource.
+ */
+static void stats_released(resource_t *res)
+{
+	uint64_t hold = os_get_timestamp() - res->acquired_at;
+
+	res->total_hold += hold;
+
+	if (hold > res->max_hold) {
+		res->max_hold = hold > UINT32_MAX ? UINT32_MAX : (uint32_t) hold;
+	}
+}
+
+/**
+ * Returns true if the statistics a should be listed before the statistics b:
+ * more contended acquisitions first, and then longer total waits first.
+ */
+static bool stats_more_contended(const resource_stats_t *a,
+                                 const resource_stats_t *b)
+{
+	if (a->num_contended != b->num_contended) {
+		return a->num_contended > b->num_contended;
+	}
+
+	return a->total_wait > b->total_wait;
+}
+#endif
+
+
 void os_resource_acquire(resource_t *res)
 {
+#ifdef RESOURCE_STATS_ENABLE
+	uint64_t wait_start = 0;
+	struct tcb *owner = NULL;
+#endif
+
 	while (true) {
 		CM_ATOMIC_CONTEXT();
 
 		if (res->acquired_by == NULL) {
 			res->acquired_by = current_task;
-			return;
+			break;
 
 		} else if (res->acquired_by == current_task) {
 			return;
 
 		} else {
+#ifdef RESOURCE_STATS_ENABLE
+			if (owner == NULL) {
+				wait_start = os_get_timestamp();
+				owner = res->acquired_by;
+			}
+#endif
+
 			current_task->state = TASK_WAITING_FOR_RESOURCE;
 
 			insert_waiting_task(res);
 
+			sched_trace_block(res);
+
 			os_task_yield();
 		}
 	}
+
+	// The statistics are updated with interrupts enabled, so a long wait
+	// event doesn't hold them off while it's sent.
+#ifdef RESOURCE_STATS_ENABLE
+	stats_acquired(res, wait_start, owner);
+#endif
 }
 
 void os_resource_release(resource_t *res)
@@ -80,6 +228,10 @@ void os_resource_release(resource_t *res)
 		return;
 	}
 
+#ifdef RESOURCE_STATS_ENABLE
+	stats_released(res);
+#endif
+
 	res->acquired_by = NULL;
 
 	struct tcb *first = res->first_waiting;
@@ -92,6 +244,8 @@ void os_resource_release(resource_t *res)
 
 		sched_add_to_runqueue_head(first);
 
+		sched_trace_wake(first);
+
 		if (current_task->priority > first->priority) {
 			os_task_yield();
 		}
@@ -99,3 +253,117 @@ void os_resource_release(resource_t *res)
 	}
 }
 
+void os_resource_get_stats(resource_t *res, resource_stats_t *stats)
+{
+	stats->resource = res;
+
+#ifdef RESOURCE_STATS_ENABLE
+	CM_ATOMIC_BLOCK() {
+		stats->num_acquires = res->num_acquires;
+		stats->num_contended = res->num_contended;
+		stats->total_wait = res->total_wait;
+		stats->total_hold = res->total_hold;
+		stats->max_wait = res->max_wait;
+		stats->max_hold = res->max_hold;
+	}
+#else
+	stats->num_acquires = 0;
+	stats->num_contended = 0;
+	stats->total_wait = 0;
+	stats->total_hold = 0;
+	stats->max_wait = 0;
+	stats->max_hold = 0;
+#endif
+}
+
+void os_resource_reset_stats(resource_t *res)
+{
+#ifdef RESOURCE_STATS_ENABLE
+	CM_ATOMIC_BLOCK() {
+		res->num_acquires = 0;
+		res->num_contended = 0;
+		res->total_wait = 0;
+		res->total_hold = 0;
+		res->max_wait = 0;
+		res->max_hold = 0;
+	}
+#else
+	(void) res;
+#endif
+}
+
+uint32_t os_resource_get_top_contended(resource_stats_t *stats,
+                                       uint32_t max_num)
+{
+#ifdef RESOURCE_STATS_ENABLE
+	uint32_t num = 0;
+
+	// Resources are only ever pushed to the front of the list, so it can be
+	// walked without masking interrupts for the whole walk.
+	for (resource_t *res = stats_list; res != NULL; res = res->stats_next) {
+		resource_stats_t cur;
+
+		os_resource_get_stats(res, &cur);
+
+		if (cur.num_contended == 0) {
+			continue;
+		}
+
+		// Insertion sort into the array, dropping the least contended
+		// entry if it's full.
+		uint32_t pos = num;
+
+		while (pos > 0 && stats_more_contended(&cur, &stats[pos - 1])) {
+			if (pos < max_num) {
+				stats[pos] = stats[pos - 1];
+			}
+
+			pos--;
+		}
+
+		if (pos < max_num) {
+			stats[pos] = cur;
+
+			if (num < max_num) {
+				num++;
+			}
+		}
+	}
+
+	return num;
+#else
+	(void) stats;
+	(void) max_num;
+
+	return 0;
+#endif
+}
+
+void os_resource_report_top_contended(uint32_t num)
+{
+#if defined(DIAG_ENABLE) && defined(RESOURCE_STATS_ENABLE)
+	resource_stats_t stats[OS_RESOURCE_REPORT_MAX];
+
+	if (!OS_DIAG_ENABLED(SYNC)) {
+		return;
+	}
+
+	if (num > OS_RESOURCE_REPORT_MAX) {
+		num = OS_RESOURCE_REPORT_MAX;
+	}
+
+	num = os_resource_get_top_contended(stats, num);
+
+	for (uint32_t i = 0; i < num; i++) {
+		diag_resource_stats((uint32_t) stats[i].resource,
+		                    stats[i].num_acquires,
+		                    stats[i].num_contended,
+		                    steps_to_us(stats[i].total_wait),
+		                    steps_to_us(stats[i].max_wait),
+		                    steps_to_us(stats[i].total_hold),
+		                    steps_to_us(stats[i].max_hold));
+	}
+#else
+	(void) num;
+#endif
+}
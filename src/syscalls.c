@@ -5,12 +5,19 @@
  *
  */
 
-#include <reent.h> // Function declarations & reent structure.
-#include <errno.h> // Error codes.
+#include <reent.h>    // Function declarations & reent structure.
+#include <errno.h>    // Error codes.
+#include <sys/stat.h> // For struct stat.
+#include <string.h>   // For memset().
+
+#include <mouros/fd.h>        // For the file descriptor table.
+#include <mouros/sync.h>      // For the malloc lock.
+#include <mouros/diag_mask.h> // For OS_DIAG_ENABLED().
 
 #include <libopencm3/cm3/cortex.h> // For the atomic macros.
 
 #include "diag/diag.h" // For the diag log functions.
+#include "scheduler.h" // For current_task.
 
 /** Minimal implementation of environment variables. */
 char *__env[1] = { 0 };
@@ -28,6 +35,21 @@ extern char end;
  */
 static char *heap_end = &end;
 
+#if !defined(SLAB_MALLOC_ENABLE) && !defined(TLSF_MALLOC_ENABLE)
+/**
+ * The lock serializing the newlib malloc() & co.
+ */
+static resource_t malloc_lock;
+
+/**
+ * The number of nested __malloc_lock() calls of the task holding malloc_lock.
+ */
+static uint32_t malloc_lock_depth = 0;
+
+void __malloc_lock(struct _reent *reent);
+void __malloc_unlock(struct _reent *reent);
+#endif
+
 void _exit(int status);
 
 
@@ -46,10 +68,8 @@ void _exit(int status)
 }
 
 /**
- * Closes the file identified by filedes.
- *
- * @note Since files aren't implemented yet, this function does nothing and
- *       always fails.
+ * Closes the file identified by filedes. Removes the mapping of filedes from
+ * the file descriptor table.
  *
  * @param reent   Pointer to the reentrancy structure.
  * @param filedes File descriptor of the file to be closed.
@@ -57,10 +77,16 @@ void _exit(int status)
  */
 int _close_r(struct _reent *reent, int filedes)
 {
-	diag_syscall_close(filedes);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_close(filedes);
+	}
 
-	reent->_errno = EBADF;
-	return -1;
+	if (!os_fd_close(filedes)) {
+		reent->_errno = EBADF;
+		return -1;
+	}
+
+	return 0;
 }
 
 /**
@@ -80,9 +106,11 @@ int _execve_r(struct _reent *reent,
               char * const *argv,
               char * const *envp)
 {
-	diag_syscall_execve((uint32_t) path,
-	                    (uint32_t) argv,
-	                    (uint32_t) envp);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_execve((uint32_t) path,
+		                    (uint32_t) argv,
+		                    (uint32_t) envp);
+	}
 
 	reent->_errno = EBADF;
 	return -1;
@@ -102,7 +130,9 @@ int _execve_r(struct _reent *reent,
  */
 int _fcntl_r(struct _reent *reent, int filedes, int cmd, int arg)
 {
-	diag_syscall_fcntl(filedes, cmd, arg);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_fcntl(filedes, cmd, arg);
+	}
 
 	reent->_errno = EBADF;
 	return -1;
@@ -120,17 +150,17 @@ int _fcntl_r(struct _reent *reent, int filedes, int cmd, int arg)
  */
 int _fork_r(struct _reent *reent)
 {
-	diag_syscall_fork();
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_fork();
+	}
 
 	reent->_errno = ENOSYS;
 	return -1;
 }
 
 /**
- * Gets information about file. Fills the struct pointed to by buf.
- *
- * @note Since files aren't implemented yet, this function does nothing and
- *       always fails.
+ * Gets information about file. Fills the struct pointed to by buf. All the
+ * descriptors in the file descriptor table are character devices.
  *
  * @param reent   Pointer to the reentrancy structure.
  * @param filedes File descriptor of the file.
@@ -139,10 +169,20 @@ int _fork_r(struct _reent *reent)
  */
 int _fstat_r(struct _reent *reent, int filedes, struct stat *buf)
 {
-	diag_syscall_fstat(filedes, (uint32_t) buf);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_fstat(filedes, (uint32_t) buf);
+	}
 
-	reent->_errno = EBADF;
-	return -1;
+	if (!os_fd_is_open(filedes)) {
+		reent->_errno = EBADF;
+		return -1;
+	}
+
+	memset(buf, 0, sizeof(*buf));
+
+	buf->st_mode = S_IFCHR;
+
+	return 0;
 }
 
 /**
@@ -156,15 +196,17 @@ int _getpid_r(struct _reent *reent)
 {
 	(void) reent;
 
-	diag_syscall_getpid();
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_getpid();
+	}
 
 	return 1;
 }
 
 /**
- * Checks if the file descriptor refers to a terminal.
- *
- * @note Currently always returns 1.
+ * Checks if the file descriptor refers to a terminal. All the descriptors in
+ * the file descriptor table are treated as terminals, so that newlib line
+ * buffers them.
  *
  * @param reent   Pointer to the reentrancy structure.
  * @param filedes The file descriptor to be checked.
@@ -172,9 +214,15 @@ int _getpid_r(struct _reent *reent)
  */
 int _isatty_r(struct _reent *reent, int filedes)
 {
-	diag_syscall_isatty(filedes);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_isatty(filedes);
+	}
+
+	if (!os_fd_is_open(filedes)) {
+		reent->_errno = EBADF;
+		return 0;
+	}
 
-	reent->_errno = EBADF;
 	return 1;
 }
 
@@ -190,7 +238,9 @@ int _isatty_r(struct _reent *reent, int filedes)
  */
 int _kill_r(struct _reent *reent, int pid, int sig)
 {
-	diag_syscall_kill(pid, sig);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_kill(pid, sig);
+	}
 
 	reent->_errno = ESRCH;
 	return -1;
@@ -208,7 +258,9 @@ int _kill_r(struct _reent *reent, int pid, int sig)
  */
 int _link_r(struct _reent *reent, const char *oldpath, const char *newpath)
 {
-	diag_syscall_link((uint32_t ) oldpath, (uint32_t ) newpath);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_link((uint32_t ) oldpath, (uint32_t ) newpath);
+	}
 
 	reent->_errno = EBADF;
 	return -1;
@@ -227,7 +279,9 @@ int _link_r(struct _reent *reent, const char *oldpath, const char *newpath)
  */
 _off_t _lseek_r(struct _reent *reent, int filedes, _off_t offset, int whence)
 {
-	diag_syscall_lseek(filedes, offset, whence);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_lseek(filedes, offset, whence);
+	}
 
 	reent->_errno = EBADF;
 	return (_off_t) -1;
@@ -243,7 +297,9 @@ _off_t _lseek_r(struct _reent *reent, int filedes, _off_t offset, int whence)
  */
 int _mkdir_r(struct _reent *reent, const char *pathname, int mode)
 {
-	diag_syscall_mkdir((uint32_t) pathname, mode);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_mkdir((uint32_t) pathname, mode);
+	}
 
 	reent->_errno = EPERM;
 	return -1;
@@ -260,14 +316,17 @@ int _mkdir_r(struct _reent *reent, const char *pathname, int mode)
  */
 int _open_r(struct _reent *reent, const char *pathname, int flags, int mode)
 {
-	diag_syscall_open((uint32_t) pathname, flags, mode);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_open((uint32_t) pathname, flags, mode);
+	}
 
 	reent->_errno = EACCES;
 	return -1;
 }
 
 /**
- * Reads up to count bytes from the provided file descriptor.
+ * Reads up to count bytes from the provided file descriptor. See
+ * os_fd_read().
  *
  * @param reent   The reentrancy structure.
  * @param filedes The file descriptor.
@@ -277,10 +336,18 @@ int _open_r(struct _reent *reent, const char *pathname, int flags, int mode)
  */
 _ssize_t _read_r(struct _reent *reent, int filedes, void *buf, size_t count)
 {
-	diag_syscall_read(filedes, (uint32_t) buf, count);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_read(filedes, (uint32_t) buf, count);
+	}
 
-	reent->_errno = EBADF;
-	return -1;
+	int32_t ret = os_fd_read(filedes, buf, (uint32_t) count);
+
+	if (ret < 0) {
+		reent->_errno = -ret;
+		return -1;
+	}
+
+	return ret;
 }
 
 /**
@@ -293,7 +360,9 @@ _ssize_t _read_r(struct _reent *reent, int filedes, void *buf, size_t count)
  */
 int _rename_r(struct _reent *reent, const char *oldpath, const char *newpath)
 {
-	diag_syscall_rename((uint32_t) oldpath, (uint32_t) newpath);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_rename((uint32_t) oldpath, (uint32_t) newpath);
+	}
 
 	reent->_errno = EBADF;
 	return -1;
@@ -302,6 +371,9 @@ int _rename_r(struct _reent *reent, const char *oldpath, const char *newpath)
 /**
  * Changes the data segment size.
  *
+ * @note If TLSF_MALLOC_ENABLE is defined, the memory above the data segment
+ *       belongs to os_malloc_tlsf, and this always fails.
+ *
  * @param reent     The reentrancy structure.
  * @param increment The number of bytes to increase/decrease the data segment
  *                  by.
@@ -309,8 +381,16 @@ int _rename_r(struct _reent *reent, const char *oldpath, const char *newpath)
  */
 void *_sbrk_r(struct _reent *reent, ptrdiff_t increment)
 {
-	diag_syscall_sbrk((uint32_t) &end, (uint32_t) heap_end, increment);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_sbrk((uint32_t) &end, (uint32_t) heap_end, increment);
+	}
+
+#ifdef TLSF_MALLOC_ENABLE
+	(void) increment;
 
+	reent->_errno = ENOMEM;
+	return (void *) -1;
+#else
 	CM_ATOMIC_CONTEXT();
 
 	char *main_stack_pointer = 0;
@@ -329,8 +409,54 @@ void *_sbrk_r(struct _reent *reent, ptrdiff_t increment)
 	heap_end += increment;
 
 	return (void *) prev_heap_end;
+#endif
+}
+
+#if !defined(SLAB_MALLOC_ENABLE) && !defined(TLSF_MALLOC_ENABLE)
+
+/**
+ * Serializes the newlib malloc() & co. between tasks. Called by newlib before
+ * touching the heap. The lock is recursive, as newlib may nest the calls.
+ *
+ * @note malloc() must not be called from interrupt handlers.
+ *
+ * @param reent The reentrancy structure.
+ */
+void __malloc_lock(struct _reent *reent)
+{
+	(void) reent;
+
+	// Before the scheduler is started, there's nothing to serialize
+	// against.
+	if (current_task == NULL) {
+		return;
+	}
+
+	os_resource_acquire(&malloc_lock);
+
+	malloc_lock_depth++;
 }
 
+/**
+ * Releases the lock taken by __malloc_lock().
+ *
+ * @param reent The reentrancy structure.
+ */
+void __malloc_unlock(struct _reent *reent)
+{
+	(void) reent;
+
+	if (current_task == NULL || malloc_lock_depth == 0) {
+		return;
+	}
+
+	if (--malloc_lock_depth == 0) {
+		os_resource_release(&malloc_lock);
+	}
+}
+
+#endif
+
 /**
  * Gets the file status.
  *
@@ -341,7 +467,9 @@ void *_sbrk_r(struct _reent *reent, ptrdiff_t increment)
  */
 int _stat_r(struct _reent *reent, const char *pathname, struct stat *buf)
 {
-	diag_syscall_stat((uint32_t) pathname, (uint32_t) buf);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_stat((uint32_t) pathname, (uint32_t) buf);
+	}
 
 	reent->_errno = EBADF;
 	return -1;
@@ -356,7 +484,9 @@ int _stat_r(struct _reent *reent, const char *pathname, struct stat *buf)
  */
 _CLOCK_T_ _times_r(struct _reent *reent, struct tms *buf)
 {
-	diag_syscall_times((uint32_t) buf);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_times((uint32_t) buf);
+	}
 
 	reent->_errno = ENOSYS;
 	return (_CLOCK_T_) -1;
@@ -371,7 +501,9 @@ _CLOCK_T_ _times_r(struct _reent *reent, struct tms *buf)
  */
 int _unlink_r(struct _reent *reent, const char *pathname)
 {
-	diag_syscall_unlink((uint32_t) pathname);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_unlink((uint32_t) pathname);
+	}
 
 	reent->_errno = ENOENT;
 	return -1;
@@ -387,14 +519,16 @@ int _unlink_r(struct _reent *reent, const char *pathname)
  */
 int _wait_r(struct _reent *reent, int *status)
 {
-	diag_syscall_wait((uint32_t) status);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_wait((uint32_t) status);
+	}
 
 	reent->_errno = ECHILD;
 	return -1;
 }
 
 /**
- * Writes to the supplied file descriptor.
+ * Writes to the supplied file descriptor. See os_fd_write().
  *
  * @param reent   The reentrancy structure.
  * @param filedes The file descriptor to be written to.
@@ -408,9 +542,17 @@ _ssize_t _write_r(struct _reent *reent,
                   const void *buf,
                   size_t count)
 {
-	diag_syscall_write(filedes, (uint32_t) buf, count);
+	if (OS_DIAG_ENABLED(SYSCALL)) {
+		diag_syscall_write(filedes, (uint32_t) buf, count);
+	}
 
-	reent->_errno = EBADF;
-	return -1;
+	int32_t ret = os_fd_write(filedes, buf, (uint32_t) count);
+
+	if (ret < 0) {
+		reent->_errno = -ret;
+		return -1;
+	}
+
+	return ret;
 }
 
@@ -0,0 +1,83 @@
+/**
+ * @file
+ *
+ * This file contains the implementation of the MourOS functions managing the
+ * newlib reentrancy structs of tasks.
+ *
+ */
+
+#include <stddef.h>  // For NULL
+#include <string.h>  // For memset (used internally in _REENT_INIT_PTR())
+#include <stdbool.h> // For true, false
+
+#include <libopencm3/cm3/cortex.h> // CM3_ATOMIC_* macros
+#include <libopencm3/cm3/assert.h> // assert macros
+
+#include <mouros/tasks.h>
+#include <mouros/pool_alloc.h>
+#include "scheduler.h"
+
+
+/**
+ * Makes reent the reentrancy struct of task, and gives the struct it replaces
+ * back to its pool, if it was allocated from one.
+ *
+ * @param task  The task to set the reent struct for.
+ * @param reent Pointer to the initialized struct to be used.
+ * @param pool  The pool reent was allocated from, or NULL.
+ */
+static void replace_reent(task_t *task, struct _reent *reent,
+                          pool_alloc_t *pool)
+{
+	struct _reent *old_reent;
+	pool_alloc_t *old_pool;
+
+	CM_ATOMIC_BLOCK() {
+		old_reent = task->reent;
+		old_pool = task->reent_pool;
+
+		task->reent = reent;
+		task->reent_pool = pool;
+
+		if (task == current_task) {
+			_impure_ptr = reent;
+		}
+	}
+
+	if (old_pool != NULL) {
+		os_pool_alloc_give(old_pool, old_reent);
+	}
+}
+
+void os_task_set_reent(task_t *task, struct _reent *reent)
+{
+	if (reent == NULL) {
+#ifdef SHARED_REENT_ENABLE
+		reent = _global_impure_ptr;
+#else
+		reent = &task->reent_data;
+		_REENT_INIT_PTR(reent);
+#endif
+	} else {
+		_REENT_INIT_PTR(reent);
+	}
+
+	replace_reent(task, reent, NULL);
+}
+
+bool os_task_alloc_reent(task_t *task, pool_alloc_t *pool)
+{
+	cm3_assert(pool->block_size >= sizeof(struct _reent));
+
+	struct _reent *reent = os_pool_alloc_take(pool);
+
+	if (reent == NULL) {
+		return false;
+	}
+
+	_REENT_INIT_PTR(reent);
+
+	replace_reent(task, reent, pool);
+
+	return true;
+}
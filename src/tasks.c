@@ -7,7 +7,6 @@
  */
 
 #include <stddef.h>  // For NULL
-#include <string.h>  // For memset (used internally in _REENT_INIT_PTR())
 #include <stdbool.h> // For true, false
 
 #include <libopencm3/cm3/cortex.h>  // CM3_ATOMIC_* macros
@@ -18,6 +17,9 @@
 #include <libopencm3/stm32/rcc.h>   // rcc_ahb_frequency value
 
 #include <mouros/tasks.h>
+#include <mouros/trace.h>
+#include <mouros/profile.h>
+#include <mouros/diag_mask.h>
 #include "scheduler.h"
 
 #include "diag/diag.h"
@@ -41,17 +43,28 @@
 #if defined(__ARM_FP)
 // The stack needs to fit the core MCU state (16 registers * 4 bytes), the
 // FPU state (33 * 4 bytes), and possibly some alignment bytes.
-#define IDLE_TASK_STACK_SIZE 256
+#define IDLE_TASK_BASE_STACK_SIZE 256
 #else
 // When the FPU isn't used, only the core MCU state needs to be saved.
-#define IDLE_TASK_STACK_SIZE 128
+#define IDLE_TASK_BASE_STACK_SIZE 128
+#endif
+
+#ifdef TRACE_RING_ENABLE
+// The idle task flushes the trace ring, so it calls the diag send function.
+#define IDLE_TASK_STACK_SIZE \
+	(IDLE_TASK_BASE_STACK_SIZE + OS_TRACE_FLUSH_STACK_SIZE)
+#else
+#define IDLE_TASK_STACK_SIZE IDLE_TASK_BASE_STACK_SIZE
 #endif
 
 static uint32_t us_per_tick = 0;
 static uint32_t systicks_per_us = 0;
+static uint32_t systicks_per_sec = 0;
 
 bool os_is_initialized = false;
 
+volatile uint32_t os_diag_mask = OS_DIAG_DEFAULT_MASK & OS_DIAG_BUILD_MASK;
+
 /**
  * Struct holding pointers to the first and last tasks in the linked list of all
  * tasks.
@@ -74,7 +87,7 @@ static void __idle_task(void *params)
 	while(true) {
 #if DIAG_ENABLE
 		uint64_t curr_tick_count = os_get_tick_count();
-		if (curr_tick_count % 10000 == 0) {
+		if (OS_DIAG_ENABLED(STACK) && curr_tick_count % 10000 == 0) {
 			CM_ATOMIC_BLOCK() {
 				struct tcb *task = all_tasks.first;
 				while (task != NULL) {
@@ -90,12 +103,20 @@ static void __idle_task(void *params)
 			while (os_get_tick_count() == curr_tick_count);
 		}
 #endif
+
+#if defined(DIAG_ENABLE) && defined(PROFILE_ENABLE)
+		os_profile_report();
+#endif
+
+#ifdef TRACE_RING_ENABLE
+		os_trace_flush();
+#endif
 	}
 }
 
 /**
- * Function used to start task execution and to remove the task from the
- * all-tasks linked list.
+ * Function used to start task execution, and to remove the task from the
+ * all-tasks linked list and give its reent struct back once it returns.
  *
  * @param task Pointer to the task to be run.
  */
@@ -103,6 +124,9 @@ static void __task_runner(struct tcb *task)
 {
 	task->task_func(task->task_params);
 
+	// Give a reent struct allocated from a pool back.
+	os_task_set_reent(task, NULL);
+
 	CM_ATOMIC_BLOCK() {
 		struct tcb *prev = task->tasklist_prev;
 		struct tcb *next = task->tasklist_next;
@@ -175,6 +199,9 @@ bool os_task_init(task_t *task,
 	task->tasklist_prev = NULL;
 
 	task->next_task = NULL;
+	task->wait_next = NULL;
+	task->wait_result = NULL;
+	task->arena = NULL;
 
 	task->priority = priority;
 	task->task_func = task_func;
@@ -209,11 +236,18 @@ bool os_task_init(task_t *task,
 
 	task->exc_ret = DEFAULT_EXC_RET;
 
-	_REENT_INIT_PTR(&task->reent);
+	task->reent = NULL;
+	task->reent_pool = NULL;
+	os_task_set_reent(task, NULL);
 
 	return true;
 }
 
+void os_task_set_arena(task_t *task, struct arena *arena)
+{
+	task->arena = arena;
+}
+
 
 bool os_task_add(task_t *new_task)
 {
@@ -258,6 +292,11 @@ void os_tasks_start(uint32_t tick_freq)
 
 	us_per_tick = 1000000 / tick_freq;
 	systicks_per_us = (systick_get_reload() + 1) / us_per_tick;
+	systicks_per_sec = (systick_get_reload() + 1) * tick_freq;
+
+#if defined(DIAG_ENABLE) && defined(TRACE_TIMESTAMP_ENABLE)
+	diag_trace_clock(systicks_per_sec, OS_TRACE_TIMESTAMP_SHIFT);
+#endif
 
 // Silence warning because of a hack libopencm3 did. (NVIC_SYSTICK_IRQ &
 // NVIC_PENDSV_IRQ are negative, and nvic_set_priority() expects an unsigned)
@@ -315,6 +354,8 @@ void os_task_sleep(uint32_t num_ticks)
 
 	sched_add_to_sleepqueue(current_task);
 
+	sched_trace_block(NULL);
+
 	os_task_yield();
 }
 
@@ -372,7 +413,23 @@ void os_set_diagnostics(uint8_t (*diag_send_func)(uint8_t *msg_buf,
                                                   uint8_t msg_buf_len),
                         void (*diag_error_func)(void))
 {
+	os_trace_set_output(diag_send_func, diag_error_func);
+
+#ifdef TRACE_RING_ENABLE
+	diag_init(os_trace_write, diag_error_func);
+#else
 	diag_init(diag_send_func, diag_error_func);
+#endif
+}
+
+void os_diag_set_mask(uint32_t mask)
+{
+	os_diag_mask = mask & OS_DIAG_BUILD_MASK;
+}
+
+uint32_t os_diag_get_mask(void)
+{
+	return os_diag_mask;
 }
 
 uint64_t os_get_tick_count(void)
@@ -382,4 +439,28 @@ uint64_t os_get_tick_count(void)
 	return os_tick_count;
 }
 
+uint64_t os_get_timestamp(void)
+{
+	CM_ATOMIC_CONTEXT();
+
+	uint32_t reload_val = systick_get_reload();
+	uint32_t systicks = systick_get_value();
+	uint64_t ticks = os_tick_count;
+
+	// The counter has wrapped around, but the tick wasn't handled yet (e.g.
+	// because interrupts are masked). The counter value is read again, since
+	// it might have been read just before the wrap.
+	if ((SCB_ICSR & SCB_ICSR_PENDSTSET) != 0) {
+		ticks++;
+		systicks = systick_get_value();
+	}
+
+	return ticks * (reload_val + 1) + (reload_val - systicks);
+}
+
+uint32_t os_get_timestamp_freq(void)
+{
+	return systicks_per_sec;
+}
+
 
@@ -0,0 +1,744 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of a TLSF (two-level segregated
+ * fit) heap.
+ */
+
+#include <stddef.h>  // For NULL, offsetof()
+#include <stdbool.h> // For bool.
+#include <string.h>  // For memcpy(), memset()
+
+#include <libopencm3/cm3/cortex.h> // For CM_ATOMIC_CONTEXT().
+#include <libopencm3/cm3/assert.h> // For assert().
+
+#include <mouros/tlsf.h> // TLSF function definitions.
+
+#include "scheduler.h" // For current_task.
+
+#ifdef TLSF_MALLOC_ENABLE
+#include <reent.h> // For the malloc reentrancy functions.
+#include <errno.h> // For ENOMEM.
+#endif
+
+
+/**
+ * Header placed in front of every block. The free list links are only present
+ * in free blocks, where they take up the beginning of the block payload.
+ */
+struct tlsf_block {
+	/** Pointer to the physically preceding block. Valid if it's free. */
+	struct tlsf_block *prev_phys;
+	/** The size of the payload, with BLOCK_FREE and BLOCK_PREV_FREE. */
+	uint32_t size;
+	/** The next block in the free list. */
+	struct tlsf_block *next_free;
+	/** The previous block in the free list. */
+	struct tlsf_block *prev_free;
+};
+
+/** Flag in tlsf_block.size marking the block free. */
+#define BLOCK_FREE 1u
+/** Flag in tlsf_block.size marking the physically preceding block free. */
+#define BLOCK_PREV_FREE 2u
+/** Mask of the size bits of tlsf_block.size. */
+#define BLOCK_SIZE_MASK (~(BLOCK_FREE | BLOCK_PREV_FREE))
+
+/** The size of the part of tlsf_block that precedes the payload. */
+#define HEADER_SIZE ((uint32_t) offsetof(struct tlsf_block, next_free))
+/** The alignment of block sizes & payloads. */
+#define ALIGN_SIZE (1u << OS_TLSF_ALIGN_SIZE_LOG2)
+/** The smallest payload size. It has to hold the free list links. */
+#define MIN_BLOCK_SIZE ((uint32_t) sizeof(struct tlsf_block) - HEADER_SIZE)
+/** The size of the smallest block not in the first level list 0. */
+#define SMALL_BLOCK_SIZE (1u << OS_TLSF_FL_INDEX_SHIFT)
+/** The largest payload size. */
+#define MAX_BLOCK_SIZE ((1u << OS_TLSF_FL_INDEX_MAX) - ALIGN_SIZE)
+
+
+#ifdef TLSF_MALLOC_ENABLE
+tlsf_t os_malloc_tlsf;
+
+/**
+ * Declared in linker script. Address in RAM right after the space for
+ * statically allocated variables.
+ */
+extern char end;
+
+/**
+ * Declared in linker script. The initial value of the main stack pointer.
+ */
+extern char _stack;
+
+/** Whether os_malloc_tlsf has been initialized. */
+static volatile bool malloc_tlsf_ready = false;
+#endif
+
+
+/**
+ * Returns the index of the most significant set bit.
+ *
+ * @param word The word to scan. Must not be 0.
+ * @return The bit index.
+ */
+static inline uint32_t find_last_set(uint32_t word)
+{
+	return 31 - (uint32_t) __builtin_clz(word);
+}
+
+/**
+ * Returns the index of the least significant set bit.
+ *
+ * @param word The word to scan. Must not be 0.
+ * @return The bit index.
+ */
+static inline uint32_t find_first_set(uint32_t word)
+{
+	return (uint32_t) __builtin_ctz(word);
+}
+
+/**
+ * Returns the payload size of the block.
+ *
+ * @param block Pointer to the block.
+ * @return The size in bytes.
+ */
+static inline uint32_t block_size(const struct tlsf_block *block)
+{
+	return block->size & BLOCK_SIZE_MASK;
+}
+
+/**
+ * Returns the payload of the block.
+ *
+ * @param block Pointer to the block.
+ * @return Pointer to the payload.
+ */
+static inline void *block_to_ptr(struct tlsf_block *block)
+{
+	return (uint8_t *) block + HEADER_SIZE;
+}
+
+/**
+ * Returns the block of the payload.
+ *
+ * @param ptr Pointer to the payload.
+ * @return Pointer to the block.
+ */
+static inline struct tlsf_block *block_from_ptr(void *ptr)
+{
+	return (struct tlsf_block *) ((uint8_t *) ptr - HEADER_SIZE);
+}
+
+/**
+ * Returns the physically following block.
+ *
+ * @param block Pointer to the block.
+ * @return Pointer to the following block.
+ */
+static inline struct tlsf_block *block_next(struct tlsf_block *block)
+{
+	return (struct tlsf_block *) ((uint8_t *) block_to_ptr(block) +
+	                              block_size(block));
+}
+
+/**
+ * Returns the list indexes of a free block of the given size.
+ *
+ * @param size The size of the block.
+ * @param fl   Pointer to a location to store the first level index.
+ * @param sl   Pointer to a location to store the second level index.
+ */
+static inline void mapping_insert(uint32_t size, uint32_t *fl, uint32_t *sl)
+{
+	if (size < SMALL_BLOCK_SIZE) {
+		*fl = 0;
+		*sl = size / (SMALL_BLOCK_SIZE / OS_TLSF_SL_INDEX_COUNT);
+	} else {
+		uint32_t bit = find_last_set(size);
+
+		*sl = (size >> (bit - OS_TLSF_SL_INDEX_COUNT_LOG2)) ^
+		      OS_TLSF_SL_INDEX_COUNT;
+		*fl = bit - (OS_TLSF_FL_INDEX_SHIFT - 1);
+	}
+}
+
+/**
+ * Returns the indexes of the first list whose blocks are all at least size
+ * bytes large. The size is rounded up to the next list boundary, so that any
+ * block of the list will do, and no list needs to be searched.
+ *
+ * @param size The requested size.
+ * @param fl   Pointer to a location to store the first level index.
+ * @param sl   Pointer to a location to store the second level index.
+ */
+static inline void mapping_search(uint32_t size, uint32_t *fl, uint32_t *sl)
+{
+	if (size >= SMALL_BLOCK_SIZE) {
+		size += (1u << (find_last_set(size) -
+		                OS_TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+	}
+
+	mapping_insert(size, fl, sl);
+}
+
+/**
+ * Finds a free block in the list given by fl and sl, or in the next non-empty
+ * list holding larger blocks.
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param fl   The first level index.
+ * @param sl   The second level index.
+ * @return Pointer to the block, or NULL if there's none.
+ */
+static struct tlsf_block *find_suitable_block(tlsf_t *tlsf,
+                                              uint32_t fl,
+                                              uint32_t sl)
+{
+	uint32_t sl_map = tlsf->sl_bitmap[fl] & (~0u << sl);
+
+	if (sl_map == 0) {
+		uint32_t fl_map = tlsf->fl_bitmap & (~0u << (fl + 1));
+
+		if (fl_map == 0) {
+			return NULL;
+		}
+
+		fl = find_first_set(fl_map);
+		sl_map = tlsf->sl_bitmap[fl];
+	}
+
+	return tlsf->blocks[fl][find_first_set(sl_map)];
+}
+
+/**
+ * Inserts the block at the head of its free list.
+ *
+ * @param tlsf  Pointer to the heap struct.
+ * @param block Pointer to the block.
+ */
+static void insert_free_block(tlsf_t *tlsf, struct tlsf_block *block)
+{
+	uint32_t fl;
+	uint32_t sl;
+
+	mapping_insert(block_size(block), &fl, &sl);
+
+	struct tlsf_block *head = tlsf->blocks[fl][sl];
+
+	block->next_free = head;
+	block->prev_free = NULL;
+
+	if (head != NULL) {
+		head->prev_free = block;
+	}
+
+	tlsf->blocks[fl][sl] = block;
+	tlsf->fl_bitmap |= 1u << fl;
+	tlsf->sl_bitmap[fl] |= 1u << sl;
+
+	tlsf->free_size += block_size(block);
+	tlsf->num_free_blocks++;
+}
+
+/**
+ * Removes the block from its free list.
+ *
+ * @param tlsf  Pointer to the heap struct.
+ * @param block Pointer to the block.
+ */
+static void remove_free_block(tlsf_t *tlsf, struct tlsf_block *block)
+{
+	uint32_t fl;
+	uint32_t sl;
+
+	mapping_insert(block_size(block), &fl, &sl);
+
+	if (block->next_free != NULL) {
+		block->next_free->prev_free = block->prev_free;
+	}
+
+	if (block->prev_free != NULL) {
+		block->prev_free->next_free = block->next_free;
+	} else {
+		tlsf->blocks[fl][sl] = block->next_free;
+
+		if (block->next_free == NULL) {
+			tlsf->sl_bitmap[fl] &= ~(1u << sl);
+
+			if (tlsf->sl_bitmap[fl] == 0) {
+				tlsf->fl_bitmap &= ~(1u << fl);
+			}
+		}
+	}
+
+	tlsf->free_size -= block_size(block);
+	tlsf->num_free_blocks--;
+}
+
+/**
+ * Marks the block as used, also in the header of the following block.
+ *
+ * @param block Pointer to the block.
+ */
+static inline void mark_used(struct tlsf_block *block)
+{
+	block->size &= ~BLOCK_FREE;
+	block_next(block)->size &= ~BLOCK_PREV_FREE;
+}
+
+/**
+ * Splits the tail of the block off into a new block, which isn't in any list
+ * yet.
+ *
+ * @param block Pointer to the block.
+ * @param size  The new size of the block. The tail must be large enough for a
+ *              block of its own.
+ * @return Pointer to the new block.
+ */
+static struct tlsf_block *split_block(struct tlsf_block *block, uint32_t size)
+{
+	struct tlsf_block *rest = (struct tlsf_block *)
+	                          ((uint8_t *) block_to_ptr(block) + size);
+
+	rest->size = block_size(block) - size - HEADER_SIZE;
+	rest->prev_phys = block;
+
+	block->size = size | (block->size & ~BLOCK_SIZE_MASK);
+
+	block_next(rest)->prev_phys = rest;
+
+	return rest;
+}
+
+/**
+ * Returns the block to the free lists, merging it with its free neighbours.
+ *
+ * @param tlsf  Pointer to the heap struct.
+ * @param block Pointer to the block.
+ */
+static void release_block(tlsf_t *tlsf, struct tlsf_block *block)
+{
+	block->size |= BLOCK_FREE;
+
+	if (block->size & BLOCK_PREV_FREE) {
+		struct tlsf_block *prev = block->prev_phys;
+
+		remove_free_block(tlsf, prev);
+
+		prev->size += HEADER_SIZE + block_size(block);
+		block = prev;
+	}
+
+	struct tlsf_block *next = block_next(block);
+
+	if (next->size & BLOCK_FREE) {
+		remove_free_block(tlsf, next);
+
+		block->size += HEADER_SIZE + block_size(next);
+		next = block_next(block);
+	}
+
+	next->prev_phys = block;
+	next->size |= BLOCK_PREV_FREE;
+
+	insert_free_block(tlsf, block);
+}
+
+/**
+ * Gives the unneeded tail of a used block back to the free lists, if it's
+ * large enough to make a block of its own.
+ *
+ * @param tlsf  Pointer to the heap struct.
+ * @param block Pointer to the block.
+ * @param size  The needed size of the block.
+ */
+static void trim_block(tlsf_t *tlsf, struct tlsf_block *block, uint32_t size)
+{
+	if (block_size(block) - size >= HEADER_SIZE + MIN_BLOCK_SIZE) {
+		release_block(tlsf, split_block(block, size));
+	}
+}
+
+/**
+ * Rounds the requested size up to a valid block size.
+ *
+ * @param size The requested size.
+ * @return The block size, or 0 if the request is too large.
+ */
+static inline uint32_t adjust_size(uint32_t size)
+{
+	if (size > MAX_BLOCK_SIZE) {
+		return 0;
+	}
+
+	size = (size + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1);
+
+	return size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size;
+}
+
+/**
+ * Updates the low-water mark of the free memory.
+ *
+ * @param tlsf Pointer to the heap struct.
+ */
+static inline void update_min_free(tlsf_t *tlsf)
+{
+	if (tlsf->free_size < tlsf->min_free_size) {
+		tlsf->min_free_size = tlsf->free_size;
+	}
+}
+
+/**
+ * Allocates a block. Must be called with the heap locked.
+ *
+ * @param tlsf Pointer to the heap struct.
+ * @param size The requested size.
+ * @return Pointer to the payload of the block, or NULL on failure.
+ */
+static void *alloc_block(tlsf_t *tlsf, uint32_t size)
+{
+	uint32_t fl;
+	uint32_t sl;
+	struct tlsf_block *block = NULL;
+
+	size = adjust_size(size);
+
+	if (size != 0) {
+		mapping_search(size, &fl, &sl);
+
+		if (fl < OS_TLSF_FL_INDEX_COUNT) {
+			block = find_suitable_block(tlsf, fl, sl);
+		}
+	}
+
+	if (block == NULL) {
+		tlsf->num_failures++;
+		return NULL;
+	}
+
+	remove_free_block(tlsf, block);
+	mark_used(block);
+	trim_block(tlsf, block, size);
+
+	update_min_free(tlsf);
+
+	return block_to_ptr(block);
+}
+
+/**
+ * Acquires the heap lock. Before the scheduler is started, there's nothing to
+ * serialize against.
+ *
+ * @param tlsf Pointer to the heap struct.
+ */
+static inline void lock_heap(tlsf_t *tlsf)
+{
+	if (current_task != NULL) {
+		os_resource_acquire(&tlsf->lock);
+	}
+}
+
+/**
+ * Releases the heap lock.
+ *
+ * @param tlsf Pointer to the heap struct.
+ */
+static inline void unlock_heap(tlsf_t *tlsf)
+{
+	if (current_task != NULL) {
+		os_resource_release(&tlsf->lock);
+	}
+}
+
+
+void os_tlsf_init(tlsf_t *tlsf, void *mem, uint32_t size)
+{
+	memset(tlsf, 0, sizeof(*tlsf));
+
+	uintptr_t start = ((uintptr_t) mem + ALIGN_SIZE - 1) &
+	                  ~(uintptr_t) (ALIGN_SIZE - 1);
+
+	cm3_assert(start - (uintptr_t) mem < size);
+
+	size = (size - (uint32_t) (start - (uintptr_t) mem)) & ~(ALIGN_SIZE - 1);
+
+	cm3_assert(size >= 2 * HEADER_SIZE + MIN_BLOCK_SIZE);
+
+	// The region is a single free block, followed by a zero size used
+	// block that keeps the last block from being merged past the end.
+	uint32_t payload = size - 2 * HEADER_SIZE;
+
+	if (payload > MAX_BLOCK_SIZE) {
+		payload = MAX_BLOCK_SIZE;
+	}
+
+	struct tlsf_block *block = (struct tlsf_block *) start;
+
+	block->prev_phys = NULL;
+	block->size = payload;
+
+	struct tlsf_block *sentinel = block_next(block);
+
+	sentinel->size = 0;
+
+	release_block(tlsf, block);
+
+	tlsf->total_size = payload + 2 * HEADER_SIZE;
+	tlsf->min_free_size = tlsf->free_size;
+}
+
+void *os_tlsf_alloc(tlsf_t *tlsf, uint32_t size)
+{
+	lock_heap(tlsf);
+
+	void *ptr = alloc_block(tlsf, size);
+
+	unlock_heap(tlsf);
+
+	return ptr;
+}
+
+void os_tlsf_free(tlsf_t *tlsf, void *ptr)
+{
+	if (ptr == NULL) {
+		return;
+	}
+
+	struct tlsf_block *block = block_from_ptr(ptr);
+
+	cm3_assert(!(block->size & BLOCK_FREE));
+
+	lock_heap(tlsf);
+
+	release_block(tlsf, block);
+
+	unlock_heap(tlsf);
+}
+
+void *os_tlsf_realloc(tlsf_t *tlsf, void *ptr, uint32_t size)
+{
+	if (ptr == NULL) {
+		return os_tlsf_alloc(tlsf, size);
+	}
+
+	if (size == 0) {
+		os_tlsf_free(tlsf, ptr);
+		return NULL;
+	}
+
+	struct tlsf_block *block = block_from_ptr(ptr);
+	uint32_t adjusted = adjust_size(size);
+	void *ret = ptr;
+
+	lock_heap(tlsf);
+
+	if (adjusted == 0) {
+		tlsf->num_failures++;
+		ret = NULL;
+
+	} else if (adjusted <= block_size(block)) {
+		trim_block(tlsf, block, adjusted);
+
+	} else {
+		struct tlsf_block *next = block_next(block);
+
+		if ((next->size & BLOCK_FREE) &&
+		    block_size(block) + HEADER_SIZE + block_size(next) >=
+		    adjusted) {
+			// Grow into the following free block.
+			remove_free_block(tlsf, next);
+
+			block->size += HEADER_SIZE + block_size(next);
+			mark_used(block);
+			trim_block(tlsf, block, adjusted);
+
+			update_min_free(tlsf);
+
+		} else {
+			ret = alloc_block(tlsf, size);
+
+			if (ret != NULL) {
+				memcpy(ret, ptr, block_size(block));
+				release_block(tlsf, block);
+			}
+		}
+	}
+
+	unlock_heap(tlsf);
+
+	return ret;
+}
+
+uint32_t os_tlsf_block_size(tlsf_t *tlsf, void *ptr)
+{
+	(void) tlsf;
+
+	return block_size(block_from_ptr(ptr));
+}
+
+void os_tlsf_get_stats(tlsf_t *tlsf, tlsf_stats_t *stats)
+{
+	lock_heap(tlsf);
+
+	stats->total_size = tlsf->total_size;
+	stats->free_size = tlsf->free_size;
+	stats->min_free_size = tlsf->min_free_size;
+	stats->num_free_blocks = tlsf->num_free_blocks;
+	stats->num_failures = tlsf->num_failures;
+	stats->largest_free_block = 0;
+
+	// The largest free block is in the highest non-empty list. Blocks
+	// within a list differ in size, so the list has to be walked.
+	if (tlsf->fl_bitmap != 0) {
+		uint32_t fl = find_last_set(tlsf->fl_bitmap);
+		uint32_t sl = find_last_set(tlsf->sl_bitmap[fl]);
+
+		for (struct tlsf_block *block = tlsf->blocks[fl][sl];
+		     block != NULL;
+		     block = block->next_free) {
+
+			if (block_size(block) > stats->largest_free_block) {
+				stats->largest_free_block = block_size(block);
+			}
+		}
+	}
+
+	unlock_heap(tlsf);
+
+	if (stats->free_size != 0) {
+		stats->fragmentation = 100 - (uint32_t) ((uint64_t) 100 *
+		                       stats->largest_free_block /
+		                       stats->free_size);
+	} else {
+		stats->fragmentation = 0;
+	}
+}
+
+
+#ifdef TLSF_MALLOC_ENABLE
+
+/**
+ * Sets os_malloc_tlsf up to manage the RAM between the statically allocated
+ * variables and the stack reserve.
+ */
+static void init_malloc_tlsf(void)
+{
+	CM_ATOMIC_CONTEXT();
+
+	if (!malloc_tlsf_ready) {
+		os_tlsf_init(&os_malloc_tlsf, &end,
+		             (uint32_t) (&_stack - OS_TLSF_STACK_RESERVE - &end));
+
+		malloc_tlsf_ready = true;
+	}
+}
+
+void *os_heap_malloc(uint32_t size)
+{
+	if (!malloc_tlsf_ready) {
+		init_malloc_tlsf();
+	}
+
+	return os_tlsf_alloc(&os_malloc_tlsf, size);
+}
+
+void os_heap_free(void *ptr)
+{
+	os_tlsf_free(&os_malloc_tlsf, ptr);
+}
+
+void *os_heap_realloc(void *ptr, uint32_t size)
+{
+	if (!malloc_tlsf_ready) {
+		init_malloc_tlsf();
+	}
+
+	return os_tlsf_realloc(&os_malloc_tlsf, ptr, size);
+}
+
+#ifndef SLAB_MALLOC_ENABLE
+
+/**
+ * Allocates memory from os_malloc_tlsf. Replaces the newlib implementation used
+ * by malloc().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param size  The requested size.
+ * @return Pointer to the allocated memory, or NULL on error.
+ */
+void *_malloc_r(struct _reent *reent, size_t size)
+{
+	void *ptr = os_heap_malloc((uint32_t) size);
+
+	if (ptr == NULL) {
+		reent->_errno = ENOMEM;
+	}
+
+	return ptr;
+}
+
+/**
+ * Frees memory allocated from os_malloc_tlsf. Replaces the newlib
+ * implementation used by free().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param ptr   Pointer to the memory to be freed.
+ */
+void _free_r(struct _reent *reent, void *ptr)
+{
+	(void) reent;
+
+	os_heap_free(ptr);
+}
+
+/**
+ * Resizes memory allocated from os_malloc_tlsf. Replaces the newlib
+ * implementation used by realloc().
+ *
+ * @param reent Pointer to the reentrancy structure.
+ * @param ptr   Pointer to the memory to be resized.
+ * @param size  The requested size.
+ * @return Pointer to the resized memory, or NULL on error.
+ */
+void *_realloc_r(struct _reent *reent, void *ptr, size_t size)
+{
+	void *new_ptr = os_heap_realloc(ptr, (uint32_t) size);
+
+	if (new_ptr == NULL && size != 0) {
+		reent->_errno = ENOMEM;
+	}
+
+	return new_ptr;
+}
+
+/**
+ * Allocates zeroed memory for an array from os_malloc_tlsf. Replaces the newlib
+ * implementation used by calloc().
+ *
+ * @param reent    Pointer to the reentrancy structure.
+ * @param num      The number of array elements.
+ * @param elm_size The size of a single element.
+ * @return Pointer to the allocated memory, or NULL on error.
+ */
+void *_calloc_r(struct _reent *reent, size_t num, size_t elm_size)
+{
+	size_t size = num * elm_size;
+
+	if (elm_size != 0 && size / elm_size != num) {
+		reent->_errno = ENOMEM;
+		return NULL;
+	}
+
+	void *ptr = _malloc_r(reent, size);
+
+	if (ptr != NULL) {
+		memset(ptr, 0, size);
+	}
+
+	return ptr;
+}
+
+#endif
+
+#endif
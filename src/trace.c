@@ -0,0 +1,261 @@
+/**
+ * @file
+ *
+ * This file contains the MourOS implementation of the trace ring.
+ */
+
+#include <stddef.h>  // For NULL
+#include <stdbool.h> // For bool.
+#include <string.h>  // For memcpy().
+
+#include <libopencm3/cm3/cortex.h> // For CM_ATOMIC_BLOCK().
+#include <libopencm3/cm3/assert.h> // For assert().
+
+#include <mouros/trace.h> // Trace ring function definitions.
+#include <mouros/tasks.h> // For os_get_timestamp().
+
+
+#if (OS_TRACE_RING_SIZE & (OS_TRACE_RING_SIZE - 1)) != 0 || \
+    OS_TRACE_RING_SIZE < 256
+#error "OS_TRACE_RING_SIZE must be a power of two, and at least 256."
+#endif
+
+/** Mask turning a free running position into an index into the ring. */
+#define RING_MASK (OS_TRACE_RING_SIZE - 1)
+
+
+/** The buffered bytes. */
+static uint8_t ring[OS_TRACE_RING_SIZE];
+
+/**
+ * The position after the last reserved byte. The positions are free running,
+ * and are only masked when accessing the ring.
+ */
+static volatile uint32_t write_pos = 0;
+/** The position after the last byte of the published messages. */
+static volatile uint32_t commit_pos = 0;
+/** The position of the first byte not yet flushed. */
+static volatile uint32_t read_pos = 0;
+/** The number of writers between reserving space and publishing a message. */
+static uint32_t num_writers = 0;
+
+/** True while a flush is in progress. */
+static bool flushing = false;
+
+/** The function the messages are flushed to. */
+static uint8_t (*output_send_func)(uint8_t *msg_buf, uint8_t msg_buf_len) = NULL;
+/** The function called if output_send_func fails. */
+static void (*output_error_func)(void) = NULL;
+
+/** The highest number of buffered bytes seen. */
+static uint32_t max_used = 0;
+/** The number of bytes flushed. */
+static uint32_t num_flushed = 0;
+/** The number of dropped messages. */
+static uint32_t num_overflows = 0;
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+/** The timestamp of the last compact event written. */
+static uint64_t last_timestamp = 0;
+#endif
+
+
+/**
+ * Appends a message to the ring, or counts it as dropped if it doesn't fit.
+ *
+ * @param msg_buf     Pointer to the message.
+ * @param msg_buf_len The length of the message.
+ * @return True if the message was appended, false if it was dropped.
+ */
+static bool ring_put(const uint8_t *msg_buf, uint8_t msg_buf_len)
+{
+	uint32_t start = 0;
+	bool reserved = false;
+
+	CM_ATOMIC_BLOCK() {
+		uint32_t used = write_pos - read_pos + msg_buf_len;
+
+		if (used <= OS_TRACE_RING_SIZE) {
+			start = write_pos;
+			write_pos = start + msg_buf_len;
+			num_writers++;
+
+			if (used > max_used) {
+				max_used = used;
+			}
+
+			reserved = true;
+		} else {
+			num_overflows++;
+		}
+	}
+
+	if (!reserved) {
+		return false;
+	}
+
+	uint32_t offset = start & RING_MASK;
+	uint32_t first_len = OS_TRACE_RING_SIZE - offset;
+
+	if (first_len > msg_buf_len) {
+		first_len = msg_buf_len;
+	}
+
+	memcpy(&ring[offset], msg_buf, first_len);
+	memcpy(ring, msg_buf + first_len, msg_buf_len - first_len);
+
+	// Interrupted writers reserved space before the writers interrupting
+	// them, so the messages can only be published once the outermost writer
+	// is done.
+	CM_ATOMIC_BLOCK() {
+		num_writers--;
+
+		if (num_writers == 0) {
+			commit_pos = write_pos;
+		}
+	}
+
+	return true;
+}
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+/**
+ * Writes value as an LEB128 varint: 7 bits per byte, least significant first,
+ * with the top bit set in all but the last byte.
+ *
+ * @param buf   The buffer to write to.
+ * @param value The value to encode.
+ * @return The number of bytes written.
+ */
+static uint8_t put_varint(uint8_t *buf, uint64_t value)
+{
+	uint8_t len = 0;
+
+	while (value >= 0x80) {
+		buf[len++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+
+	buf[len++] = (uint8_t) value;
+
+	return len;
+}
+#endif
+
+
+void os_trace_set_output(uint8_t (*send_func)(uint8_t *msg_buf,
+                                              uint8_t msg_buf_len),
+                         void (*error_func)(void))
+{
+	CM_ATOMIC_BLOCK() {
+		output_send_func = send_func;
+		output_error_func = error_func;
+	}
+}
+
+uint8_t os_trace_write(uint8_t *msg_buf, uint8_t msg_buf_len)
+{
+	ring_put(msg_buf, msg_buf_len);
+
+	return msg_buf_len;
+}
+
+#ifdef TRACE_TIMESTAMP_ENABLE
+void os_trace_compact_event(uint8_t event_id,
+                            const uint32_t *args,
+                            uint32_t num_args)
+{
+	// The ID, a 64-bit varint and 32-bit varints.
+	uint8_t buf[1 + 10 + OS_TRACE_COMPACT_MAX_ARGS * 5];
+
+	cm3_assert(num_args <= OS_TRACE_COMPACT_MAX_ARGS);
+
+	CM_ATOMIC_CONTEXT();
+
+	uint64_t timestamp = os_get_timestamp() >> OS_TRACE_TIMESTAMP_SHIFT;
+	uint8_t len = 0;
+
+	buf[len++] = event_id;
+	len = (uint8_t) (len + put_varint(&buf[len],
+	                                  timestamp - last_timestamp));
+
+	for (uint32_t i = 0; i < num_args; i++) {
+		len = (uint8_t) (len + put_varint(&buf[len], args[i]));
+	}
+
+#ifdef TRACE_RING_ENABLE
+	if (ring_put(buf, len)) {
+		last_timestamp = timestamp;
+	}
+#else
+	if (output_send_func != NULL) {
+		if (output_send_func(buf, len) < len &&
+		    output_error_func != NULL) {
+			output_error_func();
+		}
+
+		last_timestamp = timestamp;
+	}
+#endif
+}
+#endif
+
+uint32_t os_trace_flush(void)
+{
+	bool can_flush = false;
+
+	CM_ATOMIC_BLOCK() {
+		if (!flushing && output_send_func != NULL) {
+			flushing = true;
+			can_flush = true;
+		}
+	}
+
+	if (!can_flush) {
+		return 0;
+	}
+
+	uint32_t total = 0;
+	uint32_t end = commit_pos;
+
+	while (read_pos != end) {
+		uint32_t offset = read_pos & RING_MASK;
+		uint32_t len = end - read_pos;
+
+		if (len > OS_TRACE_RING_SIZE - offset) {
+			len = OS_TRACE_RING_SIZE - offset;
+		}
+
+		if (len > UINT8_MAX) {
+			len = UINT8_MAX;
+		}
+
+		uint8_t sent = output_send_func(&ring[offset], (uint8_t) len);
+
+		read_pos += sent;
+		total += sent;
+
+		if (sent < len) {
+			if (output_error_func != NULL) {
+				output_error_func();
+			}
+
+			break;
+		}
+	}
+
+	num_flushed += total;
+	flushing = false;
+
+	return total;
+}
+
+void os_trace_get_stats(trace_stats_t *stats)
+{
+	CM_ATOMIC_BLOCK() {
+		stats->used = write_pos - read_pos;
+		stats->max_used = max_used;
+		stats->num_flushed = num_flushed;
+		stats->num_overflows = num_overflows;
+	}
+}
@@ -8,8 +8,15 @@
 #define REENT_H_
 
 struct _reent {
+	/** Set by _REENT_INIT_PTR(), so tests can tell initialized structs. */
+	int _errno;
 };
 
-#endif /* REENT_H_ */
+/** The reent struct used by newlib, switched by the scheduler. */
+extern struct _reent *_impure_ptr;
+/** The global reent struct. */
+extern struct _reent *const _global_impure_ptr;
 
+#define _REENT_INIT_PTR(var) ((var)->_errno = 0)
 
+#endif /* REENT_H_ */
@@ -0,0 +1,53 @@
+/**
+ * @file
+ *
+ * This file contains a stub implementation of the MourOS scheduler.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "scheduler.h"
+
+
+struct tcb *current_task = NULL;
+
+uint64_t os_tick_count = 0;
+
+
+void sched_init(void)
+{
+}
+
+void sched_start_tasks(void)
+{
+}
+
+void sched_add_to_runqueue_head(struct tcb *task)
+{
+	check_expected_ptr(task);
+}
+
+void sched_add_to_runqueue_tail(struct tcb *task)
+{
+	check_expected_ptr(task);
+}
+
+void sched_wake_task(struct tcb *task)
+{
+	check_expected_ptr(task);
+
+	task->state = TASK_RUNNABLE;
+}
+
+void sched_add_to_sleepqueue(struct tcb *task)
+{
+	check_expected_ptr(task);
+}
+
+void sched_remove_from_sleepqueue(struct tcb *task)
+{
+	check_expected_ptr(task);
+}
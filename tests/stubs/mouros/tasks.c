@@ -17,6 +17,19 @@
 #include <mouros/tasks.h>
 
 
+/**
+ * Optional function called by os_task_yield(). Lets tests simulate other tasks
+ * running while the current task is blocked.
+ */
+void (*stub_task_yield_hook)(void) = NULL;
+
+/** The value returned by os_get_timestamp(). */
+uint64_t stub_timestamp = 0;
+
+/** The value returned by os_get_timestamp_freq(). */
+uint32_t stub_timestamp_freq = 0;
+
+
 void os_init(void)
 {
 }
@@ -56,6 +69,9 @@ void os_tasks_start(uint32_t tick_freq)
 
 void os_task_yield(void)
 {
+	if (stub_task_yield_hook != NULL) {
+		stub_task_yield_hook();
+	}
 }
 
 
@@ -75,6 +91,16 @@ void os_task_sleep(uint32_t num_ticks)
 	check_expected(num_ticks);
 }
 
+uint64_t os_get_timestamp(void)
+{
+	return stub_timestamp;
+}
+
+uint32_t os_get_timestamp_freq(void)
+{
+	return stub_timestamp_freq;
+}
+
 void os_set_diagnostics(uint8_t (*diag_send_func)(uint8_t *msg_buf,
                                                   uint8_t msg_buf_len),
                         void (*diag_error_func)(void))
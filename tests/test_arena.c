@@ -0,0 +1,177 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS arena allocator.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mouros/arena.h>
+#include <mouros/tasks.h>
+
+#include "scheduler.h"
+
+#define BLOCK_SIZE 64
+#define NUM_BLOCKS 4
+
+static uint64_t backing_memory[NUM_BLOCKS][BLOCK_SIZE / sizeof(uint64_t)];
+
+static pool_alloc_t pool;
+
+/**
+ * Returns the number of free blocks in the pool.
+ */
+static uint32_t num_free_blocks(void)
+{
+	pool_alloc_stats_t stats;
+
+	os_pool_alloc_get_stats(&pool, &stats);
+
+	return stats.num_free;
+}
+
+static void alloc_test(void **state)
+{
+	(void) state;
+
+	arena_t arena;
+
+	os_pool_alloc_init(&pool, backing_memory, BLOCK_SIZE, NUM_BLOCKS);
+	os_arena_init(&arena, &pool);
+
+	// No chunk is taken before the first allocation.
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+
+	uint8_t *a = os_arena_alloc(&arena, 1);
+	uint8_t *b = os_arena_alloc(&arena, 13);
+	uint8_t *c = os_arena_alloc(&arena, 8);
+
+	assert_ptr_equal(a, (uint8_t *) backing_memory[0] +
+	                    OS_ARENA_CHUNK_HEADER_SIZE);
+	assert_ptr_equal(b, a + 8);
+	assert_ptr_equal(c, b + 16);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+
+	// The rest of the chunk doesn't fit the next allocation.
+	uint8_t *d = os_arena_alloc(&arena, 32);
+
+	assert_ptr_equal(d, (uint8_t *) backing_memory[1] +
+	                    OS_ARENA_CHUNK_HEADER_SIZE);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 2);
+
+	// Larger than a chunk.
+	assert_null(os_arena_alloc(&arena,
+	                           BLOCK_SIZE - OS_ARENA_CHUNK_HEADER_SIZE + 1));
+	assert_non_null(os_arena_alloc(&arena,
+	                               BLOCK_SIZE - OS_ARENA_CHUNK_HEADER_SIZE));
+	assert_non_null(os_arena_alloc(&arena,
+	                               BLOCK_SIZE - OS_ARENA_CHUNK_HEADER_SIZE));
+
+	// Sizes that would overflow when rounded up.
+	assert_null(os_arena_alloc(&arena, UINT32_MAX));
+	assert_null(os_arena_alloc(&arena, UINT32_MAX - OS_ARENA_ALIGN + 2));
+
+	// The pool is empty.
+	assert_null(os_arena_alloc(&arena, 8));
+
+	os_arena_release(&arena);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+
+	// Chunks must keep the end of every allocation aligned.
+	pool_alloc_t unaligned_pool;
+
+	os_pool_alloc_init(&unaligned_pool, backing_memory, BLOCK_SIZE - 4,
+	                   NUM_BLOCKS);
+	expect_assert_failure(os_arena_init(&arena, &unaligned_pool));
+}
+
+static void rewind_test(void **state)
+{
+	(void) state;
+
+	arena_t arena;
+	arena_mark_t empty;
+	arena_mark_t mark;
+
+	os_pool_alloc_init(&pool, backing_memory, BLOCK_SIZE, NUM_BLOCKS);
+	os_arena_init(&arena, &pool);
+
+	os_arena_mark(&arena, &empty);
+
+	uint8_t *a = os_arena_alloc(&arena, 16);
+	os_arena_mark(&arena, &mark);
+
+	uint8_t *b = os_arena_alloc(&arena, 16);
+
+	// Two more chunks.
+	for (uint32_t i = 0; i < 2; i++) {
+		os_arena_alloc(&arena, 32);
+	}
+
+	assert_int_equal(num_free_blocks(), 1);
+
+	// Rewinding gives back the chunks taken after the mark, and the next
+	// allocation continues right after the marked position.
+	os_arena_rewind(&arena, &mark);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+	assert_ptr_equal(os_arena_alloc(&arena, 16), b);
+
+	// Resetting keeps the first chunk.
+	os_arena_alloc(&arena, 48);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 2);
+
+	os_arena_reset(&arena);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+	assert_ptr_equal(os_arena_alloc(&arena, 16), a);
+
+	// Rewinding to a mark taken before the first allocation gives back
+	// everything.
+	os_arena_rewind(&arena, &empty);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+
+	os_arena_reset(&arena);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+	assert_ptr_equal(os_arena_alloc(&arena, 16), a);
+}
+
+static void task_arena_test(void **state)
+{
+	(void) state;
+
+	arena_t arena;
+	task_t task;
+
+	os_pool_alloc_init(&pool, backing_memory, BLOCK_SIZE, NUM_BLOCKS);
+	os_arena_init(&arena, &pool);
+
+	task.arena = NULL;
+	current_task = &task;
+
+	assert_null(os_arena_task_alloc(8));
+
+	task.arena = &arena;
+
+	assert_ptr_equal(os_arena_task_alloc(8),
+	                 (uint8_t *) backing_memory[0] +
+	                 OS_ARENA_CHUNK_HEADER_SIZE);
+	assert_int_equal(arena.num_chunks, 1);
+
+	current_task = NULL;
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(alloc_test),
+		cmocka_unit_test(rewind_test),
+		cmocka_unit_test(task_arena_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,136 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS bitmap pool allocator.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <mouros/bitmap_pool.h>
+
+#define NUM_BLOCKS 70
+
+static uint32_t backing_memory[NUM_BLOCKS][4];
+static uint32_t map[OS_BITMAP_POOL_MAP_WORDS(NUM_BLOCKS)];
+
+static void take_give_test(void **state)
+{
+	(void) state;
+
+	bitmap_pool_t pool;
+
+	memset(backing_memory, 0xaa, sizeof(backing_memory));
+
+	os_bitmap_pool_init(&pool, backing_memory, sizeof(backing_memory[0]),
+	                    NUM_BLOCKS, map);
+
+	assert_int_equal(os_bitmap_pool_num_free(&pool), NUM_BLOCKS);
+
+	// Blocks are handed out from the lowest address up.
+	for (uint32_t i = 0; i < NUM_BLOCKS; i++) {
+		assert_ptr_equal(os_bitmap_pool_take(&pool), backing_memory[i]);
+	}
+
+	assert_null(os_bitmap_pool_take(&pool));
+	assert_int_equal(os_bitmap_pool_num_free(&pool), 0);
+
+	os_bitmap_pool_give(&pool, backing_memory[40]);
+	os_bitmap_pool_give(&pool, backing_memory[3]);
+
+	// The lowest free block is reused first.
+	assert_ptr_equal(os_bitmap_pool_take(&pool), backing_memory[3]);
+	assert_ptr_equal(os_bitmap_pool_take(&pool), backing_memory[40]);
+	assert_null(os_bitmap_pool_take(&pool));
+
+	// The allocator never writes to the blocks.
+	for (uint32_t i = 0; i < NUM_BLOCKS; i++) {
+		for (uint32_t j = 0; j < 4; j++) {
+			assert_int_equal(backing_memory[i][j], 0xaaaaaaaa);
+		}
+	}
+}
+
+static void run_test(void **state)
+{
+	(void) state;
+
+	bitmap_pool_t pool;
+
+	os_bitmap_pool_init(&pool, backing_memory, sizeof(backing_memory[0]),
+	                    NUM_BLOCKS, map);
+
+	// Runs crossing the bitmap word boundaries.
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 30), backing_memory[0]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 5), backing_memory[30]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 33), backing_memory[35]);
+	assert_int_equal(os_bitmap_pool_num_free(&pool), 2);
+
+	// Two blocks left, so a run of three doesn't fit.
+	assert_null(os_bitmap_pool_take_run(&pool, 3));
+
+	// Freeing the middle run leaves a hole of five blocks, and a single
+	// block take fills it from the bottom.
+	os_bitmap_pool_give(&pool, backing_memory[30]);
+	assert_int_equal(os_bitmap_pool_num_free(&pool), 7);
+
+	assert_ptr_equal(os_bitmap_pool_take(&pool), backing_memory[30]);
+
+	// Only a run of four fits into the hole. The two free blocks at the end
+	// of the pool are too few for a run of six.
+	assert_null(os_bitmap_pool_take_run(&pool, 6));
+	assert_null(os_bitmap_pool_take_run(&pool, 5));
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 4), backing_memory[31]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 2), backing_memory[68]);
+	assert_int_equal(os_bitmap_pool_num_free(&pool), 0);
+
+	// Giving back whole runs by their first block.
+	os_bitmap_pool_give(&pool, backing_memory[0]);
+	os_bitmap_pool_give(&pool, backing_memory[35]);
+	assert_int_equal(os_bitmap_pool_num_free(&pool), 63);
+
+	// The two freed runs are separated by blocks 30..34.
+	assert_null(os_bitmap_pool_take_run(&pool, 34));
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 31), backing_memory[35]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 30), backing_memory[0]);
+
+	os_bitmap_pool_give(&pool, backing_memory[30]);
+	os_bitmap_pool_give(&pool, backing_memory[31]);
+	os_bitmap_pool_give(&pool, backing_memory[68]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 5), backing_memory[30]);
+	assert_ptr_equal(os_bitmap_pool_take_run(&pool, 4), backing_memory[66]);
+}
+
+static void bad_give_test(void **state)
+{
+	(void) state;
+
+	bitmap_pool_t pool;
+
+	os_bitmap_pool_init(&pool, backing_memory, sizeof(backing_memory[0]),
+	                    NUM_BLOCKS, map);
+
+	// Blocks that are free already, or not from the pool at all.
+	expect_assert_failure(os_bitmap_pool_give(&pool, backing_memory[1]));
+	expect_assert_failure(os_bitmap_pool_give(&pool,
+	                                          &backing_memory[2][1]));
+	expect_assert_failure(os_bitmap_pool_give(&pool,
+	                                          backing_memory + NUM_BLOCKS));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(take_give_test),
+		cmocka_unit_test(run_test),
+		cmocka_unit_test(bad_give_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+Tests for the profile builder in tools/diag_profile.py.
+"""
+
+import io
+import os
+import sys
+import tempfile
+import unittest
+
+ROOT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+CONFIG_PATH = os.path.join(ROOT_DIR, 'src', 'diag', 'diag_config.json')
+
+sys.path.insert(0, os.path.join(ROOT_DIR, 'tools'))
+
+import diag_profile  # noqa: E402
+import diag_trace  # noqa: E402
+
+
+EVENT_TYPES = diag_trace.load_config(CONFIG_PATH)
+EVENTS_BY_NAME = {event_type.name: event_type for event_type in EVENT_TYPES}
+
+#: A symbol listing as printed by "nm -S -n".
+NM_LINES = [
+    '08000000 T vector_table',
+    '08000101 00000040 T main',
+    '08000141 00000020 t __idle_task',
+    '08000141 t idle_alias',
+    '08000161 0000001e T uart_send',
+    '20000000 00000100 B ring',
+]
+
+
+def encode(name, **args):
+    """Encodes an event the way the generated diag functions do."""
+    event_type = EVENTS_BY_NAME[name]
+    values = [args[arg_name] for arg_name in event_type.arg_names]
+
+    return bytes([event_type.id]) + event_type.struct.pack(*values)
+
+
+def sample(pc, task_id):
+    return encode('PROFILE_SAMPLE', pc=pc, task_id=task_id)
+
+
+class SymbolTableTest(unittest.TestCase):
+
+    def test_lookup(self):
+        symbols = diag_profile.SymbolTable(NM_LINES)
+
+        self.assertEqual(symbols.lookup(0x08000100), 'main')
+        self.assertEqual(symbols.lookup(0x0800013e), 'main')
+        self.assertEqual(symbols.lookup(0x08000140), '__idle_task')
+        self.assertEqual(symbols.lookup(0x08000170), 'uart_send')
+
+        # Past the end of the last sized function, and before the first one.
+        self.assertIsNone(symbols.lookup(0x08000180))
+        self.assertIsNone(symbols.lookup(0x07ffffff))
+
+        # Unsized symbols extend to the next symbol, and data is ignored.
+        self.assertEqual(symbols.lookup(0x08000010), 'vector_table')
+        self.assertIsNone(symbols.lookup(0x20000010))
+
+
+class ProfileTest(unittest.TestCase):
+
+    def setUp(self):
+        self.symbols = diag_profile.SymbolTable(NM_LINES)
+
+    def test_profile(self):
+        data = (sample(0x08000102, 1) * 3 +
+                encode('SYSCALL_GETPID') +
+                sample(0x08000170, 1) +
+                sample(0x08000150, 0) * 4 +
+                sample(0x09000000, 2))
+
+        stream = io.BytesIO(data)
+        samples, decoder = diag_profile.read_samples(EVENT_TYPES, stream)
+
+        self.assertEqual(decoder.num_skipped, 0)
+        self.assertEqual(sum(samples.values()), 9)
+
+        profile = diag_profile.symbolize(samples, self.symbols)
+
+        self.assertEqual(profile[(1, 'main')], 3)
+        self.assertEqual(profile[(1, 'uart_send')], 1)
+        self.assertEqual(profile[(0, '__idle_task')], 4)
+        self.assertEqual(profile[(2, diag_profile.UNKNOWN_FUNCTION)], 1)
+
+        flat = diag_profile.flat_profile(profile)
+        self.assertIn('__idle_task', flat[1])
+        self.assertIn('44.44', flat[1])
+        self.assertIn('main', flat[2])
+        self.assertEqual(flat[-1], 'Total samples: 9')
+
+        by_task = diag_profile.flat_profile(profile, {1: 'uart'}, True,
+                                            limit=2)
+        self.assertEqual(len(by_task), 4)
+        self.assertIn('main (uart)', by_task[2])
+
+        folded = diag_profile.folded_stacks(profile, {0: 'idle'})
+        self.assertIn('idle;__idle_task 4', folded)
+        self.assertIn('Task 1;main 3', folded)
+
+    def test_main(self):
+        data = sample(0x08000102, 1) * 2 + sample(0x08000162, 3)
+
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            input_path = os.path.join(tmp_dir, 'capture.bin')
+            symbols_path = os.path.join(tmp_dir, 'firmware.sym')
+            folded_path = os.path.join(tmp_dir, 'profile.folded')
+
+            with open(input_path, 'wb') as input_file:
+                input_file.write(data)
+
+            with open(symbols_path, 'w') as symbols_file:
+                symbols_file.write('\n'.join(NM_LINES))
+
+            stdout = io.StringIO()
+            old_stdout = sys.stdout
+            sys.stdout = stdout
+
+            try:
+                ret = diag_profile.main([CONFIG_PATH, input_path,
+                                         '--symbols', symbols_path,
+                                         '--folded', folded_path,
+                                         '--task-name', '3=uart'])
+            finally:
+                sys.stdout = old_stdout
+
+            self.assertEqual(ret, 0)
+            self.assertIn('66.67', stdout.getvalue())
+
+            with open(folded_path) as folded_file:
+                self.assertEqual(folded_file.read().splitlines(),
+                                 ['Task 1;main 2', 'uart;uart_send 1'])
+
+
+if __name__ == '__main__':
+    unittest.main()
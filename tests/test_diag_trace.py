@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""
+Tests for the diag trace decoder in tools/diag_trace.py.
+"""
+
+import io
+import json
+import os
+import sys
+import tempfile
+import unittest
+
+ROOT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+CONFIG_PATH = os.path.join(ROOT_DIR, 'src', 'diag', 'diag_config.json')
+
+sys.path.insert(0, os.path.join(ROOT_DIR, 'tools'))
+
+import diag_trace  # noqa: E402
+
+
+EVENT_TYPES = diag_trace.load_config(CONFIG_PATH)
+EVENTS_BY_NAME = {event_type.name: event_type for event_type in EVENT_TYPES}
+
+
+def encode(name, **args):
+    """Encodes an event the way the generated diag functions do."""
+    event_type = EVENTS_BY_NAME[name]
+    values = [args[arg_name] for arg_name in event_type.arg_names]
+
+    return bytes([event_type.id]) + event_type.struct.pack(*values)
+
+
+def varint(value):
+    """Encodes value as an LEB128 varint."""
+    out = bytearray()
+
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+
+    out.append(value)
+
+    return bytes(out)
+
+
+def encode_compact(name, delta, *args):
+    """Encodes a compact event the way os_trace_compact_event() does."""
+    event_type = EVENTS_BY_NAME[name]
+
+    return (bytes([event_type.id]) + varint(delta) +
+            b''.join(varint(arg) for arg in args))
+
+
+def convert(data, chunk_size=None, **kwargs):
+    """Converts data, and returns the parsed trace and the writer."""
+    stream = io.BytesIO(data)
+    out = io.StringIO()
+
+    if chunk_size is not None:
+        old_chunk_size = diag_trace.CHUNK_SIZE
+        diag_trace.CHUNK_SIZE = chunk_size
+
+    try:
+        writer, decoder = diag_trace.convert(EVENT_TYPES, stream, out,
+                                             **kwargs)
+    finally:
+        if chunk_size is not None:
+            diag_trace.CHUNK_SIZE = old_chunk_size
+
+    return json.loads(out.getvalue()), writer, decoder
+
+
+def trace_events(trace, ph, name=None):
+    return [event for event in trace['traceEvents']
+            if event['ph'] == ph and (name is None or event['name'] == name)]
+
+
+class DecoderTest(unittest.TestCase):
+
+    def test_split_messages(self):
+        data = (encode('TASK_SWITCH', timestamp=1, from_id=0, to_id=1) +
+                encode('SYSCALL_WRITE', filedes=1, buf=0x20000000, count=5) +
+                encode('TASK_SWITCH', timestamp=2, from_id=1, to_id=0))
+
+        decoder = diag_trace.Decoder(EVENT_TYPES)
+        events = []
+
+        # Feed the stream a byte at a time.
+        for i in range(len(data)):
+            events += decoder.feed(data[i:i + 1])
+
+        self.assertEqual([event_type.name for event_type, _ in events],
+                         ['TASK_SWITCH', 'SYSCALL_WRITE', 'TASK_SWITCH'])
+        self.assertEqual(events[1][1],
+                         {'filedes': 1, 'buf': 0x20000000, 'count': 5})
+        self.assertEqual(events[2][1]['timestamp'], 2)
+        self.assertEqual(len(decoder.buf), 0)
+
+    def test_resync(self):
+        data = (bytes([0xff, 0xfe]) +
+                encode('TASK_SWITCH', timestamp=7, from_id=2, to_id=3))
+
+        decoder = diag_trace.Decoder(EVENT_TYPES)
+        events = decoder.feed(data)
+
+        self.assertEqual(decoder.num_skipped, 2)
+        self.assertEqual(len(events), 1)
+        self.assertEqual(events[0][1]['to_id'], 3)
+
+
+    def test_compact(self):
+        # Before TRACE_CLOCK, the events are in the full encoding.
+        data = (encode('TASK_SWITCH', timestamp=1, from_id=0, to_id=1) +
+                encode('TRACE_CLOCK', frequency=16000000, shift=4) +
+                encode_compact('TASK_SWITCH', 300, 1, 2) +
+                encode_compact('TASK_WAKE', 2, 1, 16 + 5) +
+                encode_compact('TASK_BLOCK', 20000, 2, 2, 0x20001000))
+
+        decoder = diag_trace.Decoder(EVENT_TYPES)
+        events = []
+
+        for i in range(len(data)):
+            events += decoder.feed(data[i:i + 1])
+
+        self.assertEqual([event_type.name for event_type, _ in events],
+                         ['TASK_SWITCH', 'TRACE_CLOCK', 'TASK_SWITCH',
+                          'TASK_WAKE', 'TASK_BLOCK'])
+        self.assertEqual(events[2][1],
+                         {'timestamp': 300, 'from_id': 1, 'to_id': 2})
+        self.assertEqual(events[3][1],
+                         {'timestamp': 302, 'task_id': 1, 'exception': 21})
+        self.assertEqual(events[4][1],
+                         {'timestamp': 20302, 'task_id': 2, 'state': 2,
+                          'object': 0x20001000})
+        self.assertEqual(decoder.num_skipped, 0)
+
+        # A TASK_SWITCH a millisecond after the previous event is 5 bytes
+        # instead of 11.
+        self.assertEqual(len(encode_compact('TASK_SWITCH', 10000, 1, 2)), 5)
+        self.assertEqual(len(encode('TASK_SWITCH', timestamp=1, from_id=1,
+                                    to_id=2)), 11)
+
+
+class TraceTest(unittest.TestCase):
+
+    def test_run_intervals(self):
+        data = (encode('TASK_SWITCH', timestamp=10, from_id=0, to_id=1) +
+                encode('TASK_SWITCH', timestamp=13, from_id=1, to_id=2) +
+                encode('TASK_SWITCH', timestamp=14, from_id=2, to_id=1) +
+                encode('TASK_SWITCH', timestamp=20, from_id=1, to_id=0))
+
+        trace, writer, _ = convert(data, chunk_size=5,
+                                   task_names={1: 'control'})
+
+        runs = trace_events(trace, 'X', 'running')
+        self.assertEqual([(run['tid'], run['ts'], run['dur']) for run in runs],
+                         [(1, 10000.0, 3000.0), (2, 13000.0, 1000.0),
+                          (1, 14000.0, 6000.0)])
+
+        names = {event['tid']: event['args']['name']
+                 for event in trace_events(trace, 'M', 'thread_name')}
+        self.assertEqual(names[1], 'control')
+        self.assertEqual(names[2], 'Task 2')
+
+        self.assertEqual(writer.stats[1].num_runs, 2)
+        self.assertAlmostEqual(writer.stats[1].run_time, 9000.0)
+
+        summary = writer.summary()
+        self.assertIn('control', summary[2])
+        self.assertIn('90.00', summary[2])
+
+    def test_block_wake(self):
+        data = (encode('TASK_SWITCH', timestamp=1, from_id=0, to_id=1) +
+                encode('TASK_BLOCK', timestamp=2, task_id=1, state=2,
+                       object=0x20001000) +
+                encode('TASK_SWITCH', timestamp=2, from_id=1, to_id=0) +
+                encode('TASK_WAKE', timestamp=5, task_id=1, exception=16 + 37) +
+                encode('TASK_SWITCH', timestamp=5, from_id=0, to_id=1) +
+                encode('TASK_BLOCK', timestamp=6, task_id=1, state=4,
+                       object=0) +
+                encode('SYSCALL_GETPID'))
+
+        trace, writer, _ = convert(data, tick_us=10.0)
+
+        blocks = trace_events(trace, 'X', 'waiting for mailbox')
+        self.assertEqual(len(blocks), 1)
+        self.assertEqual(blocks[0]['ts'], 20.0)
+        self.assertEqual(blocks[0]['dur'], 30.0)
+        self.assertEqual(blocks[0]['args']['object'], '0x20001000')
+        self.assertEqual(blocks[0]['args']['woken by'], 'IRQ 37')
+
+        wakes = trace_events(trace, 'i', 'wake')
+        self.assertEqual(len(wakes), 1)
+        self.assertEqual(wakes[0]['pid'], diag_trace.IRQS_PID)
+
+        # The sleep is still open at the end, and the syscall without a
+        # timestamp is placed on the running task.
+        self.assertEqual(len(trace_events(trace, 'X', 'sleeping')), 1)
+
+        getpid = trace_events(trace, 'i', 'SYSCALL_GETPID')
+        self.assertEqual(getpid[0]['tid'], 1)
+        self.assertEqual(getpid[0]['cat'], 'syscall')
+        self.assertEqual(getpid[0]['ts'], 60.0)
+
+        self.assertEqual(writer.stats[1].num_blocks, 2)
+
+    def test_compact_timestamps(self):
+        # 16 MHz and a shift of 4 give one microsecond per unit.
+        data = (encode('TRACE_CLOCK', frequency=16000000, shift=4) +
+                encode_compact('TASK_SWITCH', 1000, 0, 1) +
+                encode_compact('TASK_SWITCH', 1, 1, 2) +
+                encode_compact('TASK_SWITCH', 2500, 2, 1))
+
+        trace, _, _ = convert(data)
+
+        runs = trace_events(trace, 'X', 'running')
+        self.assertEqual([(run['tid'], run['ts'], run['dur']) for run in runs],
+                         [(1, 1000.0, 1.0), (2, 1001.0, 2500.0)])
+
+    def test_main(self):
+        data = (encode('TASK_SWITCH', timestamp=1, from_id=0, to_id=1) +
+                encode('TASK_SWITCH', timestamp=3, from_id=1, to_id=0))
+
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            input_path = os.path.join(tmp_dir, 'capture.bin')
+            output_path = os.path.join(tmp_dir, 'trace.json')
+
+            with open(input_path, 'wb') as input_file:
+                input_file.write(data)
+
+            stdout = io.StringIO()
+            old_stdout = sys.stdout
+            sys.stdout = stdout
+
+            try:
+                ret = diag_trace.main([CONFIG_PATH, input_path,
+                                       '-o', output_path,
+                                       '--task-name', '1=uart'])
+            finally:
+                sys.stdout = old_stdout
+
+            self.assertEqual(ret, 0)
+            self.assertIn('uart', stdout.getvalue())
+
+            with open(output_path) as output_file:
+                trace = json.load(output_file)
+
+            self.assertEqual(len(trace_events(trace, 'X', 'running')), 1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,791 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS mailboxes.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <mouros/mailbox.h>
+#include <mouros/char_buffer.h>
+#include <mouros/mailbox_pow2.h>
+#include <mouros/mailbox_mpmc.h>
+#include <mouros/msg_queue.h>
+#include <mouros/frame_queue.h>
+#include <mouros/fd.h>
+#include <mouros/tasks.h>
+
+#include "scheduler.h"
+#include "mailbox_notify.h"
+
+extern void (*stub_task_yield_hook)(void);
+
+struct test_msg
+{
+	uint32_t seq;
+	uint16_t payload;
+};
+
+OS_MAILBOX_POW2_TYPED(test_fifo, struct test_msg)
+
+static void pow2_full_capacity_test(void **state)
+{
+	(void) state;
+
+	mailbox_pow2_t mb;
+
+	uint8_t num_msgs = 8;
+	struct test_msg buf[num_msgs];
+
+	os_mailbox_pow2_init(&mb, buf, num_msgs, sizeof(struct test_msg), NULL);
+
+	// All the slots should be usable.
+	for (uint32_t i = 0; i < num_msgs; i++) {
+		struct test_msg msg = { .seq = i, .payload = (uint16_t) (i * 3) };
+		assert_true(os_mailbox_pow2_write(&mb, &msg));
+	}
+
+	struct test_msg extra = { .seq = 100, .payload = 0 };
+	assert_false(os_mailbox_pow2_write(&mb, &extra));
+	assert_int_equal(os_mailbox_pow2_count(&mb), num_msgs);
+
+	for (uint32_t i = 0; i < num_msgs; i++) {
+		struct test_msg msg;
+		assert_true(os_mailbox_pow2_read(&mb, &msg));
+		assert_int_equal(msg.seq, i);
+		assert_int_equal(msg.payload, i * 3);
+	}
+
+	struct test_msg msg;
+	assert_false(os_mailbox_pow2_read(&mb, &msg));
+	assert_int_equal(os_mailbox_pow2_count(&mb), 0);
+}
+
+static void pow2_counter_wrap_test(void **state)
+{
+	(void) state;
+
+	mailbox_pow2_t mb;
+	char buf[4];
+
+	os_mailbox_pow2_init(&mb, buf, 4, 1, NULL);
+
+	// Start right before the free running counters overflow.
+	mb.read_cnt = UINT32_MAX - 2;
+	mb.write_cnt = UINT32_MAX - 2;
+
+	const char in[] = "abcdefgh";
+	assert_int_equal(os_mailbox_pow2_write_multiple(&mb, in, 8), 4);
+	assert_int_equal(os_mailbox_pow2_count(&mb), 4);
+
+	char out[8] = { 0 };
+	assert_int_equal(os_mailbox_pow2_read_multiple(&mb, out, 2), 2);
+	assert_memory_equal(out, "ab", 2);
+
+	assert_int_equal(os_mailbox_pow2_write_multiple(&mb, &in[4], 4), 2);
+
+	assert_int_equal(os_mailbox_pow2_read_multiple(&mb, out, 8), 4);
+	assert_memory_equal(out, "cdef", 4);
+	assert_int_equal(os_mailbox_pow2_count(&mb), 0);
+}
+
+static uint32_t data_added_calls = 0;
+
+static void data_added(void)
+{
+	data_added_calls++;
+}
+
+static void pow2_typed_test(void **state)
+{
+	(void) state;
+
+	mailbox_pow2_t mb;
+	struct test_msg buf[2];
+
+	data_added_calls = 0;
+
+	test_fifo_init(&mb, buf, 2, data_added);
+
+	struct test_msg msg = { .seq = 7, .payload = 0xbeef };
+	assert_true(test_fifo_write(&mb, &msg));
+	assert_true(test_fifo_write(&mb, &msg));
+	assert_false(test_fifo_write(&mb, &msg));
+	assert_int_equal(data_added_calls, 2);
+
+	struct test_msg out;
+	assert_true(test_fifo_read(&mb, &out));
+	assert_int_equal(out.seq, 7);
+	assert_int_equal(out.payload, 0xbeef);
+}
+
+static void pow2_bad_size_test(void **state)
+{
+	(void) state;
+
+	mailbox_pow2_t mb;
+	uint8_t buf[6];
+
+	expect_assert_failure(os_mailbox_pow2_init(&mb, buf, 6, 1, NULL));
+	expect_assert_failure(os_mailbox_pow2_init(&mb, buf, 0, 1, NULL));
+}
+
+static void mpmc_single_thread_test(void **state)
+{
+	(void) state;
+
+	mailbox_mpmc_t mb;
+	uint32_t buf[OS_MAILBOX_MPMC_BUF_SIZE(4, 3) / sizeof(uint32_t)];
+
+	os_mailbox_mpmc_init(&mb, buf, 4, 3, NULL);
+
+	// Every slot is usable.
+	const uint8_t in[] = "abcdefghijklmno";
+	assert_int_equal(os_mailbox_mpmc_write_multiple(&mb, in, 5), 4);
+
+	uint8_t out[16] = { 0 };
+	assert_true(os_mailbox_mpmc_read(&mb, out));
+	assert_memory_equal(out, "abc", 3);
+
+	// Wrap around the slot buffer a couple of times.
+	for (uint32_t i = 0; i < 10; i++) {
+		assert_true(os_mailbox_mpmc_write(&mb, &in[(i % 5) * 3]));
+		assert_false(os_mailbox_mpmc_write(&mb, in));
+
+		assert_true(os_mailbox_mpmc_read(&mb, out));
+	}
+
+	assert_int_equal(os_mailbox_mpmc_read_multiple(&mb, out, 5), 3);
+	assert_false(os_mailbox_mpmc_read(&mb, out));
+}
+
+#define STRESS_PRODUCERS 4
+#define STRESS_CONSUMERS 4
+#define STRESS_MSGS_PER_PRODUCER 100000
+
+static mailbox_mpmc_t stress_mb;
+static uint32_t stress_received[STRESS_PRODUCERS];
+static uint32_t stress_errors = 0;
+static uint32_t stress_total = 0;
+
+static void *stress_producer(void *arg)
+{
+	uint32_t producer = (uint32_t) (uintptr_t) arg;
+
+	for (uint32_t i = 0; i < STRESS_MSGS_PER_PRODUCER; i++) {
+		uint32_t msg[2] = { producer, i };
+
+		while (!os_mailbox_mpmc_write(&stress_mb, msg));
+	}
+
+	return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+	(void) arg;
+
+	uint32_t last_seen[STRESS_PRODUCERS];
+	for (uint32_t i = 0; i < STRESS_PRODUCERS; i++) {
+		last_seen[i] = UINT32_MAX;
+	}
+
+	while (__atomic_load_n(&stress_total, __ATOMIC_ACQUIRE) <
+	       STRESS_PRODUCERS * STRESS_MSGS_PER_PRODUCER) {
+		uint32_t msg[2];
+
+		if (!os_mailbox_mpmc_read(&stress_mb, msg)) {
+			continue;
+		}
+
+		// Messages from a single producer must arrive in order.
+		if (msg[0] >= STRESS_PRODUCERS ||
+		    (last_seen[msg[0]] != UINT32_MAX &&
+		     msg[1] <= last_seen[msg[0]])) {
+			__atomic_fetch_add(&stress_errors, 1, __ATOMIC_ACQ_REL);
+		} else {
+			last_seen[msg[0]] = msg[1];
+			__atomic_fetch_add(&stress_received[msg[0]], 1,
+			                   __ATOMIC_ACQ_REL);
+		}
+
+		__atomic_fetch_add(&stress_total, 1, __ATOMIC_ACQ_REL);
+	}
+
+	return NULL;
+}
+
+static void mpmc_stress_test(void **state)
+{
+	(void) state;
+
+	static uint32_t buf[OS_MAILBOX_MPMC_BUF_SIZE(64, 8) / sizeof(uint32_t)];
+
+	os_mailbox_mpmc_init(&stress_mb, buf, 64, 8, NULL);
+
+	pthread_t producers[STRESS_PRODUCERS];
+	pthread_t consumers[STRESS_CONSUMERS];
+
+	for (uint32_t i = 0; i < STRESS_CONSUMERS; i++) {
+		pthread_create(&consumers[i], NULL, stress_consumer, NULL);
+	}
+
+	for (uint32_t i = 0; i < STRESS_PRODUCERS; i++) {
+		pthread_create(&producers[i], NULL, stress_producer,
+		               (void *) (uintptr_t) i);
+	}
+
+	for (uint32_t i = 0; i < STRESS_PRODUCERS; i++) {
+		pthread_join(producers[i], NULL);
+	}
+
+	for (uint32_t i = 0; i < STRESS_CONSUMERS; i++) {
+		pthread_join(consumers[i], NULL);
+	}
+
+	assert_int_equal(stress_errors, 0);
+
+	for (uint32_t i = 0; i < STRESS_PRODUCERS; i++) {
+		assert_int_equal(stress_received[i], STRESS_MSGS_PER_PRODUCER);
+	}
+}
+
+static void msg_queue_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	uint64_t backing_mem[4][4];
+
+	os_pool_alloc_init(&pool, backing_mem, sizeof(backing_mem[0]), 4);
+
+	msg_queue_t queue;
+	void *ptr_buf[4];
+
+	os_msg_queue_init(&queue, ptr_buf, 4, &pool, NULL);
+
+	// The block is passed by pointer, not copied.
+	uint64_t *msg = os_msg_queue_alloc(&queue);
+	assert_non_null(msg);
+	msg[0] = 0x1122334455667788;
+
+	assert_true(os_msg_queue_send(&queue, msg));
+
+	uint64_t *received = os_msg_queue_receive(&queue);
+	assert_ptr_equal(received, msg);
+	assert_int_equal(received[0], 0x1122334455667788);
+	assert_null(os_msg_queue_receive(&queue));
+
+	os_msg_queue_free(&queue, received);
+
+	// The freed block is the first one to be reused.
+	assert_ptr_equal(os_msg_queue_alloc(&queue), msg);
+}
+
+static void msg_refcount_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	uint8_t backing_mem[2][OS_MSG_BLOCK_SIZE(16)]
+		__attribute__((aligned(8)));
+
+	os_pool_alloc_init(&pool, backing_mem, sizeof(backing_mem[0]), 2);
+
+	msg_queue_t queues[3];
+	void *ptr_bufs[3][2];
+
+	for (uint32_t i = 0; i < 3; i++) {
+		os_msg_queue_init(&queues[i], ptr_bufs[i], 2, &pool, NULL);
+	}
+
+	// Fill up the last queue, so the fan-out to it fails.
+	void *filler = os_msg_alloc(&pool);
+	assert_true(os_msg_queue_send(&queues[2], filler));
+
+	uint8_t *msg = os_msg_alloc(&pool);
+	assert_non_null(msg);
+	assert_null(os_msg_alloc(&pool));
+
+	msg_queue_t *targets[] = { &queues[0], &queues[1], &queues[2] };
+	assert_int_equal(os_msg_queue_send_multi(targets, 3, msg), 2);
+
+	// The block only returns to the pool after both receivers released it.
+	os_msg_release(os_msg_queue_receive(&queues[0]));
+	assert_null(os_msg_alloc(&pool));
+
+	os_msg_release(os_msg_queue_receive(&queues[1]));
+	assert_ptr_equal(os_msg_alloc(&pool), msg);
+}
+
+static void select_ready_test(void **state)
+{
+	(void) state;
+
+	task_t task;
+	current_task = &task;
+
+	mailbox_t mbs[3];
+	char bufs[3][4];
+
+	for (uint32_t i = 0; i < 3; i++) {
+		os_mailbox_init(&mbs[i], bufs[i], 4, 1, NULL);
+	}
+
+	mailbox_t *set[] = { &mbs[0], &mbs[1], &mbs[2] };
+
+	assert_int_equal(os_mailbox_poll(set, 3), 0);
+
+	char ch = 'x';
+	assert_true(os_mailbox_write(&mbs[1], &ch));
+	assert_true(os_mailbox_write(&mbs[2], &ch));
+
+	assert_int_equal(os_mailbox_poll(set, 3), 0b110);
+
+	// Data is available, so select mustn't block and mustn't leave the task
+	// registered with any of the mailboxes.
+	mbs[0].waiting_task = &task;
+	assert_int_equal(os_mailbox_select(set, 3), 0b110);
+	assert_null(mbs[0].waiting_task);
+
+	expect_assert_failure(os_mailbox_poll(set, 33));
+
+	current_task = NULL;
+}
+
+static void select_wakeup_test(void **state)
+{
+	(void) state;
+
+	task_t task;
+
+	mailbox_t mbs[2];
+	char bufs[2][4];
+
+	for (uint32_t i = 0; i < 2; i++) {
+		os_mailbox_init(&mbs[i], bufs[i], 4, 1, NULL);
+		mbs[i].waiting_task = &task;
+	}
+
+	task.state = TASK_WAITING_FOR_MAILBOX;
+
+	// The first write wakes the waiting task up.
+	expect_value(sched_wake_task, task, &task);
+
+	char ch = 'x';
+	assert_true(os_mailbox_write(&mbs[0], &ch));
+	assert_null(mbs[0].waiting_task);
+	assert_int_equal(task.state, TASK_RUNNABLE);
+
+	// The task is no longer waiting, so it mustn't be woken up again.
+	assert_int_equal(os_mailbox_write_multiple(&mbs[1], "ab", 2), 2);
+	assert_null(mbs[1].waiting_task);
+}
+
+static void frame_queue_wrap_test(void **state)
+{
+	(void) state;
+
+	frame_queue_t queue;
+	uint8_t buf[16];
+
+	os_frame_queue_init(&queue, buf, sizeof(buf), NULL);
+
+	assert_true(os_frame_queue_write(&queue, "abcde", 5));
+	assert_true(os_frame_queue_write(&queue, "fgh", 3));
+
+	// 12 bytes used, a 3 byte frame doesn't fit before the end.
+	assert_false(os_frame_queue_write(&queue, "ijk", 3));
+
+	uint16_t len;
+	const char *frame = os_frame_queue_peek(&queue, &len);
+	assert_int_equal(len, 5);
+	assert_memory_equal(frame, "abcde", 5);
+	os_frame_queue_consume(&queue);
+
+	// Now the frame wraps to the beginning of the buffer.
+	assert_true(os_frame_queue_write(&queue, "ijk", 3));
+
+	// The span ends at the wrap point.
+	uint32_t span_len;
+	const uint8_t *span = os_frame_queue_peek_span(&queue, &span_len);
+	assert_int_equal(span_len, 5);
+	assert_memory_equal(span, "\x03\x00" "fgh", 5);
+	os_frame_queue_consume_span(&queue, span_len);
+
+	char out[8];
+	len = 2;
+	assert_false(os_frame_queue_read(&queue, out, &len));
+	assert_int_equal(len, 3);
+
+	len = sizeof(out);
+	assert_true(os_frame_queue_read(&queue, out, &len));
+	assert_int_equal(len, 3);
+	assert_memory_equal(out, "ijk", 3);
+
+	assert_null(os_frame_queue_peek(&queue, &len));
+	assert_null(os_frame_queue_peek_span(&queue, &span_len));
+}
+
+static void frame_queue_model_test(void **state)
+{
+	(void) state;
+
+	frame_queue_t queue;
+	uint8_t buf[61];
+
+	os_frame_queue_init(&queue, buf, sizeof(buf), NULL);
+
+	// Reference FIFO of frame lengths. The frame contents are derived from
+	// the frame sequence number.
+	uint16_t model_len[64];
+	uint32_t model_head = 0;
+	uint32_t model_tail = 0;
+	uint32_t total_bytes = 0;
+
+	srand(1234);
+
+	for (uint32_t i = 0; i < 20000; i++) {
+		if (rand() % 2 == 0) {
+			uint16_t len = (uint16_t) (rand() % 20);
+			uint8_t *frame = os_frame_queue_reserve(&queue, len);
+
+			if (frame == NULL) {
+				// An empty queue always has room for a
+				// frame of up to half the buffer.
+				assert_int_not_equal(model_head, model_tail);
+				continue;
+			}
+
+			for (uint16_t j = 0; j < len; j++) {
+				frame[j] = (uint8_t) (model_tail + j);
+			}
+
+			os_frame_queue_commit(&queue);
+
+			model_len[model_tail % 64] = len;
+			model_tail++;
+			total_bytes += 2u + len;
+
+		} else {
+			uint16_t len;
+			const uint8_t *frame = os_frame_queue_peek(&queue, &len);
+
+			if (model_head == model_tail) {
+				assert_null(frame);
+				continue;
+			}
+
+			assert_non_null(frame);
+			assert_int_equal(len, model_len[model_head % 64]);
+
+			for (uint16_t j = 0; j < len; j++) {
+				assert_int_equal(frame[j],
+				                 (uint8_t) (model_head + j));
+			}
+
+			os_frame_queue_consume(&queue);
+
+			model_head++;
+		}
+	}
+
+	// Make sure the buffer was wrapped around plenty of times.
+	assert_true(total_bytes > 100 * sizeof(buf));
+}
+
+/**
+ * Host-side stand-in for a DMA engine. Moves at most max_len bytes between the
+ * buffer and the supplied memory in one go, like a single DMA transfer.
+ */
+static uint32_t mock_dma_tx(mailbox_t *mb, char *dest, uint32_t max_len)
+{
+	const char *span;
+	uint32_t len = os_char_buffer_read_span(mb, &span);
+
+	if (len > max_len) {
+		len = max_len;
+	}
+
+	memcpy(dest, span, len);
+
+	// Transfer complete interrupt.
+	os_char_buffer_read_commit(mb, len);
+
+	return len;
+}
+
+static uint32_t mock_dma_rx(mailbox_t *mb, const char *src, uint32_t max_len)
+{
+	char *span;
+	uint32_t len = os_char_buffer_write_span(mb, &span);
+
+	if (len > max_len) {
+		len = max_len;
+	}
+
+	memcpy(span, src, len);
+
+	// Transfer complete interrupt.
+	os_char_buffer_write_commit(mb, len);
+
+	return len;
+}
+
+static void span_dma_test(void **state)
+{
+	(void) state;
+
+	mailbox_t mb;
+	char buf[8];
+
+	data_added_calls = 0;
+
+	os_char_buffer_init(&mb, buf, sizeof(buf), data_added);
+
+	// One slot always stays empty.
+	assert_int_equal(mock_dma_rx(&mb, "abcdefghij", 10), 7);
+	assert_int_equal(data_added_calls, 1);
+
+	char out[32] = { 0 };
+	assert_int_equal(mock_dma_tx(&mb, out, 5), 5);
+	assert_memory_equal(out, "abcde", 5);
+
+	// The free space wraps, so it takes two transfers to fill it.
+	assert_int_equal(mock_dma_rx(&mb, "klmno", 5), 1);
+	assert_int_equal(mock_dma_rx(&mb, "lmno", 4), 4);
+	assert_int_equal(mock_dma_rx(&mb, "xyz", 3), 0);
+	assert_int_equal(data_added_calls, 3);
+
+	// Likewise for the stored data.
+	assert_int_equal(mock_dma_tx(&mb, out, 32), 3);
+	assert_memory_equal(out, "fgk", 3);
+	assert_int_equal(mock_dma_tx(&mb, out, 32), 4);
+	assert_memory_equal(out, "lmno", 4);
+	assert_int_equal(mock_dma_tx(&mb, out, 32), 0);
+
+	// The regular API sees the same data.
+	assert_int_equal(mock_dma_rx(&mb, "pq", 2), 2);
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, 32), 2);
+	assert_memory_equal(out, "pq", 2);
+}
+
+static void notify_policy_test(void **state)
+{
+	(void) state;
+
+	mailbox_t mb;
+	mailbox_notify_t notify;
+	char buf[16];
+
+	data_added_calls = 0;
+	os_tick_count = 100;
+
+	os_char_buffer_init(&mb, buf, sizeof(buf), data_added);
+	os_mailbox_set_notify(&mb, &notify, 8, '\n', 5);
+
+	// Below the threshold, writes don't notify.
+	os_char_buffer_write_str(&mb, "abc");
+	assert_int_equal(data_added_calls, 0);
+
+	// The delimiter does.
+	os_char_buffer_write_ch(&mb, '\n');
+	assert_int_equal(data_added_calls, 1);
+
+	char out[16];
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, sizeof(out)), 4);
+
+	// So does reaching the threshold.
+	os_char_buffer_write_str(&mb, "0123456");
+	assert_int_equal(data_added_calls, 1);
+	os_char_buffer_write_ch(&mb, '7');
+	assert_int_equal(data_added_calls, 2);
+
+	// Staying above the threshold doesn't notify again.
+	os_char_buffer_write_ch(&mb, '8');
+	assert_int_equal(data_added_calls, 2);
+
+	// Going below it and crossing it again does.
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, 3), 3);
+	os_char_buffer_write_ch(&mb, '9');
+	assert_int_equal(data_added_calls, 2);
+	os_char_buffer_write_ch(&mb, 'a');
+	assert_int_equal(data_added_calls, 3);
+
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, sizeof(out)), 8);
+
+	// Pending data notifies after idle_ticks without writes. Every write
+	// restarts the timeout.
+	os_char_buffer_write_ch(&mb, 'x');
+	os_tick_count += 4;
+	mailbox_notify_tick();
+	os_char_buffer_write_ch(&mb, 'y');
+	os_tick_count += 4;
+	mailbox_notify_tick();
+	assert_int_equal(data_added_calls, 3);
+	os_tick_count += 1;
+	mailbox_notify_tick();
+	assert_int_equal(data_added_calls, 4);
+
+	// The timeout fires only once.
+	os_tick_count += 10;
+	mailbox_notify_tick();
+	assert_int_equal(data_added_calls, 4);
+
+	// Data consumed before the timeout doesn't notify.
+	os_char_buffer_write_ch(&mb, 'z');
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, sizeof(out)), 3);
+	os_tick_count += 10;
+	mailbox_notify_tick();
+	assert_int_equal(data_added_calls, 4);
+
+	// Threshold 0 means a full mailbox.
+	os_mailbox_set_notify(&mb, &notify, 0, OS_MAILBOX_NO_DELIMITER, 0);
+	assert_int_equal(os_char_buffer_write_buf(&mb, "0123456789abcdef", 16),
+	                 15);
+	assert_int_equal(data_added_calls, 5);
+	assert_int_equal(os_char_buffer_read_buf(&mb, out, sizeof(out)), 15);
+
+	// Removing the policy restores a notification per write.
+	os_mailbox_set_notify(&mb, NULL, 0, OS_MAILBOX_NO_DELIMITER, 0);
+	os_char_buffer_write_str(&mb, "ab");
+	assert_int_equal(data_added_calls, 7);
+}
+
+/** The buffer drained by drain_on_yield(). */
+static mailbox_t *drain_mb = NULL;
+/** The data drained by drain_on_yield(). */
+static char drained[16];
+/** The number of bytes in drained. */
+static uint32_t num_drained = 0;
+
+static void drain_on_yield(void)
+{
+	// The driver empties the buffer while the writer is blocked.
+	assert_int_equal(current_task->state, TASK_WAITING_FOR_MAILBOX);
+
+	num_drained += os_char_buffer_read_buf(drain_mb, &drained[num_drained],
+	                                       sizeof(drained) - num_drained);
+}
+
+static void fd_blocking_write_test(void **state)
+{
+	(void) state;
+
+	mailbox_t tx;
+	char tx_buf[8];
+
+	os_char_buffer_init(&tx, tx_buf, sizeof(tx_buf), NULL);
+	assert_true(os_fd_set(STDOUT_FILENO, NULL, &tx, 0));
+
+	// Without a task to block, a write to a full buffer returns early.
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "hello world", 11), 7);
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "x", 1), -EAGAIN);
+
+	struct tcb task = { .state = TASK_RUNNING };
+	current_task = &task;
+
+	drain_mb = &tx;
+	num_drained = 0;
+	stub_task_yield_hook = drain_on_yield;
+
+	// The writer blocks until the buffer is read, and the read wakes it.
+	expect_value(sched_wake_task, task, &task);
+	expect_value(sched_wake_task, task, &task);
+
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "0123456789", 10), 10);
+	assert_null(tx.waiting_writers);
+
+	stub_task_yield_hook = NULL;
+	current_task = NULL;
+
+	char out[8];
+	uint32_t num_out = os_char_buffer_read_buf(&tx, out, sizeof(out));
+
+	assert_int_equal(num_drained + num_out, 17);
+	assert_memory_equal(drained, "hello w0123456", 14);
+	assert_memory_equal(out, "789", 3);
+
+	assert_true(os_fd_close(STDOUT_FILENO));
+}
+
+static void fd_table_test(void **state)
+{
+	(void) state;
+
+	mailbox_t rx, tx;
+	char rx_buf[8], tx_buf[8];
+
+	os_char_buffer_init(&rx, rx_buf, sizeof(rx_buf), NULL);
+	os_char_buffer_init(&tx, tx_buf, sizeof(tx_buf), NULL);
+
+	assert_false(os_fd_is_open(STDOUT_FILENO));
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "a", 1), -EBADF);
+
+	assert_true(os_fd_set(STDOUT_FILENO, NULL, &tx, OS_FD_NONBLOCK));
+	assert_false(os_fd_set(OS_FD_MAX_FDS, NULL, &tx, 0));
+
+	// Non-blocking writes are partial once the buffer fills up.
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "hello world", 11), 7);
+	assert_int_equal(os_fd_write(STDOUT_FILENO, "x", 1), -EAGAIN);
+	assert_int_equal(os_fd_read(STDOUT_FILENO, rx_buf, 1), -EBADF);
+
+	char out[16];
+	assert_int_equal(os_char_buffer_read_buf(&tx, out, sizeof(out)), 7);
+	assert_memory_equal(out, "hello w", 7);
+
+	// User descriptors are allocated above stderr.
+	int fd = os_fd_open(&rx, NULL, OS_FD_NONBLOCK);
+	assert_int_equal(fd, STDERR_FILENO + 1);
+	assert_int_equal(os_fd_open(&rx, NULL, 0), STDERR_FILENO + 2);
+
+	assert_int_equal(os_fd_read(fd, out, sizeof(out)), -EAGAIN);
+	os_char_buffer_write_str(&rx, "abc");
+	assert_int_equal(os_fd_read(fd, out, 2), 2);
+	assert_memory_equal(out, "ab", 2);
+
+	// Blocking reads return whatever is available.
+	assert_int_equal(os_fd_read(fd + 1, out, sizeof(out)), 1);
+	assert_int_equal(out[0], 'c');
+
+	assert_true(os_fd_close(fd));
+	assert_true(os_fd_close(fd + 1));
+	assert_true(os_fd_close(STDOUT_FILENO));
+	assert_false(os_fd_close(fd));
+	assert_false(os_fd_is_open(fd));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(pow2_full_capacity_test),
+		cmocka_unit_test(pow2_counter_wrap_test),
+		cmocka_unit_test(pow2_typed_test),
+		cmocka_unit_test(pow2_bad_size_test),
+		cmocka_unit_test(mpmc_single_thread_test),
+		cmocka_unit_test(mpmc_stress_test),
+		cmocka_unit_test(msg_queue_test),
+		cmocka_unit_test(msg_refcount_test),
+		cmocka_unit_test(select_ready_test),
+		cmocka_unit_test(select_wakeup_test),
+		cmocka_unit_test(frame_queue_wrap_test),
+		cmocka_unit_test(frame_queue_model_test),
+		cmocka_unit_test(span_dma_test),
+		cmocka_unit_test(notify_policy_test),
+		cmocka_unit_test(fd_table_test),
+		cmocka_unit_test(fd_blocking_write_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
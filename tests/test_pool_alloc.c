@@ -11,8 +11,16 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <mouros/pool_alloc.h>
+#include <mouros/tasks.h>
+
+#include "scheduler.h"
+
+extern void (*stub_task_yield_hook)(void);
 
 struct test_struct
 {
@@ -63,6 +71,42 @@ static void alloc_dealloc_test(void **state)
 	assert_ptr_equal(os_pool_alloc_take(&pool), NULL);
 }
 
+static void lazy_init_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	uint64_t backing_memory[8];
+
+	memset(backing_memory, 0xaa, sizeof(backing_memory));
+
+	os_pool_alloc_init(&pool, backing_memory, sizeof(uint64_t), 8);
+
+	// The backing memory isn't touched by the initialization.
+	for (uint32_t i = 0; i < 8; i++) {
+		assert_true(backing_memory[i] == 0xaaaaaaaaaaaaaaaa);
+	}
+
+	// Given blocks are reused before any unused ones, like with a fully
+	// built free list.
+	assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[0]);
+	assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[1]);
+
+	os_pool_alloc_give(&pool, &backing_memory[0]);
+	assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[0]);
+	assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[2]);
+
+	for (uint32_t i = 3; i < 8; i++) {
+		assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[i]);
+	}
+
+	assert_null(os_pool_alloc_take(&pool));
+
+	os_pool_alloc_give(&pool, &backing_memory[5]);
+	assert_ptr_equal(os_pool_alloc_take(&pool), &backing_memory[5]);
+	assert_null(os_pool_alloc_take(&pool));
+}
+
 static void small_block_test(void **state)
 {
 	(void) state;
@@ -73,11 +117,393 @@ static void small_block_test(void **state)
 	expect_assert_failure(os_pool_alloc_init(&pool, backing_memory, 2, 10));
 }
 
+static void stats_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	pool_alloc_stats_t stats;
+	uint64_t backing_memory[4];
+
+	os_pool_alloc_init(&pool, backing_memory, sizeof(uint64_t), 4);
+
+	os_pool_alloc_get_stats(&pool, &stats);
+	assert_int_equal(stats.capacity, 4);
+	assert_int_equal(stats.num_free, 4);
+	assert_int_equal(stats.min_free, 4);
+	assert_int_equal(stats.num_failures, 0);
+	assert_int_equal(stats.max_used, 0);
+
+	void *blocks[4];
+	for (uint32_t i = 0; i < 4; i++) {
+		blocks[i] = os_pool_alloc_take(&pool);
+	}
+
+	assert_null(os_pool_alloc_take(&pool));
+	assert_null(os_pool_alloc_take(&pool));
+
+	for (uint32_t i = 0; i < 3; i++) {
+		os_pool_alloc_give(&pool, blocks[i]);
+	}
+
+	os_pool_alloc_get_stats(&pool, &stats);
+	assert_int_equal(stats.num_free, 3);
+	assert_int_equal(stats.min_free, 0);
+	assert_int_equal(stats.num_failures, 2);
+	assert_int_equal(stats.max_used, 4);
+
+	// The low-water mark restarts from the current level.
+	os_pool_alloc_reset_stats(&pool);
+	blocks[0] = os_pool_alloc_take(&pool);
+	os_pool_alloc_give(&pool, blocks[0]);
+
+	os_pool_alloc_get_stats(&pool, &stats);
+	assert_int_equal(stats.num_free, 3);
+	assert_int_equal(stats.min_free, 2);
+	assert_int_equal(stats.num_failures, 0);
+	assert_int_equal(stats.max_used, 2);
+}
+
+static void batch_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	pool_alloc_stats_t stats;
+	uint64_t backing_memory[8];
+	void *blocks[8];
+
+	os_pool_alloc_init(&pool, backing_memory, sizeof(uint64_t), 8);
+
+	// Unused blocks are handed out in address order.
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, 3), 3);
+	for (uint32_t i = 0; i < 3; i++) {
+		assert_ptr_equal(blocks[i], &backing_memory[i]);
+	}
+
+	os_pool_alloc_give_n(&pool, blocks, 3);
+
+	// The given blocks come back first, in the order they were given,
+	// followed by the unused ones.
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, 5), 5);
+	for (uint32_t i = 0; i < 5; i++) {
+		assert_ptr_equal(blocks[i], &backing_memory[i]);
+	}
+
+	// Only three blocks are left.
+	assert_int_equal(os_pool_alloc_take_n(&pool, &blocks[5], 4), 3);
+	for (uint32_t i = 5; i < 8; i++) {
+		assert_ptr_equal(blocks[i], &backing_memory[i]);
+	}
+
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, 1), 0);
+	assert_null(os_pool_alloc_take(&pool));
+
+	// Give back a pre-linked chain of blocks 6 -> 2 -> 4.
+	*(void **) &backing_memory[6] = &backing_memory[2];
+	*(void **) &backing_memory[2] = &backing_memory[4];
+	os_pool_alloc_give_chain(&pool, &backing_memory[6], &backing_memory[4],
+	                         3);
+
+	os_pool_alloc_give(&pool, &backing_memory[7]);
+
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, 8), 4);
+	assert_ptr_equal(blocks[0], &backing_memory[7]);
+	assert_ptr_equal(blocks[1], &backing_memory[6]);
+	assert_ptr_equal(blocks[2], &backing_memory[2]);
+	assert_ptr_equal(blocks[3], &backing_memory[4]);
+
+	// Taking and giving nothing leaves the pool alone.
+	os_pool_alloc_give_n(&pool, blocks, 0);
+	os_pool_alloc_give_n(&pool, blocks, 4);
+
+	os_pool_alloc_get_stats(&pool, &stats);
+	assert_int_equal(stats.num_free, 4);
+	assert_int_equal(stats.min_free, 0);
+	assert_int_equal(stats.num_failures, 4);
+	assert_int_equal(stats.max_used, 8);
+}
+
+static void large_batch_test(void **state)
+{
+	(void) state;
+
+	pool_alloc_t pool;
+	uint64_t backing_memory[2 * OS_POOL_ALLOC_TAKE_BATCH + 3];
+	void *blocks[2 * OS_POOL_ALLOC_TAKE_BATCH + 3];
+	const uint32_t num_blocks = 2 * OS_POOL_ALLOC_TAKE_BATCH + 3;
+
+	os_pool_alloc_init(&pool, backing_memory, sizeof(uint64_t), num_blocks);
+
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, 3), 3);
+	os_pool_alloc_give_n(&pool, blocks, 3);
+
+	// Takes larger than a batch continue from the list of free blocks into
+	// the unused blocks, and end when both run out.
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, num_blocks + 1),
+	                 num_blocks);
+	for (uint32_t i = 0; i < num_blocks; i++) {
+		assert_ptr_equal(blocks[i], &backing_memory[i]);
+	}
+
+	// Batches taken only from the list of free blocks keep its order.
+	os_pool_alloc_give_n(&pool, blocks, num_blocks);
+
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, num_blocks),
+	                 num_blocks);
+	for (uint32_t i = 0; i < num_blocks; i++) {
+		assert_ptr_equal(blocks[i], &backing_memory[i]);
+	}
+
+	assert_null(os_pool_alloc_take(&pool));
+}
+
+static pool_alloc_t blocking_pool;
+static uint64_t blocking_mem[2];
+static void *blocking_given = NULL;
+
+static void give_on_yield(void)
+{
+	// Another task gives a block back while the current one is blocked.
+	os_pool_alloc_give(&blocking_pool, blocking_given);
+}
+
+static void blocking_take_test(void **state)
+{
+	(void) state;
+
+	struct tcb task = { .priority = 3, .state = TASK_RUNNING };
+	current_task = &task;
+	os_tick_count = 1000;
+
+	os_pool_alloc_init(&blocking_pool, blocking_mem, sizeof(uint64_t), 2);
+
+	void *first = os_pool_alloc_take_blocking(&blocking_pool, 10);
+	void *second = os_pool_alloc_take_blocking(&blocking_pool,
+	                                           OS_POOL_ALLOC_WAIT_FOREVER);
+	assert_non_null(first);
+	assert_non_null(second);
+
+	// A zero timeout doesn't block.
+	assert_null(os_pool_alloc_take_blocking(&blocking_pool, 0));
+
+	// The given block is handed directly to the waiting task.
+	blocking_given = first;
+	stub_task_yield_hook = give_on_yield;
+
+	expect_value(sched_add_to_sleepqueue, task, &task);
+	expect_value(sched_remove_from_sleepqueue, task, &task);
+	expect_value(sched_wake_task, task, &task);
+
+	assert_ptr_equal(os_pool_alloc_take_blocking(&blocking_pool, 10), first);
+	assert_int_equal(task.wakeup_time, 1010);
+	assert_int_equal(task.state, TASK_RUNNABLE);
+	assert_null(blocking_pool.first_waiting);
+	assert_null(os_pool_alloc_take(&blocking_pool));
+
+	// Nothing's given back before the timeout expires.
+	stub_task_yield_hook = NULL;
+
+	expect_value(sched_add_to_sleepqueue, task, &task);
+	expect_value(sched_remove_from_sleepqueue, task, &task);
+
+	assert_null(os_pool_alloc_take_blocking(&blocking_pool, 10));
+	assert_null(blocking_pool.first_waiting);
+
+	current_task = NULL;
+}
+
+static struct tcb *order_tasks[3];
+static uint32_t order_depth = 0;
+static bool order_checked = false;
+
+static void wait_next_on_yield(void)
+{
+	if (order_depth == 2) {
+		// All three tasks are waiting now.
+		order_checked =
+			blocking_pool.first_waiting == order_tasks[1] &&
+			order_tasks[1]->wait_next == order_tasks[2] &&
+			order_tasks[2]->wait_next == order_tasks[0] &&
+			order_tasks[0]->wait_next == NULL;
+		return;
+	}
+
+	// Another task starts waiting while the current one is blocked.
+	order_depth++;
+	current_task = order_tasks[order_depth];
+
+	os_pool_alloc_take_blocking(&blocking_pool, OS_POOL_ALLOC_WAIT_FOREVER);
+
+	order_depth--;
+	current_task = order_tasks[order_depth];
+}
+
+static void waiting_order_test(void **state)
+{
+	(void) state;
+
+	struct tcb low = { .priority = 5, .state = TASK_RUNNING };
+	struct tcb high = { .priority = 1, .state = TASK_RUNNING };
+	struct tcb high2 = { .priority = 1, .state = TASK_RUNNING };
+	uint64_t block;
+
+	os_pool_alloc_init(&blocking_pool, blocking_mem, sizeof(uint64_t), 1);
+	assert_non_null(os_pool_alloc_take(&blocking_pool));
+
+	// Waiting tasks are ordered by priority, and then by arrival.
+	order_tasks[0] = &low;
+	order_tasks[1] = &high;
+	order_tasks[2] = &high2;
+	current_task = &low;
+	stub_task_yield_hook = wait_next_on_yield;
+
+	// The nested takes return innermost first, and so leave the sleep queue.
+	expect_value(sched_remove_from_sleepqueue, task, &high2);
+	expect_value(sched_remove_from_sleepqueue, task, &high);
+	expect_value(sched_remove_from_sleepqueue, task, &low);
+	assert_null(os_pool_alloc_take_blocking(&blocking_pool,
+	                                        OS_POOL_ALLOC_WAIT_FOREVER));
+
+	stub_task_yield_hook = NULL;
+
+	assert_true(order_checked);
+	assert_null(blocking_pool.first_waiting);
+
+	// Blocks go to the waiting tasks in the same order.
+	low.state = TASK_WAITING_FOR_BLOCK;
+	high.state = TASK_WAITING_FOR_BLOCK;
+	high2.state = TASK_WAITING_FOR_BLOCK;
+	low.wait_next = NULL;
+	high2.wait_next = &low;
+	high.wait_next = &high2;
+	blocking_pool.first_waiting = &high;
+
+	struct tcb runner = { .priority = 10, .state = TASK_RUNNING };
+	current_task = &runner;
+
+	expect_value(sched_remove_from_sleepqueue, task, &high);
+	expect_value(sched_wake_task, task, &high);
+	os_pool_alloc_give(&blocking_pool, &block);
+
+	assert_ptr_equal(high.wait_result, &block);
+	assert_ptr_equal(blocking_pool.first_waiting, &high2);
+
+	// A task already woken up by its timeout isn't woken up again.
+	high2.state = TASK_RUNNABLE;
+	os_pool_alloc_give(&blocking_pool, blocking_mem);
+
+	assert_ptr_equal(high2.wait_result, blocking_mem);
+	assert_ptr_equal(blocking_pool.first_waiting, &low);
+	assert_null(low.wait_result);
+
+	current_task = NULL;
+}
+
+#define STRESS_THREADS 8
+#define STRESS_BLOCKS 16
+#define STRESS_ITERATIONS 200000
+
+struct stress_block {
+	uintptr_t next;
+	uint32_t owner;
+	uint32_t seq;
+};
+
+static pool_alloc_t stress_pool;
+static struct stress_block stress_mem[STRESS_BLOCKS];
+static uint32_t stress_errors = 0;
+
+static void *stress_thread(void *arg)
+{
+	uint32_t id = (uint32_t) (uintptr_t) arg;
+	struct stress_block *held[3];
+
+	for (uint32_t i = 0; i < STRESS_ITERATIONS; i++) {
+		uint32_t num_held = 0;
+
+		// Hold up to three blocks at once, so blocks get taken and
+		// given back in varying orders.
+		for (uint32_t j = 0; j <= i % 3; j++) {
+			struct stress_block *block = os_pool_alloc_take(&stress_pool);
+
+			if (block == NULL) {
+				break;
+			}
+
+			__atomic_store_n(&block->owner, id, __ATOMIC_RELAXED);
+			__atomic_store_n(&block->seq, i, __ATOMIC_RELAXED);
+
+			held[num_held++] = block;
+		}
+
+		// Nobody else may touch a block while it's taken.
+		for (uint32_t j = 0; j < num_held; j++) {
+			if (__atomic_load_n(&held[j]->owner, __ATOMIC_RELAXED) != id ||
+			    __atomic_load_n(&held[j]->seq, __ATOMIC_RELAXED) != i) {
+				__atomic_fetch_add(&stress_errors, 1, __ATOMIC_ACQ_REL);
+			}
+
+			os_pool_alloc_give(&stress_pool, held[j]);
+		}
+	}
+
+	return NULL;
+}
+
+static void stress_test(void **state)
+{
+	(void) state;
+
+	os_pool_alloc_init(&stress_pool,
+	                   stress_mem,
+	                   sizeof(struct stress_block),
+	                   STRESS_BLOCKS);
+
+	pthread_t threads[STRESS_THREADS];
+
+	for (uint32_t i = 0; i < STRESS_THREADS; i++) {
+		pthread_create(&threads[i], NULL, stress_thread,
+		               (void *) (uintptr_t) i);
+	}
+
+	for (uint32_t i = 0; i < STRESS_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	assert_int_equal(stress_errors, 0);
+
+	// All the blocks must be back in the pool, each exactly once.
+	bool seen[STRESS_BLOCKS] = { false };
+
+	for (uint32_t i = 0; i < STRESS_BLOCKS; i++) {
+		struct stress_block *block = os_pool_alloc_take(&stress_pool);
+
+		assert_non_null(block);
+		assert_false(seen[block - stress_mem]);
+
+		seen[block - stress_mem] = true;
+	}
+
+	assert_null(os_pool_alloc_take(&stress_pool));
+
+	pool_alloc_stats_t stats;
+	os_pool_alloc_get_stats(&stress_pool, &stats);
+	assert_int_equal(stats.num_free, 0);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(alloc_dealloc_test),
-		cmocka_unit_test(small_block_test)
+		cmocka_unit_test(lazy_init_test),
+		cmocka_unit_test(small_block_test),
+		cmocka_unit_test(stats_test),
+		cmocka_unit_test(batch_test),
+		cmocka_unit_test(large_batch_test),
+		cmocka_unit_test(blocking_take_test),
+		cmocka_unit_test(waiting_order_test),
+		cmocka_unit_test(stress_test)
 	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,138 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS sampling profiler.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <mouros/profile.h>
+
+#include "scheduler.h"
+#include "profile_sample.h"
+
+
+/**
+ * A saved task stack: R4-R11 followed by the exception frame R0-R3, R12, LR,
+ * PC, xPSR.
+ */
+static int task_stack[16];
+
+/** The task being sampled. */
+static struct tcb task = { .id = 4, .stack = task_stack };
+
+
+/**
+ * Runs num_ticks system ticks with the task running at pc.
+ */
+static void run_ticks(uint32_t pc, uint32_t num_ticks)
+{
+	task_stack[8 + 6] = (int) pc;
+
+	for (uint32_t i = 0; i < num_ticks; i++) {
+		profile_tick();
+	}
+}
+
+/**
+ * Reads and drops all the samples in the ring.
+ */
+static void drain(void)
+{
+	profile_sample_t sample;
+
+	while (os_profile_read(&sample, 1) == 1);
+}
+
+static void period_test(void **state)
+{
+	(void) state;
+
+	profile_sample_t samples[4];
+	profile_stats_t stats;
+
+	current_task = &task;
+
+	// Nothing is sampled before the profiler is started.
+	run_ticks(0x08000100, 10);
+	assert_int_equal(os_profile_read(samples, 4), 0);
+
+	os_profile_start(3);
+
+	run_ticks(0x08000100, 2);
+	assert_int_equal(os_profile_read(samples, 4), 0);
+
+	run_ticks(0x08000100, 1);
+	run_ticks(0x08000200, 3);
+	run_ticks(0x08000300, 2);
+
+	assert_int_equal(os_profile_read(samples, 4), 2);
+	assert_int_equal(samples[0].pc, 0x08000100);
+	assert_int_equal(samples[0].task_id, 4);
+	assert_int_equal(samples[1].pc, 0x08000200);
+
+	os_profile_stop();
+
+	run_ticks(0x08000300, 10);
+	assert_int_equal(os_profile_read(samples, 4), 0);
+
+	os_profile_get_stats(&stats);
+	assert_int_equal(stats.num_samples, 2);
+	assert_int_equal(stats.num_dropped, 0);
+	assert_int_equal(stats.num_pending, 0);
+
+	current_task = NULL;
+}
+
+static void overflow_test(void **state)
+{
+	(void) state;
+
+	profile_sample_t samples[4];
+	profile_stats_t before;
+	profile_stats_t after;
+
+	current_task = &task;
+	drain();
+	os_profile_get_stats(&before);
+
+	os_profile_start(1);
+
+	for (uint32_t i = 0; i < OS_PROFILE_RING_SIZE + 5; i++) {
+		run_ticks(0x08000000 + i * 2, 1);
+	}
+
+	os_profile_stop();
+	os_profile_get_stats(&after);
+
+	assert_int_equal(after.num_samples - before.num_samples,
+	                 OS_PROFILE_RING_SIZE);
+	assert_int_equal(after.num_dropped - before.num_dropped, 5);
+	assert_int_equal(after.num_pending, OS_PROFILE_RING_SIZE);
+
+	// The oldest samples are kept.
+	assert_int_equal(os_profile_read(samples, 2), 2);
+	assert_int_equal(samples[0].pc, 0x08000000);
+	assert_int_equal(samples[1].pc, 0x08000002);
+
+	drain();
+
+	current_task = NULL;
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(period_test),
+		cmocka_unit_test(overflow_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
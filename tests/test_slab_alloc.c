@@ -0,0 +1,194 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS slab allocator.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mouros/slab_alloc.h>
+
+static uint64_t mem_16[4][2];
+static uint64_t mem_64[2][8];
+static uint64_t mem_256[1][32];
+
+static uint32_t fallback_calls = 0;
+
+static void *fallback_alloc(uint32_t size)
+{
+	fallback_calls++;
+
+	return malloc(size);
+}
+
+static void fallback_free(void *ptr)
+{
+	fallback_calls++;
+
+	free(ptr);
+}
+
+static void *fallback_realloc(void *ptr, uint32_t size)
+{
+	fallback_calls++;
+
+	return realloc(ptr, size);
+}
+
+static void setup_slab(slab_alloc_t *slab)
+{
+	os_slab_alloc_init(slab);
+	os_slab_alloc_add_class(slab, mem_16, 16, 4);
+	os_slab_alloc_add_class(slab, mem_64, 64, 2);
+	os_slab_alloc_add_class(slab, mem_256, 256, 1);
+}
+
+static void size_class_test(void **state)
+{
+	(void) state;
+
+	slab_alloc_t slab;
+	setup_slab(&slab);
+
+	uint8_t *block = os_slab_alloc_take(&slab, 1);
+	assert_true(block >= (uint8_t *) mem_16 &&
+	            block < (uint8_t *) mem_16 + sizeof(mem_16));
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 16);
+	os_slab_alloc_give(&slab, block);
+
+	// The 32 byte class doesn't exist, so 17 bytes come from the 64 byte one.
+	block = os_slab_alloc_take(&slab, 17);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 64);
+	os_slab_alloc_give(&slab, block);
+
+	block = os_slab_alloc_take(&slab, 64);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 64);
+	os_slab_alloc_give(&slab, block);
+
+	block = os_slab_alloc_take(&slab, 65);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 256);
+	os_slab_alloc_give(&slab, block);
+
+	// Nothing's large enough, and there's no fallback.
+	assert_null(os_slab_alloc_take(&slab, 257));
+	assert_null(os_slab_alloc_take(&slab, 0xffffffff));
+}
+
+static void exhaustion_test(void **state)
+{
+	(void) state;
+
+	slab_alloc_t slab;
+	setup_slab(&slab);
+
+	void *blocks[7];
+
+	// Once the 16 byte class runs out, the larger ones get used.
+	for (uint32_t i = 0; i < 7; i++) {
+		blocks[i] = os_slab_alloc_take(&slab, 8);
+		assert_non_null(blocks[i]);
+	}
+
+	assert_int_equal(os_slab_alloc_block_size(&slab, blocks[3]), 16);
+	assert_int_equal(os_slab_alloc_block_size(&slab, blocks[4]), 64);
+	assert_int_equal(os_slab_alloc_block_size(&slab, blocks[6]), 256);
+
+	assert_null(os_slab_alloc_take(&slab, 8));
+
+	// Freed blocks go back to the class they came from.
+	os_slab_alloc_give(&slab, blocks[6]);
+	assert_ptr_equal(os_slab_alloc_take(&slab, 200), blocks[6]);
+
+	os_slab_alloc_give(&slab, NULL);
+}
+
+static void realloc_test(void **state)
+{
+	(void) state;
+
+	slab_alloc_t slab;
+	setup_slab(&slab);
+
+	char *block = os_slab_alloc_realloc(&slab, NULL, 10);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 16);
+	memcpy(block, "0123456789abcde", 16);
+
+	// Growing within the block keeps it in place.
+	assert_ptr_equal(os_slab_alloc_realloc(&slab, block, 16), block);
+
+	char *moved = os_slab_alloc_realloc(&slab, block, 40);
+	assert_int_equal(os_slab_alloc_block_size(&slab, moved), 64);
+	assert_string_equal(moved, "0123456789abcde");
+
+	// A failed realloc leaves the block untouched.
+	assert_null(os_slab_alloc_realloc(&slab, moved, 1000));
+	assert_string_equal(moved, "0123456789abcde");
+
+	assert_null(os_slab_alloc_realloc(&slab, moved, 0));
+}
+
+static void fallback_test(void **state)
+{
+	(void) state;
+
+	slab_alloc_t slab;
+	setup_slab(&slab);
+	os_slab_alloc_set_fallback(&slab, fallback_alloc, fallback_free,
+	                           fallback_realloc);
+
+	fallback_calls = 0;
+
+	char *block = os_slab_alloc_take(&slab, 1000);
+	assert_non_null(block);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 0);
+	assert_int_equal(fallback_calls, 1);
+
+	strcpy(block, "fallback");
+	block = os_slab_alloc_realloc(&slab, block, 2000);
+	assert_string_equal(block, "fallback");
+	assert_int_equal(fallback_calls, 2);
+
+	os_slab_alloc_give(&slab, block);
+	assert_int_equal(fallback_calls, 3);
+
+	// Small blocks still come from the classes.
+	block = os_slab_alloc_take(&slab, 16);
+	assert_int_equal(os_slab_alloc_block_size(&slab, block), 16);
+	assert_int_equal(fallback_calls, 3);
+}
+
+static void bad_class_test(void **state)
+{
+	(void) state;
+
+	slab_alloc_t slab;
+	setup_slab(&slab);
+
+	static uint64_t mem[64];
+
+	expect_assert_failure(os_slab_alloc_add_class(&slab, mem, 48, 2));
+	expect_assert_failure(os_slab_alloc_add_class(&slab, mem, 8, 2));
+	expect_assert_failure(os_slab_alloc_add_class(&slab, mem, 4096, 2));
+	expect_assert_failure(os_slab_alloc_add_class(&slab, mem, 64, 2));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(size_class_test),
+		cmocka_unit_test(exhaustion_test),
+		cmocka_unit_test(realloc_test),
+		cmocka_unit_test(fallback_test),
+		cmocka_unit_test(bad_class_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,227 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS resources.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <mouros/sync.h>
+
+#include "scheduler.h"
+
+extern void (*stub_task_yield_hook)(void);
+extern uint64_t stub_timestamp;
+
+
+/** The task owning the contended resource. */
+static struct tcb owner = { .id = 1, .priority = 3, .state = TASK_RUNNING };
+/** The task waiting for the contended resource. */
+static struct tcb waiter = { .id = 2, .priority = 3, .state = TASK_RUNNING };
+
+/** The resource released by release_on_yield(). */
+static resource_t *yield_res = NULL;
+/** The time release_on_yield() releases yield_res at. */
+static uint64_t yield_release_time = 0;
+
+
+static void release_on_yield(void)
+{
+	// The owner runs and releases the resource while the waiter is blocked.
+	current_task = &owner;
+	stub_timestamp = yield_release_time;
+
+	os_resource_release(yield_res);
+
+	current_task = &waiter;
+}
+
+/**
+ * Acquires res from the waiter while the owner holds it. The owner acquires
+ * res at acquire_time, the waiter tries at wait_time, and the owner releases
+ * it at release_time.
+ */
+static void contend(resource_t *res,
+                    uint64_t acquire_time,
+                    uint64_t wait_time,
+                    uint64_t release_time)
+{
+	current_task = &owner;
+	stub_timestamp = acquire_time;
+	os_resource_acquire(res);
+
+	current_task = &waiter;
+	stub_timestamp = wait_time;
+	yield_res = res;
+	yield_release_time = release_time;
+	stub_task_yield_hook = release_on_yield;
+
+	expect_value(sched_add_to_runqueue_head, task, &waiter);
+
+	os_resource_acquire(res);
+
+	stub_task_yield_hook = NULL;
+
+	assert_ptr_equal(res->acquired_by, &waiter);
+	assert_null(res->first_waiting);
+	assert_int_equal(waiter.state, TASK_RUNNABLE);
+	waiter.state = TASK_RUNNING;
+}
+
+static void uncontended_test(void **state)
+{
+	(void) state;
+
+	static resource_t res;
+	resource_stats_t stats;
+
+	current_task = &owner;
+
+	stub_timestamp = 100;
+	os_resource_acquire(&res);
+
+	// Acquiring a resource again doesn't count.
+	stub_timestamp = 150;
+	os_resource_acquire(&res);
+
+	stub_timestamp = 250;
+	os_resource_release(&res);
+
+	os_resource_get_stats(&res, &stats);
+
+	assert_ptr_equal(stats.resource, &res);
+	assert_int_equal(stats.num_acquires, 1);
+	assert_int_equal(stats.num_contended, 0);
+	assert_int_equal(stats.total_wait, 0);
+	assert_int_equal(stats.max_wait, 0);
+	assert_int_equal(stats.total_hold, 150);
+	assert_int_equal(stats.max_hold, 150);
+
+	// Releasing a resource not owned doesn't count either.
+	stub_timestamp = 1000;
+	os_resource_release(&res);
+
+	os_resource_get_stats(&res, &stats);
+	assert_int_equal(stats.total_hold, 150);
+
+	current_task = NULL;
+}
+
+static void contended_test(void **state)
+{
+	(void) state;
+
+	static resource_t res;
+	resource_stats_t stats;
+
+	contend(&res, 100, 200, 500);
+
+	stub_timestamp = 600;
+	os_resource_release(&res);
+
+	os_resource_get_stats(&res, &stats);
+
+	assert_int_equal(stats.num_acquires, 2);
+	assert_int_equal(stats.num_contended, 1);
+	assert_int_equal(stats.total_wait, 300);
+	assert_int_equal(stats.max_wait, 300);
+	assert_int_equal(stats.total_hold, 400 + 100);
+	assert_int_equal(stats.max_hold, 400);
+
+	contend(&res, 1000, 1100, 1150);
+
+	stub_timestamp = 1400;
+	os_resource_release(&res);
+
+	os_resource_get_stats(&res, &stats);
+
+	assert_int_equal(stats.num_acquires, 4);
+	assert_int_equal(stats.num_contended, 2);
+	assert_int_equal(stats.total_wait, 300 + 50);
+	assert_int_equal(stats.max_wait, 300);
+	assert_int_equal(stats.total_hold, 500 + 150 + 250);
+	assert_int_equal(stats.max_hold, 400);
+
+	os_resource_reset_stats(&res);
+	os_resource_get_stats(&res, &stats);
+
+	assert_int_equal(stats.num_acquires, 0);
+	assert_int_equal(stats.num_contended, 0);
+	assert_int_equal(stats.total_wait, 0);
+	assert_int_equal(stats.total_hold, 0);
+	assert_int_equal(stats.max_wait, 0);
+	assert_int_equal(stats.max_hold, 0);
+
+	current_task = NULL;
+}
+
+static void top_contended_test(void **state)
+{
+	(void) state;
+
+	static resource_t res[4];
+	resource_stats_t top[3];
+	resource_stats_t earlier[8];
+
+	// Forget the contention in the other tests.
+	uint32_t num = os_resource_get_top_contended(earlier, 8);
+
+	for (uint32_t i = 0; i < num; i++) {
+		os_resource_reset_stats((resource_t *) earlier[i].resource);
+	}
+
+	assert_int_equal(os_resource_get_top_contended(top, 3), 0);
+
+	// res[0]: contended once, for a long time.
+	contend(&res[0], 0, 0, 1000);
+	os_resource_release(&res[0]);
+
+	// res[1]: contended twice.
+	for (uint32_t i = 0; i < 2; i++) {
+		contend(&res[1], 0, 0, 10);
+		os_resource_release(&res[1]);
+	}
+
+	// res[2]: contended once, briefly.
+	contend(&res[2], 0, 0, 10);
+	os_resource_release(&res[2]);
+
+	// res[3]: never contended.
+	current_task = &owner;
+	os_resource_acquire(&res[3]);
+	os_resource_release(&res[3]);
+
+	assert_int_equal(os_resource_get_top_contended(top, 3), 3);
+	assert_ptr_equal(top[0].resource, &res[1]);
+	assert_ptr_equal(top[1].resource, &res[0]);
+	assert_ptr_equal(top[2].resource, &res[2]);
+	assert_int_equal(top[0].num_contended, 2);
+	assert_int_equal(top[1].total_wait, 1000);
+
+	// The least contended resource is dropped if the array is short.
+	assert_int_equal(os_resource_get_top_contended(top, 2), 2);
+	assert_ptr_equal(top[0].resource, &res[1]);
+	assert_ptr_equal(top[1].resource, &res[0]);
+
+	assert_int_equal(os_resource_get_top_contended(top, 0), 0);
+
+	current_task = NULL;
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(uncontended_test),
+		cmocka_unit_test(contended_test),
+		cmocka_unit_test(top_contended_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS task reentrancy struct functions.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <mouros/tasks.h>
+
+#include "scheduler.h"
+
+#define BLOCK_SIZE 32
+#define NUM_BLOCKS 2
+
+static uint64_t backing_memory[NUM_BLOCKS][BLOCK_SIZE / sizeof(uint64_t)];
+
+static pool_alloc_t pool;
+
+static struct _reent global_reent;
+
+struct _reent *_impure_ptr = &global_reent;
+struct _reent *const _global_impure_ptr = &global_reent;
+
+/**
+ * Returns the number of free blocks in the pool.
+ */
+static uint32_t num_free_blocks(void)
+{
+	pool_alloc_stats_t stats;
+
+	os_pool_alloc_get_stats(&pool, &stats);
+
+	return stats.num_free;
+}
+
+static void alloc_replace_test(void **state)
+{
+	(void) state;
+
+	task_t task = { .reent = NULL, .reent_pool = NULL };
+
+	os_pool_alloc_init(&pool, backing_memory, BLOCK_SIZE, NUM_BLOCKS);
+
+	os_task_set_reent(&task, NULL);
+	assert_ptr_equal(task.reent, &task.reent_data);
+
+	current_task = &task;
+
+	// Allocating a struct makes it the task's, and the one in use.
+	assert_true(os_task_alloc_reent(&task, &pool));
+
+	struct _reent *first = task.reent;
+
+	assert_ptr_not_equal(first, &task.reent_data);
+	assert_ptr_equal(task.reent_pool, &pool);
+	assert_ptr_equal(_impure_ptr, first);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+
+	// Replacing it with another one from the pool gives the first one back.
+	first->_errno = 5;
+
+	assert_true(os_task_alloc_reent(&task, &pool));
+	assert_ptr_not_equal(task.reent, first);
+	assert_int_equal(task.reent->_errno, 0);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+
+	// So does replacing it with a struct not from a pool, or the default.
+	struct _reent own_reent;
+
+	os_task_set_reent(&task, &own_reent);
+	assert_ptr_equal(task.reent, &own_reent);
+	assert_null(task.reent_pool);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+
+	assert_true(os_task_alloc_reent(&task, &pool));
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS - 1);
+
+	os_task_set_reent(&task, NULL);
+	assert_ptr_equal(task.reent, &task.reent_data);
+	assert_ptr_equal(_impure_ptr, &task.reent_data);
+	assert_int_equal(num_free_blocks(), NUM_BLOCKS);
+
+	current_task = NULL;
+}
+
+static void pool_empty_test(void **state)
+{
+	(void) state;
+
+	task_t task = { .reent = NULL, .reent_pool = NULL };
+	void *blocks[NUM_BLOCKS];
+
+	_impure_ptr = &global_reent;
+
+	os_pool_alloc_init(&pool, backing_memory, BLOCK_SIZE, NUM_BLOCKS);
+	os_task_set_reent(&task, NULL);
+
+	assert_int_equal(os_pool_alloc_take_n(&pool, blocks, NUM_BLOCKS),
+	                 NUM_BLOCKS);
+
+	// The task keeps its struct if the pool is empty.
+	assert_false(os_task_alloc_reent(&task, &pool));
+	assert_ptr_equal(task.reent, &task.reent_data);
+	assert_null(task.reent_pool);
+
+	// Replacing a struct the task doesn't run with leaves _impure_ptr alone.
+	os_pool_alloc_give(&pool, blocks[0]);
+
+	assert_true(os_task_alloc_reent(&task, &pool));
+	assert_ptr_equal(task.reent, blocks[0]);
+	assert_ptr_equal(_impure_ptr, &global_reent);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(alloc_replace_test),
+		cmocka_unit_test(pool_empty_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
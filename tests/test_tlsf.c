@@ -0,0 +1,249 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS TLSF heap.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mouros/tlsf.h>
+
+#define HEAP_SIZE 4096
+
+static uint64_t heap_mem[HEAP_SIZE / sizeof(uint64_t)];
+
+static void alloc_free_test(void **state)
+{
+	(void) state;
+
+	tlsf_t tlsf;
+	tlsf_stats_t initial;
+	tlsf_stats_t stats;
+
+	os_tlsf_init(&tlsf, heap_mem, sizeof(heap_mem));
+	os_tlsf_get_stats(&tlsf, &initial);
+
+	assert_true(initial.total_size <= HEAP_SIZE);
+	assert_true(initial.free_size > HEAP_SIZE - 64);
+	assert_int_equal(initial.num_free_blocks, 1);
+	assert_int_equal(initial.largest_free_block, initial.free_size);
+	assert_int_equal(initial.fragmentation, 0);
+
+	uint8_t *a = os_tlsf_alloc(&tlsf, 1);
+	uint8_t *b = os_tlsf_alloc(&tlsf, 100);
+	uint8_t *c = os_tlsf_alloc(&tlsf, 1000);
+
+	assert_non_null(a);
+	assert_non_null(b);
+	assert_non_null(c);
+
+	// The blocks are aligned and don't overlap.
+	assert_int_equal((uintptr_t) a % (1 << OS_TLSF_ALIGN_SIZE_LOG2), 0);
+	assert_int_equal((uintptr_t) b % (1 << OS_TLSF_ALIGN_SIZE_LOG2), 0);
+	assert_int_equal((uintptr_t) c % (1 << OS_TLSF_ALIGN_SIZE_LOG2), 0);
+	assert_true(os_tlsf_block_size(&tlsf, a) >= 1);
+	assert_true(os_tlsf_block_size(&tlsf, b) >= 100);
+	assert_true(os_tlsf_block_size(&tlsf, c) >= 1000);
+	assert_true(a + os_tlsf_block_size(&tlsf, a) <= b);
+	assert_true(b + os_tlsf_block_size(&tlsf, b) <= c);
+
+	memset(a, 0x11, 1);
+	memset(b, 0x22, 100);
+	memset(c, 0x33, 1000);
+
+	// Freeing a and c leaves b in between, so the heap is fragmented.
+	os_tlsf_free(&tlsf, a);
+	os_tlsf_free(&tlsf, c);
+
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_int_equal(stats.num_free_blocks, 2);
+	assert_true(stats.largest_free_block < stats.free_size);
+	assert_true(stats.fragmentation > 0);
+
+	// Freeing b merges everything back into a single block.
+	os_tlsf_free(&tlsf, b);
+	os_tlsf_free(&tlsf, NULL);
+
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_int_equal(stats.free_size, initial.free_size);
+	assert_int_equal(stats.num_free_blocks, 1);
+	assert_int_equal(stats.fragmentation, 0);
+	assert_true(stats.min_free_size < initial.free_size);
+	assert_int_equal(stats.num_failures, 0);
+}
+
+static void exhaust_test(void **state)
+{
+	(void) state;
+
+	tlsf_t tlsf;
+	tlsf_stats_t stats;
+
+	os_tlsf_init(&tlsf, heap_mem, sizeof(heap_mem));
+
+	assert_null(os_tlsf_alloc(&tlsf, HEAP_SIZE));
+	assert_null(os_tlsf_alloc(&tlsf, UINT32_MAX));
+
+	// Fill the heap with small blocks.
+	uint32_t num_blocks = 0;
+	void *blocks[HEAP_SIZE / 16];
+
+	while ((blocks[num_blocks] = os_tlsf_alloc(&tlsf, 16)) != NULL) {
+		num_blocks++;
+	}
+
+	assert_true(num_blocks > HEAP_SIZE / 64);
+
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_true(stats.free_size < 16);
+	assert_int_equal(stats.min_free_size, stats.free_size);
+	assert_int_equal(stats.num_failures, 3);
+
+	for (uint32_t i = 0; i < num_blocks; i += 2) {
+		os_tlsf_free(&tlsf, blocks[i]);
+	}
+
+	// Plenty of free memory, but no two adjacent blocks.
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_true(stats.free_size >= 16 * (num_blocks / 2));
+	assert_true(stats.fragmentation > 90);
+	assert_null(os_tlsf_alloc(&tlsf, 64));
+
+	for (uint32_t i = 1; i < num_blocks; i += 2) {
+		os_tlsf_free(&tlsf, blocks[i]);
+	}
+
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_int_equal(stats.num_free_blocks, 1);
+	assert_non_null(os_tlsf_alloc(&tlsf, 64));
+}
+
+static void realloc_test(void **state)
+{
+	(void) state;
+
+	tlsf_t tlsf;
+
+	os_tlsf_init(&tlsf, heap_mem, sizeof(heap_mem));
+
+	uint8_t *a = os_tlsf_realloc(&tlsf, NULL, 32);
+	assert_non_null(a);
+
+	for (uint32_t i = 0; i < 32; i++) {
+		a[i] = (uint8_t) i;
+	}
+
+	// The block after a is free, so it grows in place.
+	uint8_t *grown = os_tlsf_realloc(&tlsf, a, 256);
+	assert_ptr_equal(grown, a);
+	assert_true(os_tlsf_block_size(&tlsf, a) >= 256);
+
+	// Shrinking always happens in place.
+	assert_ptr_equal(os_tlsf_realloc(&tlsf, a, 64), a);
+
+	// Now block the way, so that the next growth has to move the block.
+	uint8_t *b = os_tlsf_alloc(&tlsf, 16);
+	assert_true(b > a);
+
+	uint8_t *moved = os_tlsf_realloc(&tlsf, a, 512);
+	assert_non_null(moved);
+	assert_ptr_not_equal(moved, a);
+
+	for (uint32_t i = 0; i < 32; i++) {
+		assert_int_equal(moved[i], i);
+	}
+
+	// A failed realloc leaves the block alone.
+	assert_null(os_tlsf_realloc(&tlsf, moved, HEAP_SIZE));
+	assert_int_equal(moved[31], 31);
+
+	assert_null(os_tlsf_realloc(&tlsf, moved, 0));
+	os_tlsf_free(&tlsf, b);
+
+	tlsf_stats_t stats;
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_int_equal(stats.num_free_blocks, 1);
+}
+
+static void random_test(void **state)
+{
+	(void) state;
+
+	tlsf_t tlsf;
+	tlsf_stats_t initial;
+	tlsf_stats_t stats;
+
+	void *blocks[64] = { NULL };
+	uint32_t sizes[64] = { 0 };
+
+	os_tlsf_init(&tlsf, heap_mem, sizeof(heap_mem));
+	os_tlsf_get_stats(&tlsf, &initial);
+
+	srand(1234);
+
+	for (uint32_t round = 0; round < 10000; round++) {
+		uint32_t i = (uint32_t) rand() % 64;
+
+		if (blocks[i] != NULL) {
+			// Every block keeps its contents.
+			for (uint32_t j = 0; j < sizes[i]; j++) {
+				assert_int_equal(((uint8_t *) blocks[i])[j],
+				                 (uint8_t) i);
+			}
+
+			os_tlsf_free(&tlsf, blocks[i]);
+			blocks[i] = NULL;
+		} else {
+			sizes[i] = (uint32_t) rand() % 300;
+			blocks[i] = os_tlsf_alloc(&tlsf, sizes[i]);
+
+			if (blocks[i] != NULL) {
+				memset(blocks[i], (int) i, sizes[i]);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < 64; i++) {
+		os_tlsf_free(&tlsf, blocks[i]);
+	}
+
+	os_tlsf_get_stats(&tlsf, &stats);
+	assert_int_equal(stats.free_size, initial.free_size);
+	assert_int_equal(stats.num_free_blocks, 1);
+}
+
+static void double_free_test(void **state)
+{
+	(void) state;
+
+	tlsf_t tlsf;
+
+	os_tlsf_init(&tlsf, heap_mem, sizeof(heap_mem));
+
+	void *a = os_tlsf_alloc(&tlsf, 16);
+	os_tlsf_alloc(&tlsf, 16);
+
+	os_tlsf_free(&tlsf, a);
+	expect_assert_failure(os_tlsf_free(&tlsf, a));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(alloc_free_test),
+		cmocka_unit_test(exhaust_test),
+		cmocka_unit_test(realloc_test),
+		cmocka_unit_test(random_test),
+		cmocka_unit_test(double_free_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
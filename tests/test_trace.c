@@ -0,0 +1,244 @@
+/**
+ * @file
+ *
+ * This file contains tests for the MourOS trace ring.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <mouros/trace.h>
+#include <mouros/tasks.h>
+
+/** Everything the output function received. */
+static uint8_t output[4 * OS_TRACE_RING_SIZE];
+static uint32_t output_len = 0;
+
+/** The number of bytes the output function transmits per call at most. */
+static uint32_t send_limit = UINT8_MAX;
+static uint32_t num_send_calls = 0;
+static uint32_t num_errors = 0;
+
+/** The value returned by os_get_timestamp(). */
+static uint64_t timestamp = 0;
+
+uint64_t os_get_timestamp(void)
+{
+	return timestamp;
+}
+
+static uint8_t test_send(uint8_t *msg_buf, uint8_t msg_buf_len)
+{
+	uint8_t len = msg_buf_len;
+
+	if (len > send_limit) {
+		len = (uint8_t) send_limit;
+	}
+
+	memcpy(&output[output_len], msg_buf, len);
+	output_len += len;
+	num_send_calls++;
+
+	return len;
+}
+
+static void test_error(void)
+{
+	num_errors++;
+}
+
+/**
+ * Empties the ring and resets the output.
+ */
+static void reset_output(void)
+{
+	send_limit = UINT8_MAX;
+	os_trace_set_output(test_send, test_error);
+	os_trace_flush();
+
+	output_len = 0;
+	num_send_calls = 0;
+	num_errors = 0;
+}
+
+static void write_flush_test(void **state)
+{
+	(void) state;
+
+	reset_output();
+
+	uint8_t msg[200];
+	trace_stats_t before;
+	trace_stats_t stats;
+
+	for (uint32_t i = 0; i < sizeof(msg); i++) {
+		msg[i] = (uint8_t) i;
+	}
+
+	os_trace_get_stats(&before);
+
+	// Nothing is transmitted when writing.
+	assert_int_equal(os_trace_write(msg, 10), 10);
+	assert_int_equal(os_trace_write(msg, 200), 200);
+	assert_int_equal(num_send_calls, 0);
+
+	os_trace_get_stats(&stats);
+	assert_int_equal(stats.used, 210);
+
+	// Both messages go out in batches of up to 255 bytes.
+	assert_int_equal(os_trace_flush(), 210);
+	assert_int_equal(num_send_calls, 1);
+	assert_int_equal(output_len, 210);
+	assert_memory_equal(output, msg, 10);
+	assert_memory_equal(output + 10, msg, 200);
+
+	os_trace_get_stats(&stats);
+	assert_int_equal(stats.used, 0);
+	assert_int_equal(stats.num_flushed - before.num_flushed, 210);
+	assert_int_equal(stats.num_overflows, before.num_overflows);
+
+	assert_int_equal(os_trace_flush(), 0);
+}
+
+static void wrap_test(void **state)
+{
+	(void) state;
+
+	reset_output();
+
+	uint8_t msg[100];
+	uint32_t total = 0;
+
+	// Write and flush more than the size of the ring, so that the messages
+	// wrap around its end.
+	for (uint32_t round = 0; round < 3 * OS_TRACE_RING_SIZE / 100; round++) {
+		for (uint32_t i = 0; i < sizeof(msg); i++) {
+			msg[i] = (uint8_t) (round + i);
+		}
+
+		os_trace_write(msg, sizeof(msg));
+
+		if (round % 4 == 3) {
+			uint32_t start = output_len;
+
+			total += os_trace_flush();
+
+			for (uint32_t j = 0; j < 4; j++) {
+				for (uint32_t i = 0; i < sizeof(msg); i++) {
+					assert_int_equal(output[start + j * 100 + i],
+					                 (uint8_t) (round - 3 + j + i));
+				}
+			}
+		}
+	}
+
+	assert_int_equal(total, output_len);
+}
+
+static void overflow_test(void **state)
+{
+	(void) state;
+
+	reset_output();
+
+	uint8_t msg[200];
+	trace_stats_t before;
+	trace_stats_t stats;
+
+	memset(msg, 0x5a, sizeof(msg));
+
+	os_trace_get_stats(&before);
+
+	uint32_t num_fit = OS_TRACE_RING_SIZE / sizeof(msg);
+
+	for (uint32_t i = 0; i < num_fit + 2; i++) {
+		assert_int_equal(os_trace_write(msg, sizeof(msg)), sizeof(msg));
+	}
+
+	// The messages that didn't fit are dropped whole.
+	os_trace_get_stats(&stats);
+	assert_int_equal(stats.used, num_fit * sizeof(msg));
+	assert_int_equal(stats.max_used, num_fit * sizeof(msg));
+	assert_int_equal(stats.num_overflows - before.num_overflows, 2);
+
+	assert_int_equal(os_trace_flush(), num_fit * sizeof(msg));
+	assert_int_equal(num_errors, 0);
+}
+
+static void short_send_test(void **state)
+{
+	(void) state;
+
+	reset_output();
+
+	uint8_t msg[50];
+
+	memset(msg, 0x33, sizeof(msg));
+
+	os_trace_write(msg, sizeof(msg));
+
+	// A short send stops the flush and reports an error. The rest is sent
+	// by the next flush.
+	send_limit = 20;
+	assert_int_equal(os_trace_flush(), 20);
+	assert_int_equal(num_errors, 1);
+
+	send_limit = UINT8_MAX;
+	assert_int_equal(os_trace_flush(), 30);
+	assert_int_equal(output_len, 50);
+	assert_int_equal(num_errors, 1);
+
+	// Without an output function nothing is flushed.
+	os_trace_write(msg, sizeof(msg));
+	os_trace_set_output(NULL, NULL);
+	assert_int_equal(os_trace_flush(), 0);
+
+	os_trace_set_output(test_send, test_error);
+	assert_int_equal(os_trace_flush(), 50);
+}
+
+static void compact_event_test(void **state)
+{
+	(void) state;
+
+	reset_output();
+
+	uint32_t args[] = { 3, 0x20001000 };
+
+	// 5000 units after the start, 0x20001000 needs five bytes.
+	timestamp = 5000 << OS_TRACE_TIMESTAMP_SHIFT;
+	os_trace_compact_event(24, args, 2);
+
+	// The time is counted from the previous event, and the steps below the
+	// time unit are dropped.
+	timestamp += (1 << OS_TRACE_TIMESTAMP_SHIFT) + 1;
+	os_trace_compact_event(0, args, 1);
+
+	assert_int_equal(os_trace_flush(), 12);
+
+	const uint8_t expected[] = {
+		24, 0x88, 0x27, 3, 0x80, 0xa0, 0x80, 0x80, 0x02,
+		0, 1, 3
+	};
+
+	assert_memory_equal(output, expected, sizeof(expected));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(write_flush_test),
+		cmocka_unit_test(wrap_test),
+		cmocka_unit_test(overflow_test),
+		cmocka_unit_test(short_send_test),
+		cmocka_unit_test(compact_event_test)
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""
+Turns the PROFILE_SAMPLE events of a MourOS diag capture into a flat profile,
+or into folded stacks for flame graph tools (flamegraph.pl, speedscope, ...).
+
+The samples are taken by the sampling profiler (see include/mouros/profile.h).
+Each holds the PC of the preempted task and the task ID. The PCs are mapped to
+functions with the symbol table of the firmware ELF file, as listed by nm.
+There's no call stack in the samples, so the folded stacks are only two levels
+deep: the task, and the function.
+
+Usage:
+    diag_profile.py src/diag/diag_config.json capture.bin firmware.elf \\
+                    --task-name 1=uart --folded profile.folded
+"""
+
+import argparse
+import bisect
+import collections
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import diag_trace  # noqa: E402
+
+
+#: nm symbol types of code.
+CODE_SYMBOL_TYPES = 'tTwW'
+
+#: The name given to the PCs outside of all the known functions.
+UNKNOWN_FUNCTION = '[unknown]'
+
+
+class SymbolTable:
+    """Maps addresses to the functions containing them."""
+
+    def __init__(self, nm_lines):
+        symbols = {}
+
+        for line in nm_lines:
+            fields = line.split(None, 3)
+
+            # Lines are "address size type name", or "address type name" for
+            # symbols without a size.
+            if len(fields) == 4 and len(fields[2]) == 1:
+                address, size, sym_type, name = fields
+                size = int(size, 16)
+            elif len(fields) >= 3 and len(fields[1]) == 1:
+                address, sym_type = fields[:2]
+                name = line.split(None, 2)[2]
+                size = None
+            else:
+                continue
+
+            if sym_type not in CODE_SYMBOL_TYPES:
+                continue
+
+            # Thumb function symbols have the lowest bit set.
+            address = int(address, 16) & ~1
+
+            # Prefer a sized symbol to an unsized alias at the same address.
+            if address not in symbols or symbols[address][1] is None:
+                symbols[address] = (name.strip(), size)
+
+        self.addresses = sorted(symbols)
+        self.symbols = [symbols[address] for address in self.addresses]
+
+    @classmethod
+    def from_elf(cls, elf_path, nm='arm-none-eabi-nm'):
+        """Reads the symbol table of an ELF file with nm."""
+        output = subprocess.check_output(
+            [nm, '--defined-only', '--print-size', '--numeric-sort',
+             '--demangle', elf_path], universal_newlines=True)
+
+        return cls(output.splitlines())
+
+    def lookup(self, pc):
+        """Returns the name of the function containing pc, or None."""
+        index = bisect.bisect_right(self.addresses, pc) - 1
+
+        if index < 0:
+            return None
+
+        name, size = self.symbols[index]
+
+        if size is not None and pc >= self.addresses[index] + size:
+            return None
+
+        return name
+
+
+def read_samples(event_types, stream, id_size=None):
+    """
+    Decodes the stream, and returns a Counter of the (task ID, PC) pairs of
+    the PROFILE_SAMPLE events, and the Decoder.
+    """
+    decoder = diag_trace.Decoder(event_types, id_size)
+    samples = collections.Counter()
+
+    while True:
+        data = stream.read(diag_trace.CHUNK_SIZE)
+
+        if not data:
+            break
+
+        for event_type, args in decoder.feed(data):
+            if event_type.name == 'PROFILE_SAMPLE':
+                samples[(args['task_id'], args['pc'])] += 1
+
+    return samples, decoder
+
+
+def symbolize(samples, symbols):
+    """
+    Returns a Counter of the (task ID, function name) pairs of the samples.
+    """
+    profile = collections.Counter()
+
+    for (task_id, pc), count in samples.items():
+        profile[(task_id, symbols.lookup(pc) or UNKNOWN_FUNCTION)] += count
+
+    return profile
+
+
+def flat_profile(profile, task_names=None, by_task=False, limit=None):
+    """Returns the lines of a flat profile, hottest functions first."""
+    task_names = task_names or {}
+    total = sum(profile.values())
+    functions = collections.Counter()
+
+    for (task_id, function), count in profile.items():
+        if by_task:
+            task = task_names.get(task_id, 'Task {}'.format(task_id))
+            function = '{} ({})'.format(function, task)
+
+        functions[function] += count
+
+    lines = ['{:>8} {:>7}  {}'.format('Samples', '%', 'Function')]
+
+    for function, count in functions.most_common(limit):
+        lines.append('{:>8} {:>7.2f}  {}'.format(
+            count, 100.0 * count / total, function))
+
+    lines.append('Total samples: {}'.format(total))
+
+    return lines
+
+
+def folded_stacks(profile, task_names=None):
+    """Returns the profile as folded stacks: "task;function count" lines."""
+    task_names = task_names or {}
+    lines = []
+
+    for (task_id, function), count in sorted(profile.items()):
+        task = task_names.get(task_id, 'Task {}'.format(task_id))
+        lines.append('{};{} {}'.format(task, function, count))
+
+    return lines
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Build a profile from the samples in a MourOS diag '
+                    'capture.')
+    parser.add_argument('config', help='the diag_config.json file')
+    parser.add_argument('input', help='the binary capture, or - for stdin')
+    parser.add_argument('elf', nargs='?',
+                        help='the firmware ELF file to take the symbols from')
+    parser.add_argument('--symbols', metavar='FILE',
+                        help='take the symbols from a saved "nm -S -n" listing '
+                             'instead of the ELF file')
+    parser.add_argument('--nm', default='arm-none-eabi-nm',
+                        help='the nm to read the ELF file with (default: '
+                             'arm-none-eabi-nm)')
+    parser.add_argument('--folded', metavar='FILE',
+                        help='also write the profile as folded stacks')
+    parser.add_argument('--by-task', action='store_true',
+                        help='list the functions separately for every task')
+    parser.add_argument('--limit', type=int,
+                        help='list at most this many functions')
+    parser.add_argument('--id-size', type=int, choices=(1, 2),
+                        help='the size of the event IDs in bytes (default: '
+                             'derived from the number of events)')
+    parser.add_argument('--task-name', type=diag_trace.parse_task_name,
+                        action='append', default=[], metavar='ID=NAME',
+                        help='name a task in the profile (repeatable)')
+    args = parser.parse_args(argv)
+
+    if args.symbols is not None:
+        with open(args.symbols) as symbols_file:
+            symbols = SymbolTable(symbols_file.read().splitlines())
+    elif args.elf is not None:
+        symbols = SymbolTable.from_elf(args.elf, args.nm)
+    else:
+        parser.error('either the ELF file or --symbols is needed')
+
+    event_types = diag_trace.load_config(args.config)
+    task_names = dict(args.task_name)
+
+    if args.input == '-':
+        stream = sys.stdin.buffer
+    else:
+        stream = open(args.input, 'rb')
+
+    with stream:
+        samples, decoder = read_samples(event_types, stream, args.id_size)
+
+    if not samples:
+        print('No profiler samples in the capture', file=sys.stderr)
+        return 1
+
+    profile = symbolize(samples, symbols)
+
+    print('\n'.join(flat_profile(profile, task_names, args.by_task,
+                                 args.limit)))
+
+    if args.folded is not None:
+        with open(args.folded, 'w') as folded_file:
+            folded_file.write('\n'.join(folded_stacks(profile, task_names)))
+            folded_file.write('\n')
+
+    if decoder.num_skipped > 0 or decoder.buf:
+        print('Warning: skipped {} corrupted and {} trailing bytes'.format(
+            decoder.num_skipped, len(decoder.buf)), file=sys.stderr)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
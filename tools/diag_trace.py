@@ -0,0 +1,492 @@
+#!/usr/bin/env python3
+"""
+Decodes the MourOS diagnostic stream and exports it as a Chrome / Perfetto
+JSON trace (viewable in ui.perfetto.dev or chrome://tracing), together with a
+per-task CPU usage summary.
+
+The stream is read as produced by the generated diag functions: every message
+is the index of its event in diag_config.json (1 byte, or 2 bytes if there are
+more than 256 events), followed by the event's arguments packed little-endian
+without any padding.
+
+Events marked "compact" in diag_config.json are logged in the compact encoding
+once a TRACE_CLOCK event was seen (see include/mouros/trace.h): the event index,
+followed by the time since the previous compact event and the remaining
+arguments, all as LEB128 varints. The time unit is given by TRACE_CLOCK.
+
+The stream is decoded in chunks, and the trace is written out as it's decoded,
+so the memory use doesn't grow with the length of the capture.
+
+Usage:
+    diag_trace.py src/diag/diag_config.json capture.bin -o trace.json \\
+                  --task-name 1=uart --task-name 2=control
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+
+#: struct format characters of the argument types used in diag_config.json.
+ARG_FORMATS = {
+    'uint8_t': 'B',
+    'int8_t': 'b',
+    'uint16_t': 'H',
+    'int16_t': 'h',
+    'uint32_t': 'I',
+    'int32_t': 'i',
+    'uint64_t': 'Q',
+    'int64_t': 'q',
+    'float': 'f',
+    'double': 'd',
+}
+
+#: The Chrome trace process holding the task tracks.
+TASKS_PID = 0
+#: The Chrome trace process holding the interrupt tracks.
+IRQS_PID = 1
+
+#: The number of the first external interrupt in the exception numbering.
+FIRST_IRQ_EXCEPTION = 16
+
+#: Names of the task states in TASK_BLOCK, indexed by the tcb state enum.
+TASK_STATES = [
+    'runnable',
+    'waiting for resource',
+    'waiting for mailbox',
+    'waiting for block',
+    'sleeping',
+    'suspended',
+    'running',
+    'stopped',
+]
+
+#: The size of the chunks the input is read in.
+CHUNK_SIZE = 64 * 1024
+
+
+class EventType:
+    """A diag event, as described by an entry of diag_config.json."""
+
+    def __init__(self, event_id, config):
+        self.id = event_id
+        self.name = config['name']
+        self.text = config.get('text', self.name)
+        self.compact = config.get('compact', False)
+        self.category = config.get('category', '')
+        self.arg_names = [arg['name'] for arg in config.get('args', [])]
+        self.struct = struct.Struct(
+            '<' + ''.join(ARG_FORMATS[arg['type']]
+                          for arg in config.get('args', [])))
+
+    def format(self, args):
+        """Returns the text of the event with the arguments filled in."""
+        return self.text.format(**args)
+
+
+def load_config(path):
+    """Returns the list of EventTypes described by the diag config file."""
+    with open(path) as config_file:
+        config = json.load(config_file)
+
+    return [EventType(event_id, event) for event_id, event in enumerate(config)]
+
+
+class Decoder:
+    """
+    Splits the diag stream into events. The stream can be fed in chunks of any
+    size; messages split between chunks are kept until they're complete.
+    """
+
+    def __init__(self, event_types, id_size=None):
+        self.event_types = event_types
+        self.id_size = id_size or (1 if len(event_types) <= 256 else 2)
+        self.buf = bytearray()
+        #: The number of bytes skipped because they didn't start a known event.
+        self.num_skipped = 0
+        #: True once TRACE_CLOCK was seen, i.e. the compact events are in use.
+        self.compact_enabled = False
+        #: The timestamp of the last compact event.
+        self.compact_timestamp = 0
+
+    @staticmethod
+    def read_varint(buf, pos):
+        """
+        Reads an LEB128 varint. Returns the value and the position after it, or
+        None if the varint isn't complete.
+        """
+        value = 0
+        shift = 0
+
+        while pos < len(buf):
+            byte = buf[pos]
+            value |= (byte & 0x7f) << shift
+            pos += 1
+
+            if byte & 0x80 == 0:
+                return value, pos
+
+            shift += 7
+
+        return None
+
+    def decode_compact(self, event_type, pos):
+        """
+        Decodes the arguments of a compact event starting at pos. Returns the
+        arguments and the position after them, or None if the event isn't
+        complete.
+        """
+        args = {}
+
+        for arg_name in event_type.arg_names:
+            result = self.read_varint(self.buf, pos)
+
+            if result is None:
+                return None
+
+            args[arg_name], pos = result
+
+        if 'timestamp' in args:
+            args['timestamp'] += self.compact_timestamp
+
+        return args, pos
+
+    def feed(self, data):
+        """
+        Decodes as much of the stream as possible.
+
+        Returns a list of (EventType, dict of arguments) tuples.
+        """
+        self.buf += data
+
+        events = []
+        pos = 0
+
+        while len(self.buf) - pos >= self.id_size:
+            event_id = int.from_bytes(self.buf[pos:pos + self.id_size],
+                                      'little')
+
+            if event_id >= len(self.event_types):
+                # Corrupted or truncated data. Resynchronize byte by byte.
+                self.num_skipped += 1
+                pos += 1
+                continue
+
+            event_type = self.event_types[event_id]
+
+            if event_type.compact and self.compact_enabled:
+                result = self.decode_compact(event_type, pos + self.id_size)
+
+                if result is None:
+                    break
+
+                args, pos = result
+                self.compact_timestamp = args.get('timestamp',
+                                                  self.compact_timestamp)
+            else:
+                end = pos + self.id_size + event_type.struct.size
+
+                if end > len(self.buf):
+                    break
+
+                values = event_type.struct.unpack_from(self.buf,
+                                                       pos + self.id_size)
+                args = dict(zip(event_type.arg_names, values))
+                pos = end
+
+                if event_type.name == 'TRACE_CLOCK':
+                    self.compact_enabled = True
+
+            events.append((event_type, args))
+
+        del self.buf[:pos]
+
+        return events
+
+
+class TaskStats:
+    """CPU usage of a single task."""
+
+    def __init__(self):
+        self.run_time = 0.0
+        self.num_runs = 0
+        self.block_time = 0.0
+        self.num_blocks = 0
+
+
+class TraceWriter:
+    """
+    Turns decoded events into Chrome trace events, and writes them to a file
+    as they come. Keeps only the state of the currently open intervals.
+    """
+
+    def __init__(self, out, tick_us=1000.0, task_names=None):
+        self.out = out
+        self.tick_us = tick_us
+        self.task_names = task_names or {}
+        self.num_written = 0
+
+        self.stats = {}
+        self.named_tracks = set()
+
+        # The running task, and the time it was switched in.
+        self.running = None
+        self.running_since = 0.0
+        # The blocked tasks, mapped to the time and reason they blocked.
+        self.blocked = {}
+
+        # The length of the compact event time unit, once known.
+        self.compact_unit_us = None
+
+        self.first_ts = None
+        self.last_ts = 0.0
+
+        self.out.write('{"traceEvents":[\n')
+
+    def task_name(self, task_id):
+        return self.task_names.get(task_id, 'Task {}'.format(task_id))
+
+    def write(self, event):
+        if self.num_written > 0:
+            self.out.write(',\n')
+
+        self.out.write(json.dumps(event, separators=(',', ':')))
+        self.num_written += 1
+
+    def name_track(self, pid, tid, name):
+        """Names a track the first time it's used."""
+        if (pid, tid) in self.named_tracks:
+            return
+
+        self.named_tracks.add((pid, tid))
+        self.write({'ph': 'M', 'name': 'thread_name', 'pid': pid, 'tid': tid,
+                    'args': {'name': name}})
+
+    def task_stats(self, task_id):
+        if task_id not in self.stats:
+            self.stats[task_id] = TaskStats()
+            self.name_track(TASKS_PID, task_id, self.task_name(task_id))
+
+        return self.stats[task_id]
+
+    def interval(self, pid, tid, name, start, end, args=None):
+        event = {'ph': 'X', 'name': name, 'pid': pid, 'tid': tid,
+                 'ts': start, 'dur': end - start}
+
+        if args:
+            event['args'] = args
+
+        self.write(event)
+
+    def instant(self, pid, tid, name, ts, args=None, category=None):
+        event = {'ph': 'i', 's': 't', 'name': name, 'pid': pid, 'tid': tid,
+                 'ts': ts}
+
+        if category:
+            event['cat'] = category
+
+        if args:
+            event['args'] = args
+
+        self.write(event)
+
+    def end_run(self, ts):
+        if self.running is None:
+            return
+
+        stats = self.task_stats(self.running)
+        stats.run_time += ts - self.running_since
+        stats.num_runs += 1
+
+        self.interval(TASKS_PID, self.running, 'running', self.running_since,
+                      ts)
+        self.running = None
+
+    def end_block(self, task_id, ts, woken_by):
+        if task_id not in self.blocked:
+            return
+
+        start, state, obj = self.blocked.pop(task_id)
+
+        stats = self.task_stats(task_id)
+        stats.block_time += ts - start
+        stats.num_blocks += 1
+
+        self.interval(TASKS_PID, task_id, state, start, ts,
+                      {'object': '0x{:08x}'.format(obj),
+                       'woken by': woken_by})
+
+    def handle(self, event_type, args):
+        """Processes a single decoded event."""
+        # Events without a timestamp (e.g. the syscalls) are placed at the
+        # time of the last timestamped event.
+        if 'timestamp' in args:
+            if event_type.compact and self.compact_unit_us is not None:
+                ts = args['timestamp'] * self.compact_unit_us
+            else:
+                ts = args['timestamp'] * self.tick_us
+
+            self.last_ts = max(self.last_ts, ts)
+
+            if self.first_ts is None:
+                self.first_ts = ts
+        else:
+            ts = self.last_ts
+
+        name = event_type.name
+
+        if name == 'TRACE_CLOCK':
+            self.compact_unit_us = ((1 << args['shift']) * 1e6 /
+                                    args['frequency'])
+
+        elif name == 'TASK_SWITCH':
+            self.end_run(ts)
+            self.running = args['to_id']
+            self.running_since = ts
+            self.task_stats(self.running)
+
+        elif name == 'TASK_BLOCK':
+            state = args['state']
+            state_name = (TASK_STATES[state] if state < len(TASK_STATES)
+                          else 'state {}'.format(state))
+
+            self.task_stats(args['task_id'])
+            self.blocked[args['task_id']] = (ts, state_name, args['object'])
+
+        elif name == 'TASK_WAKE':
+            exception = args['exception']
+
+            if exception == 0:
+                woken_by = 'task'
+            else:
+                woken_by = self.irq_name(exception)
+                self.name_track(IRQS_PID, exception, woken_by)
+                self.instant(IRQS_PID, exception, 'wake', ts,
+                             {'task': self.task_name(args['task_id'])})
+
+            self.end_block(args['task_id'], ts, woken_by)
+
+        else:
+            tid = args.get('task_id', self.running)
+
+            if tid is None:
+                tid = -1
+                self.name_track(TASKS_PID, tid, 'Unknown task')
+
+            self.instant(TASKS_PID, tid, name, ts,
+                         {'text': event_type.format(args)},
+                         event_type.category)
+
+    @staticmethod
+    def irq_name(exception):
+        if exception >= FIRST_IRQ_EXCEPTION:
+            return 'IRQ {}'.format(exception - FIRST_IRQ_EXCEPTION)
+
+        return 'Exception {}'.format(exception)
+
+    def finish(self):
+        """Closes the open intervals, and terminates the trace file."""
+        # A task switched in by the last event didn't run for any measurable
+        # time.
+        if self.last_ts > self.running_since:
+            self.end_run(self.last_ts)
+
+        for task_id in list(self.blocked):
+            self.end_block(task_id, self.last_ts, 'end of trace')
+
+        self.out.write('\n],"displayTimeUnit":"ns"}\n')
+
+    def summary(self):
+        """Returns the per-task CPU usage summary as a list of lines."""
+        duration = self.last_ts - (self.first_ts or 0.0)
+        lines = ['{:>4} {:<16} {:>8} {:>14} {:>7} {:>14}'.format(
+            'ID', 'Task', 'Runs', 'CPU time [ms]', 'CPU [%]',
+            'Blocked [ms]')]
+
+        for task_id in sorted(self.stats):
+            stats = self.stats[task_id]
+            share = 100.0 * stats.run_time / duration if duration > 0 else 0.0
+
+            lines.append('{:>4} {:<16} {:>8} {:>14.3f} {:>7.2f} {:>14.3f}'.format(
+                task_id, self.task_name(task_id)[:16], stats.num_runs,
+                stats.run_time / 1000.0, share, stats.block_time / 1000.0))
+
+        lines.append('Trace duration: {:.3f} ms'.format(duration / 1000.0))
+
+        return lines
+
+
+def convert(event_types, stream, out, tick_us=1000.0, task_names=None,
+            id_size=None):
+    """
+    Decodes the whole stream and writes the trace to out. Returns the
+    TraceWriter, holding the statistics, and the Decoder.
+    """
+    decoder = Decoder(event_types, id_size)
+    writer = TraceWriter(out, tick_us, task_names)
+
+    while True:
+        data = stream.read(CHUNK_SIZE)
+
+        if not data:
+            break
+
+        for event_type, args in decoder.feed(data):
+            writer.handle(event_type, args)
+
+    writer.finish()
+
+    return writer, decoder
+
+
+def parse_task_name(value):
+    task_id, sep, name = value.partition('=')
+
+    if not sep:
+        raise argparse.ArgumentTypeError('expected ID=NAME')
+
+    return int(task_id, 0), name
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        description='Convert a MourOS diag capture to a Chrome/Perfetto trace.')
+    parser.add_argument('config', help='the diag_config.json file')
+    parser.add_argument('input', help='the binary capture, or - for stdin')
+    parser.add_argument('-o', '--output', default='trace.json',
+                        help='the trace file to write (default: trace.json)')
+    parser.add_argument('--tick-us', type=float, default=1000.0,
+                        help='the length of an OS tick in microseconds '
+                             '(default: 1000)')
+    parser.add_argument('--id-size', type=int, choices=(1, 2),
+                        help='the size of the event IDs in bytes (default: '
+                             'derived from the number of events)')
+    parser.add_argument('--task-name', type=parse_task_name, action='append',
+                        default=[], metavar='ID=NAME',
+                        help='name a task in the trace (repeatable)')
+    args = parser.parse_args(argv)
+
+    event_types = load_config(args.config)
+    task_names = dict(args.task_name)
+
+    if args.input == '-':
+        stream = sys.stdin.buffer
+    else:
+        stream = open(args.input, 'rb')
+
+    with stream, open(args.output, 'w') as out:
+        writer, decoder = convert(event_types, stream, out, args.tick_us,
+                                  task_names, args.id_size)
+
+    print('\n'.join(writer.summary()))
+
+    if decoder.num_skipped > 0 or decoder.buf:
+        print('Warning: skipped {} corrupted and {} trailing bytes'.format(
+            decoder.num_skipped, len(decoder.buf)), file=sys.stderr)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())